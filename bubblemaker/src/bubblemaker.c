@@ -28,67 +28,154 @@
 
 LOG_MODULE_REGISTER(bubblemaker);
 
-#define IDLE_STATE_DURATION K_MSEC(500)
 #define RED_LIGHT_DURATION K_SECONDS(2)
 #define YELLOW_LIGHT_DURATION K_SECONDS(1)
 #define MEASURE_STATE_DURATION K_SECONDS(10)
 #define END_STATE_DURATION K_SECONDS(3)
 
+#define BUBBLEMAKER_MAX_SUBSCRIBERS 4
+
+/*
+ * The game is driven by the events posted as bits of a kernel event object:
+ * the start requested from the shell, LwM2M or the Water Meter reset, and the
+ * expiry of the single timer that measures the duration of the current state.
+ * Posting a bit cannot fail, unlike a put to a full queue, so a burst of start
+ * requests cannot drop a timeout and leave the game stuck in one state; the
+ * start requests themselves coalesce. The state is only changed by the
+ * Bubblemaker thread, which publishes it to the subscribers.
+ */
+#define BUBBLEMAKER_EVENT_START BIT(0)
+#define BUBBLEMAKER_EVENT_TIMEOUT BIT(1)
+#define BUBBLEMAKER_EVENTS_ALL (BUBBLEMAKER_EVENT_START | BUBBLEMAKER_EVENT_TIMEOUT)
+
 static struct k_thread bubblemaker_thread;
 static K_THREAD_STACK_DEFINE(bubblemaker_stack, 1024);
 
-enum bubblemaker_state bm_state = BUBBLEMAKER_IDLE;
+static K_EVENT_DEFINE(bubblemaker_events);
 
-static void run_bubblemaker(void *arg1, void *arg2, void *arg3)
+static void state_timer_handler(struct k_timer *timer)
 {
-	LOG_INF("Waiting for Water meter instances to initialize...");
+	(void)timer;
 
-	while (water_meter_is_null()) {
-		k_sleep(K_SECONDS(1));
+	k_event_post(&bubblemaker_events, BUBBLEMAKER_EVENT_TIMEOUT);
+}
+
+static K_TIMER_DEFINE(state_timer, state_timer_handler, NULL);
+
+static enum bubblemaker_state bm_state = BUBBLEMAKER_IDLE;
+
+static bubblemaker_state_handler_t *subscribers[BUBBLEMAKER_MAX_SUBSCRIBERS];
+static size_t subscriber_count;
+
+int bubblemaker_subscribe(bubblemaker_state_handler_t *handler)
+{
+	if (subscriber_count >= ARRAY_SIZE(subscribers)) {
+		LOG_ERR("Too many Bubblemaker state subscribers");
+		return -1;
 	}
+	subscribers[subscriber_count++] = handler;
+	return 0;
+}
 
-	while (1) {
-		switch (bm_state) {
-		case BUBBLEMAKER_IDLE:
-			k_sleep(IDLE_STATE_DURATION);
-			break;
-		case BUBBLEMAKER_START_RED_LIGHT:
-			k_sleep(RED_LIGHT_DURATION);
-			bm_state = BUBBLEMAKER_START_YELLOW_LIGHT;
-			break;
-		case BUBBLEMAKER_START_YELLOW_LIGHT:
-			k_sleep(YELLOW_LIGHT_DURATION);
-			bm_state = BUBBLEMAKER_MEASURE;
-			break;
-		case BUBBLEMAKER_MEASURE:
-			water_meter_instances_reset();
-			k_sleep(MEASURE_STATE_DURATION);
-#if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-			double out_volumes[2];
+void bubblemaker_request_start(void)
+{
+	k_event_post(&bubblemaker_events, BUBBLEMAKER_EVENT_START);
+}
 
-			water_meter_get_cumulated_volumes(out_volumes);
-			bm_state = out_volumes[0] > out_volumes[1] ? BUBBLEMAKER_END_P1_WON :
-								     BUBBLEMAKER_END_P2_WON;
+static k_timeout_t state_duration(enum bubblemaker_state state)
+{
+	switch (state) {
+	case BUBBLEMAKER_IDLE:
+		return K_FOREVER;
+	case BUBBLEMAKER_START_RED_LIGHT:
+		return RED_LIGHT_DURATION;
+	case BUBBLEMAKER_START_YELLOW_LIGHT:
+		return YELLOW_LIGHT_DURATION;
+	case BUBBLEMAKER_MEASURE:
+		return MEASURE_STATE_DURATION;
+#if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
+	case BUBBLEMAKER_END_P1_WON:
+	case BUBBLEMAKER_END_P2_WON:
 #else // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-			bm_state = BUBBLEMAKER_END;
+	case BUBBLEMAKER_END:
 #endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-			break;
+		return END_STATE_DURATION;
+	default:
+		AVS_UNREACHABLE("Invalid enum value");
+		return K_FOREVER;
+	}
+}
+
+static void enter_state(enum bubblemaker_state state)
+{
+	bm_state = state;
+
+	switch (state) {
+	case BUBBLEMAKER_START_RED_LIGHT:
+	case BUBBLEMAKER_MEASURE:
 #if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-		case BUBBLEMAKER_END_P1_WON:
-		case BUBBLEMAKER_END_P2_WON:
-			water_meter_instances_reset();
-			k_sleep(END_STATE_DURATION);
-			bm_state = BUBBLEMAKER_IDLE;
-			break;
+	case BUBBLEMAKER_END_P1_WON:
+	case BUBBLEMAKER_END_P2_WON:
+#endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
+		water_meter_instances_reset();
+		break;
+	default:
+		break;
+	}
+
+	k_timeout_t duration = state_duration(state);
+
+	if (!K_TIMEOUT_EQ(duration, K_FOREVER)) {
+		k_timer_start(&state_timer, duration, K_NO_WAIT);
+	}
+
+	for (size_t i = 0; i < subscriber_count; i++) {
+		subscribers[i](state);
+	}
+}
+
+static enum bubblemaker_state state_after_timeout(enum bubblemaker_state state)
+{
+	switch (state) {
+	case BUBBLEMAKER_START_RED_LIGHT:
+		return BUBBLEMAKER_START_YELLOW_LIGHT;
+	case BUBBLEMAKER_START_YELLOW_LIGHT:
+		return BUBBLEMAKER_MEASURE;
+	case BUBBLEMAKER_MEASURE: {
+#if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
+		double out_volumes[2];
+
+		water_meter_get_cumulated_volumes(out_volumes);
+		return out_volumes[0] > out_volumes[1] ? BUBBLEMAKER_END_P1_WON :
+							 BUBBLEMAKER_END_P2_WON;
 #else // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-		case BUBBLEMAKER_END:
-			k_sleep(END_STATE_DURATION);
-			bm_state = BUBBLEMAKER_IDLE;
-			break;
+		return BUBBLEMAKER_END;
 #endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-		default:
-			AVS_UNREACHABLE("Invalid enum value");
-			break;
+	}
+	default:
+		return BUBBLEMAKER_IDLE;
+	}
+}
+
+static void run_bubblemaker(void *arg1, void *arg2, void *arg3)
+{
+	LOG_INF("Waiting for Water meter instances to initialize...");
+
+	water_meter_wait_created();
+	enter_state(BUBBLEMAKER_IDLE);
+
+	while (1) {
+		uint32_t events =
+			k_event_wait(&bubblemaker_events, BUBBLEMAKER_EVENTS_ALL, false, K_FOREVER);
+
+		k_event_clear(&bubblemaker_events, events);
+
+		// a start is ignored during a game, even one ending with this timeout
+		if ((events & BUBBLEMAKER_EVENT_START) && bm_state == BUBBLEMAKER_IDLE) {
+			enter_state(BUBBLEMAKER_START_RED_LIGHT);
+		}
+		if (events & BUBBLEMAKER_EVENT_TIMEOUT) {
+			enter_state(state_after_timeout(bm_state));
 		}
 	}
 }
@@ -31,6 +31,19 @@ enum bubblemaker_state {
 #endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
 };
 
-extern enum bubblemaker_state bm_state;
+typedef void bubblemaker_state_handler_t(enum bubblemaker_state state);
+
+/**
+ * Registers @p handler to be called from the Bubblemaker thread whenever the
+ * game enters a state, starting with BUBBLEMAKER_IDLE once the Water Meter
+ * object is created. The handler must not block. Must be called before
+ * bubblemaker_init() returns, e.g. from the init functions it calls.
+ */
+int bubblemaker_subscribe(bubblemaker_state_handler_t *handler);
+
+/**
+ * Starts a game if none is in progress. Safe to call from any thread.
+ */
+void bubblemaker_request_start(void);
 
 int bubblemaker_init(void);
@@ -0,0 +1,25 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// probes of the Latency Statistics object, see latency_stats.h
+#define LATENCY_PROBES(X)                                                                          \
+	X(LWM2M_CALLBACK, "lwm2m_callback")                                                        \
+	X(UPDATE_OBJECTS, "update_objects")                                                        \
+	X(WATER_METER_READ, "water_meter_read")                                                    \
+	X(WATER_PUMP_READ, "water_pump_read")                                                      \
+	X(LED_STRIP_UPDATE, "led_strip_update")
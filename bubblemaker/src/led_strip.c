@@ -14,11 +14,15 @@
  * limitations under the License.
  */
 
+#include <string.h>
+
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
 
 #include <zephyr/drivers/led_strip.h>
 
+#include "latency_stats.h"
 #include "led_strip.h"
 #include "bubblemaker.h"
 #include "water_meter.h"
@@ -31,10 +35,49 @@ LOG_MODULE_REGISTER(led_strip);
 #define STRIP_NUM_PIXELS DT_PROP(STRIP_NODE, chain_length)
 #define RGB(_r, _g, _b) { .r = (_r), .g = (_g), .b = (_b) }
 
+#define FRAME_PERIOD K_MSEC(CONFIG_APP_LED_STRIP_FRAME_PERIOD_MS)
+// an animation frame rendered later than that after the previous one is late
+#define FRAME_LATE_US (CONFIG_APP_LED_STRIP_FRAME_PERIOD_MS * USEC_PER_MSEC * 3 / 2)
+
 static struct k_thread led_strip_thread;
 static K_THREAD_STACK_DEFINE(led_strip_stack, 1024);
 static const struct device *const strip = DEVICE_DT_GET(STRIP_NODE);
-struct led_rgb pixels[STRIP_NUM_PIXELS];
+
+/*
+ * A frame is rendered on every state change, and periodically while the
+ * state is animated. It is only pushed to the strip if it differs from the
+ * one shown, so static colors cost nothing after the first frame. The driver
+ * may overwrite the buffer it is given, hence the copy of the shown frame.
+ */
+static struct led_rgb frame[STRIP_NUM_PIXELS];
+static struct led_rgb shown[STRIP_NUM_PIXELS];
+static bool shown_valid;
+
+static K_SEM_DEFINE(frame_requested, 1, 1);
+// the state to render, published by the Bubblemaker thread
+static atomic_t rendered_state = ATOMIC_INIT(BUBBLEMAKER_IDLE);
+
+static void frame_timer_handler(struct k_timer *timer)
+{
+	(void)timer;
+
+	k_sem_give(&frame_requested);
+}
+
+static K_TIMER_DEFINE(frame_timer, frame_timer_handler, NULL);
+
+struct led_strip_stats {
+	uint32_t rendered;
+	uint32_t pushed;
+	// frames of animations only
+	uint32_t late;
+	uint32_t max_interval_us;
+	// rendering and pushing to the strip
+	uint32_t max_frame_time_us;
+};
+
+static struct led_strip_stats stats;
+static struct k_spinlock stats_lock;
 
 enum uniform_colors {
 	STRIP_COLOR_RED,
@@ -106,72 +149,113 @@ static void ws2812_strip_hsv2rgb(uint32_t h, uint32_t s, uint32_t v, uint8_t *r,
 	}
 }
 
-static void ws2812_strip_update(void)
-{
-	led_strip_update_rgb(strip, pixels, STRIP_NUM_PIXELS);
-}
-
-static void ws2812_strip_set_color(enum uniform_colors color)
+static void fill_color(enum uniform_colors color)
 {
 	for (size_t i = 0; i < STRIP_NUM_PIXELS; i++) {
-		pixels[i] = colors[color];
+		frame[i] = colors[color];
 	}
-	ws2812_strip_update();
 }
 
-static void ws2812_strip_display_rainbow(void)
+static void render_rainbow(void)
 {
 	static uint32_t rgb_increase;
 
-	for (int i = 0; i < 3; i++) {
-		for (int j = i; j < STRIP_NUM_PIXELS; j++) {
-			uint32_t hue = j * 360 / STRIP_NUM_PIXELS + rgb_increase;
+	for (int j = 0; j < STRIP_NUM_PIXELS; j++) {
+		uint32_t hue = j * 360 / STRIP_NUM_PIXELS + rgb_increase;
 
-			ws2812_strip_hsv2rgb(hue, 100, 100, &pixels[j].r, &pixels[j].g,
-					     &pixels[j].b);
-		}
-		ws2812_strip_update();
-		k_sleep(K_MSEC(10));
+		ws2812_strip_hsv2rgb(hue, 100, 100, &frame[j].r, &frame[j].g, &frame[j].b);
 	}
 	rgb_increase += 5;
 }
 
-static void led_strip_task(void *arg1, void *arg2, void *arg3)
+/**
+ * @returns true if @p state is animated, i.e. needs a new frame every
+ *          FRAME_PERIOD
+ */
+static bool render_frame(enum bubblemaker_state state)
 {
-	ws2812_strip_set_color(STRIP_COLOR_NONE);
-
-	while (1) {
-		switch (bm_state) {
-		case BUBBLEMAKER_IDLE:
-			ws2812_strip_display_rainbow();
-			break;
-		case BUBBLEMAKER_START_RED_LIGHT:
-			ws2812_strip_set_color(STRIP_COLOR_RED);
-			break;
-		case BUBBLEMAKER_START_YELLOW_LIGHT:
-			ws2812_strip_set_color(STRIP_COLOR_YELLOW);
-			break;
-		case BUBBLEMAKER_MEASURE:
-			ws2812_strip_set_color(STRIP_COLOR_GREEN);
-			break;
+	switch (state) {
+	case BUBBLEMAKER_IDLE:
+		render_rainbow();
+		return true;
+	case BUBBLEMAKER_START_RED_LIGHT:
+		fill_color(STRIP_COLOR_RED);
+		return false;
+	case BUBBLEMAKER_START_YELLOW_LIGHT:
+		fill_color(STRIP_COLOR_YELLOW);
+		return false;
+	case BUBBLEMAKER_MEASURE:
+		fill_color(STRIP_COLOR_GREEN);
+		return false;
 #if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-		case BUBBLEMAKER_END_P1_WON:
-			ws2812_strip_set_color(STRIP_COLOR_P1);
-			break;
-		case BUBBLEMAKER_END_P2_WON:
-			ws2812_strip_set_color(STRIP_COLOR_P2);
-			break;
+	case BUBBLEMAKER_END_P1_WON:
+		fill_color(STRIP_COLOR_P1);
+		return false;
+	case BUBBLEMAKER_END_P2_WON:
+		fill_color(STRIP_COLOR_P2);
+		return false;
 #else // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-		case BUBBLEMAKER_END:
-			ws2812_strip_set_color(STRIP_COLOR_RED);
-			break;
+	case BUBBLEMAKER_END:
+		fill_color(STRIP_COLOR_RED);
+		return false;
 #endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-		default:
-			AVS_UNREACHABLE("Invalid enum value");
+	default:
+		AVS_UNREACHABLE("Invalid enum value");
+		return false;
+	}
+}
+
+static void led_strip_task(void *arg1, void *arg2, void *arg3)
+{
+	bool animating = false;
+	uint32_t last_animation_frame = 0;
+
+	while (1) {
+		k_sem_take(&frame_requested, K_FOREVER);
+
+		uint32_t start = k_cycle_get_32();
+		bool animated = render_frame((enum bubblemaker_state)atomic_get(&rendered_state));
+		bool changed = !shown_valid || memcmp(frame, shown, sizeof(frame));
+
+		if (changed) {
+			memcpy(shown, frame, sizeof(shown));
+			shown_valid = true;
+			LATENCY_MEASURE(LATENCY_PROBE_LED_STRIP_UPDATE)
+			{
+				led_strip_update_rgb(strip, frame, STRIP_NUM_PIXELS);
+			}
 		}
+
+		uint32_t frame_time_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+		uint32_t interval_us = 0;
+
+		if (animated && animating) {
+			interval_us = k_cyc_to_us_floor32(start - last_animation_frame);
+		} else if (animated) {
+			k_timer_start(&frame_timer, FRAME_PERIOD, FRAME_PERIOD);
+		} else if (animating) {
+			k_timer_stop(&frame_timer);
+		}
+		animating = animated;
+		last_animation_frame = start;
+
+		k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+		stats.rendered++;
+		stats.pushed += changed;
+		stats.late += interval_us > FRAME_LATE_US;
+		stats.max_interval_us = MAX(stats.max_interval_us, interval_us);
+		stats.max_frame_time_us = MAX(stats.max_frame_time_us, frame_time_us);
+		k_spin_unlock(&stats_lock, key);
 	}
 }
 
+static void led_strip_state_changed(enum bubblemaker_state state)
+{
+	atomic_set(&rendered_state, state);
+	k_sem_give(&frame_requested);
+}
+
 int led_strip_init(void)
 {
 	LOG_INF("Initializing led_strip");
@@ -183,6 +267,10 @@ int led_strip_init(void)
 		return -1;
 	}
 
+	if (bubblemaker_subscribe(led_strip_state_changed)) {
+		return -1;
+	}
+
 	if (!k_thread_create(&led_strip_thread, led_strip_stack,
 			     K_THREAD_STACK_SIZEOF(led_strip_stack), led_strip_task, NULL, NULL,
 			     NULL, 2, 0, K_NO_WAIT)) {
@@ -193,4 +281,26 @@ int led_strip_init(void)
 	return 0;
 }
 
+#ifdef CONFIG_SHELL
+static int cmd_stats_led_strip(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	struct led_strip_stats snapshot = stats;
+
+	k_spin_unlock(&stats_lock, key);
+
+	shell_print(shell, "frames rendered:          %u", snapshot.rendered);
+	shell_print(shell, "frames pushed:            %u", snapshot.pushed);
+	shell_print(shell, "late animation frames:    %u", snapshot.late);
+	shell_print(shell, "max frame interval [us]:  %u", snapshot.max_interval_us);
+	shell_print(shell, "max frame time [us]:      %u", snapshot.max_frame_time_us);
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((stats), led_strip, NULL, "Show statistics of the LED strip frames",
+		 cmd_stats_led_strip, 1, 0);
+#endif // CONFIG_SHELL
 #endif // LED_STRIP_AVAILABLE
@@ -26,6 +26,9 @@
 #include <anjay_zephyr/lwm2m.h>
 #include <anjay_zephyr/objects.h>
 
+#include "boot_profile.h"
+#include "heap_stats.h"
+#include "latency_stats.h"
 #include "peripherals.h"
 #include "status_led.h"
 #include "sensors.h"
@@ -46,6 +49,9 @@ static const anjay_dm_object_def_t **switch_obj;
 #endif // SWITCH_AVAILABLE_ANY
 static avs_sched_handle_t update_objects_handle;
 
+// given by main() once the peripherals are initialized, and then kept given
+static K_SEM_DEFINE(peripherals_ready, 0, 1);
+
 #if PUSH_BUTTON_AVAILABLE_ANY
 static struct anjay_zephyr_ipso_button_instance buttons[] = {
 #if PUSH_BUTTON_AVAILABLE(0) && !WATER_PUMP_0_AVAILABLE
@@ -79,7 +85,10 @@ static struct anjay_zephyr_switch_instance switches[] = {
 
 static int register_objects(anjay_t *anjay)
 {
-	water_meter_obj = water_meter_object_create();
+	HEAP_STATS_TAG(HEAP_TAG_WATER_METER)
+	{
+		water_meter_obj = water_meter_object_create();
+	}
 	if (water_meter_obj) {
 		anjay_register_object(anjay, water_meter_obj);
 	} else {
@@ -88,13 +97,19 @@ static int register_objects(anjay_t *anjay)
 	}
 
 #if WATER_PUMP_0_AVAILABLE
-	power_control_obj = power_control_object_create();
+	HEAP_STATS_TAG(HEAP_TAG_POWER_CONTROL)
+	{
+		power_control_obj = power_control_object_create();
+	}
 	if (power_control_obj) {
 		anjay_register_object(anjay, power_control_obj);
 	}
 #endif // WATER_PUMP_0_AVAILABLE
 
-	basic_sensor_objects_install(anjay);
+	HEAP_STATS_TAG(HEAP_TAG_SENSORS)
+	{
+		basic_sensor_objects_install(anjay);
+	}
 #if PUSH_BUTTON_AVAILABLE_ANY
 	anjay_zephyr_ipso_push_button_object_install(anjay, buttons, AVS_ARRAY_SIZE(buttons));
 #endif // PUSH_BUTTON_AVAILABLE_ANY
@@ -112,6 +127,16 @@ static int register_objects(anjay_t *anjay)
 		anjay_register_object(anjay, switch_obj);
 	}
 #endif // SWITCH_AVAILABLE_ANY
+
+#ifdef CONFIG_APP_LATENCY_STATS
+	latency_stats_object_install(anjay);
+#endif // CONFIG_APP_LATENCY_STATS
+#ifdef CONFIG_APP_HEAP_STATS
+	heap_stats_object_install(anjay);
+#endif // CONFIG_APP_HEAP_STATS
+#ifdef CONFIG_APP_BOOT_PROFILE
+	boot_profile_object_install(anjay);
+#endif // CONFIG_APP_BOOT_PROFILE
 	return 0;
 }
 
@@ -127,7 +152,10 @@ static void update_objects(avs_sched_t *sched, const void *anjay_ptr)
 {
 	anjay_t *anjay = *(anjay_t *const *)anjay_ptr;
 
-	update_objects_frequent(anjay);
+	LATENCY_MEASURE(LATENCY_PROBE_UPDATE_OBJECTS)
+	{
+		update_objects_frequent(anjay);
+	}
 
 	status_led_toggle();
 
@@ -140,6 +168,10 @@ static int init_update_objects(anjay_t *anjay)
 {
 	avs_sched_t *sched = anjay_get_scheduler(anjay);
 
+	boot_profile_mark(BOOT_PHASE_ANJAY_READY);
+	boot_profile_registration_watch(anjay);
+	water_meter_notify_start(anjay);
+
 	update_objects(sched, &anjay);
 
 	status_led_init();
@@ -150,6 +182,8 @@ static int init_update_objects(anjay_t *anjay)
 static int clean_before_anjay_destroy(anjay_t *anjay)
 {
 	avs_sched_del(&update_objects_handle);
+	boot_profile_registration_unwatch();
+	water_meter_notify_stop();
 
 	return 0;
 }
@@ -170,11 +204,24 @@ static int release_objects(void)
 	return 0;
 }
 
-int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reason)
+static int handle_lwm2m_callback(anjay_t *anjay,
+				 enum anjay_zephyr_lwm2m_callback_reasons reason)
 {
 	switch (reason) {
-	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_INIT:
-		return register_objects(anjay);
+	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_INIT: {
+		int result;
+
+		// the sensor drivers are initialized by main()
+		k_sem_take(&peripherals_ready, K_FOREVER);
+		k_sem_give(&peripherals_ready);
+
+		HEAP_STATS_TAG(HEAP_TAG_OBJECTS)
+		{
+			result = register_objects(anjay);
+		}
+		boot_profile_mark(BOOT_PHASE_OBJECTS_REGISTERED);
+		return result;
+	}
 	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_ANJAY_READY:
 		return init_update_objects(anjay);
 	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_ANJAY_SHUTTING_DOWN:
@@ -186,14 +233,34 @@ int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reas
 	}
 }
 
+int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reason)
+{
+	int result;
+
+	LATENCY_MEASURE(LATENCY_PROBE_LWM2M_CALLBACK)
+	{
+		result = handle_lwm2m_callback(anjay, reason);
+	}
+	return result;
+}
+
 int main(void)
 {
+	boot_profile_mark(BOOT_PHASE_MAIN);
 	LOG_INF("Initializing Anjay-zephyr-client Bubblemaker " CONFIG_ANJAY_ZEPHYR_VERSION);
 
 	anjay_zephyr_lwm2m_set_user_callback(lwm2m_callback);
 	anjay_zephyr_lwm2m_init_from_settings();
+	boot_profile_mark(BOOT_PHASE_SETTINGS_LOADED);
 	anjay_zephyr_lwm2m_start();
+	boot_profile_mark(BOOT_PHASE_LWM2M_STARTED);
+
+	// the network is brought up by the Anjay thread in the meantime, and the
+	// objects are registered once both are done
+	basic_sensors_init();
 	bubblemaker_init();
+	boot_profile_mark(BOOT_PHASE_PERIPHERALS_READY);
+	k_sem_give(&peripherals_ready);
 
 	// Anjay runs in a separate thread and preceding function doesn't block
 	// add your own code here
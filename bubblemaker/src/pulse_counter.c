@@ -0,0 +1,227 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#ifdef CONFIG_APP_WATER_METER_CAPTURE_HW
+#include <helpers/nrfx_gppi.h>
+#endif // CONFIG_APP_WATER_METER_CAPTURE_HW
+
+#ifdef CONFIG_GPIO_EMUL
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#endif // CONFIG_GPIO_EMUL
+
+#include "pulse_counter.h"
+
+LOG_MODULE_REGISTER(pulse_counter);
+
+#ifdef CONFIG_APP_WATER_METER_CAPTURE_HW
+#define TIMEBASE_FREQUENCY NRFX_MHZ_TO_HZ(1)
+// capture channel of pulse_counter_now(), the others are used by the counters
+#define TIMEBASE_NOW_CHANNEL NRF_TIMER_CC_CHANNEL0
+
+static const nrfx_timer_t timebase = NRFX_TIMER_INSTANCE(0);
+
+/*
+ * TIMER0-2 are driven through nrfx directly. Enabling their devicetree
+ * nodes would let a Zephyr driver, e.g. the counter one, take them too.
+ */
+#define TIMER_UNCLAIMED(idx) !DT_NODE_HAS_STATUS(DT_NODELABEL(timer##idx), okay)
+BUILD_ASSERT(TIMER_UNCLAIMED(0) && TIMER_UNCLAIMED(1) && TIMER_UNCLAIMED(2),
+	     "TIMER0-2 are used by CONFIG_APP_WATER_METER_CAPTURE_HW, disable their nodes "
+	     "or use CONFIG_APP_WATER_METER_CAPTURE_GPIO_IRQ");
+
+static int timebase_start(void)
+{
+	static bool started;
+
+	if (started) {
+		return 0;
+	}
+
+	nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG(TIMEBASE_FREQUENCY);
+
+	timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	if (nrfx_timer_init(&timebase, &timer_config, NULL) != NRFX_SUCCESS) {
+		LOG_ERR("Could not initialize TIMER0");
+		return -EBUSY;
+	}
+	nrfx_timer_enable(&timebase);
+	started = true;
+	return 0;
+}
+
+int pulse_counter_start(struct pulse_counter *counter)
+{
+	if (!device_is_ready(counter->spec.port)) {
+		return -ENODEV;
+	}
+
+	int ret = timebase_start();
+
+	if (ret) {
+		return ret;
+	}
+
+	nrfx_timer_config_t timer_config = NRFX_TIMER_DEFAULT_CONFIG(NRFX_MHZ_TO_HZ(1));
+
+	timer_config.mode = NRF_TIMER_MODE_LOW_POWER_COUNTER;
+	timer_config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	if (nrfx_timer_init(&counter->timer, &timer_config, NULL) != NRFX_SUCCESS) {
+		LOG_ERR("Could not initialize TIMER%d", counter->timer.instance_id);
+		return -EBUSY;
+	}
+
+	uint8_t in_channel;
+	uint8_t ppi_channel;
+
+	if (nrfx_gpiote_channel_alloc(&counter->gpiote, &in_channel) != NRFX_SUCCESS) {
+		LOG_ERR("No free GPIOTE channel");
+		return -ENOMEM;
+	}
+	if (nrfx_gppi_channel_alloc(&ppi_channel) != NRFX_SUCCESS) {
+		LOG_ERR("No free (D)PPI channel");
+		nrfx_gpiote_channel_free(&counter->gpiote, in_channel);
+		return -ENOMEM;
+	}
+
+	static const nrf_gpio_pin_pull_t pull_config = NRF_GPIO_PIN_NOPULL;
+	const nrfx_gpiote_trigger_config_t trigger_config = {
+		.trigger = (counter->spec.dt_flags & GPIO_ACTIVE_LOW) ? NRFX_GPIOTE_TRIGGER_HITOLO :
+									  NRFX_GPIOTE_TRIGGER_LOTOHI,
+		.p_in_channel = &in_channel
+	};
+	const nrfx_gpiote_input_pin_config_t input_config = { .p_pull_config = &pull_config,
+							      .p_trigger_config = &trigger_config };
+
+	if (nrfx_gpiote_input_configure(&counter->gpiote, counter->pin, &input_config) !=
+	    NRFX_SUCCESS) {
+		LOG_ERR("Could not configure pin %u", counter->pin);
+		nrfx_gppi_channel_free(ppi_channel);
+		nrfx_gpiote_channel_free(&counter->gpiote, in_channel);
+		return -EIO;
+	}
+
+	nrfx_gppi_channel_endpoints_setup(
+		ppi_channel, nrfx_gpiote_in_event_address_get(&counter->gpiote, counter->pin),
+		nrfx_timer_task_address_get(&counter->timer, NRF_TIMER_TASK_COUNT));
+	nrfx_gppi_fork_endpoint_setup(
+		ppi_channel, nrfx_timer_capture_task_address_get(&timebase,
+								 counter->timestamp_channel));
+	nrfx_gppi_channels_enable(BIT(ppi_channel));
+
+	nrfx_timer_clear(&counter->timer);
+	nrfx_timer_enable(&counter->timer);
+	// the event is routed to the TIMER only, without an interrupt
+	nrfx_gpiote_trigger_enable(&counter->gpiote, counter->pin, false);
+	return 0;
+}
+
+void pulse_counter_read(struct pulse_counter *counter, struct pulse_count *out_count)
+{
+	uint32_t last_pulse;
+
+	// a pulse in between changes the timestamp, the count is then read again
+	do {
+		last_pulse = nrfx_timer_capture_get(&timebase, counter->timestamp_channel);
+		out_count->pulses = nrfx_timer_capture(&counter->timer, NRF_TIMER_CC_CHANNEL0);
+		out_count->last_pulse =
+			nrfx_timer_capture_get(&timebase, counter->timestamp_channel);
+	} while (out_count->last_pulse != last_pulse);
+}
+
+uint32_t pulse_counter_now(void)
+{
+	// only called from the water meter thread, so the channel is not shared
+	return nrfx_timer_capture(&timebase, TIMEBASE_NOW_CHANNEL);
+}
+
+uint32_t pulse_counter_ticks_to_us(uint32_t ticks)
+{
+	return (uint32_t)((uint64_t)ticks * USEC_PER_SEC / TIMEBASE_FREQUENCY);
+}
+#else // CONFIG_APP_WATER_METER_CAPTURE_HW
+static void pulse_handler(const struct device *port, struct gpio_callback *cb,
+			  gpio_port_pins_t pins)
+{
+	uint32_t now = k_cycle_get_32();
+	struct pulse_counter *counter = CONTAINER_OF(cb, struct pulse_counter, callback);
+
+	k_spinlock_key_t key = k_spin_lock(&counter->lock);
+
+	counter->pulses++;
+	counter->last_pulse = now;
+	k_spin_unlock(&counter->lock, key);
+}
+
+int pulse_counter_start(struct pulse_counter *counter)
+{
+	if (!device_is_ready(counter->spec.port)) {
+		return -ENODEV;
+	}
+
+	int ret = gpio_pin_configure_dt(&counter->spec, GPIO_INPUT);
+
+	if (ret) {
+		return ret;
+	}
+	gpio_init_callback(&counter->callback, pulse_handler, BIT(counter->spec.pin));
+	ret = gpio_add_callback(counter->spec.port, &counter->callback);
+	if (ret) {
+		return ret;
+	}
+	return gpio_pin_interrupt_configure_dt(&counter->spec, GPIO_INT_EDGE_TO_ACTIVE);
+}
+
+void pulse_counter_read(struct pulse_counter *counter, struct pulse_count *out_count)
+{
+	k_spinlock_key_t key = k_spin_lock(&counter->lock);
+
+	out_count->pulses = counter->pulses;
+	out_count->last_pulse = counter->last_pulse;
+	k_spin_unlock(&counter->lock, key);
+}
+
+uint32_t pulse_counter_now(void)
+{
+	return k_cycle_get_32();
+}
+
+uint32_t pulse_counter_ticks_to_us(uint32_t ticks)
+{
+	return k_cyc_to_us_floor32(ticks);
+}
+
+#ifdef CONFIG_GPIO_EMUL
+int pulse_counter_emulate(struct pulse_counter *counter, uint32_t count)
+{
+	int active = (counter->spec.dt_flags & GPIO_ACTIVE_LOW) ? 0 : 1;
+
+	for (uint32_t i = 0; i < count; i++) {
+		int ret = gpio_emul_input_set(counter->spec.port, counter->spec.pin, active);
+
+		if (!ret) {
+			ret = gpio_emul_input_set(counter->spec.port, counter->spec.pin, !active);
+		}
+		if (ret) {
+			return ret;
+		}
+	}
+	return 0;
+}
+#endif // CONFIG_GPIO_EMUL
+#endif // CONFIG_APP_WATER_METER_CAPTURE_HW
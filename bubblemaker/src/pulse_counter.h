@@ -0,0 +1,108 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/spinlock.h>
+
+#ifdef CONFIG_APP_WATER_METER_CAPTURE_HW
+#include <nrfx_gpiote.h>
+#include <nrfx_timer.h>
+#endif // CONFIG_APP_WATER_METER_CAPTURE_HW
+
+/**
+ * Counter and timestamp of the pulses on a GPIO input. With
+ * CONFIG_APP_WATER_METER_CAPTURE_HW, the GPIOTE event of the pin is linked
+ * through (D)PPI to the COUNT task of a TIMER and to a CAPTURE task of the
+ * free running TIMER0, so the pulses are counted and timestamped without the
+ * CPU, and the TIMERs are only read on request. Otherwise, every pulse is
+ * counted and timestamped with the cycle counter in a GPIO interrupt, which
+ * also works with the GPIO emulator.
+ */
+struct pulse_counter {
+	struct gpio_dt_spec spec;
+#ifdef CONFIG_APP_WATER_METER_CAPTURE_HW
+	nrfx_gpiote_t gpiote;
+	nrfx_timer_t timer;
+	nrf_timer_cc_channel_t timestamp_channel;
+	uint32_t pin;
+#else  // CONFIG_APP_WATER_METER_CAPTURE_HW
+	struct gpio_callback callback;
+	struct k_spinlock lock;
+	uint32_t pulses;
+	uint32_t last_pulse;
+#endif // CONFIG_APP_WATER_METER_CAPTURE_HW
+};
+
+struct pulse_count {
+	// number of pulses since pulse_counter_start(), modulo 2^32
+	uint32_t pulses;
+	// pulse_counter_now() at the last of them, meaningless if there was none
+	uint32_t last_pulse;
+};
+
+/**
+ * Initializer of a counter of the pulses on the pin in the gpios property of
+ * @p node_id. With CONFIG_APP_WATER_METER_CAPTURE_HW, the counter uses
+ * TIMER @p timer_idx to count, and capture channel @p timer_idx of TIMER0 to
+ * timestamp the pulses.
+ */
+#ifdef CONFIG_APP_WATER_METER_CAPTURE_HW
+#define PULSE_COUNTER_INITIALIZER(node_id, timer_idx)                                              \
+	{                                                                                          \
+		.spec = GPIO_DT_SPEC_GET(node_id, gpios),                                          \
+		.gpiote = NRFX_GPIOTE_INSTANCE(NRF_DT_GPIOTE_INST(node_id, gpios)),                \
+		.timer = NRFX_TIMER_INSTANCE(timer_idx),                                           \
+		.timestamp_channel = NRF_TIMER_CC_CHANNEL##timer_idx,                              \
+		.pin = NRF_DT_GPIOS_TO_PSEL(node_id, gpios)                                        \
+	}
+#else // CONFIG_APP_WATER_METER_CAPTURE_HW
+#define PULSE_COUNTER_INITIALIZER(node_id, timer_idx)                                              \
+	{                                                                                          \
+		.spec = GPIO_DT_SPEC_GET(node_id, gpios)                                           \
+	}
+#endif // CONFIG_APP_WATER_METER_CAPTURE_HW
+
+/**
+ * Configures the pin and starts counting the transitions to its active level.
+ */
+int pulse_counter_start(struct pulse_counter *counter);
+
+/**
+ * Reads the number of pulses and the time of the last one, consistently with
+ * each other. The number of pulses between two calls, and the time between
+ * the last pulses seen by them, are the differences of the results in
+ * unsigned arithmetic.
+ */
+void pulse_counter_read(struct pulse_counter *counter, struct pulse_count *out_count);
+
+/**
+ * @returns current time in the units of pulse timestamps, modulo 2^32
+ */
+uint32_t pulse_counter_now(void);
+
+uint32_t pulse_counter_ticks_to_us(uint32_t ticks);
+
+#if defined(CONFIG_GPIO_EMUL) && !defined(CONFIG_APP_WATER_METER_CAPTURE_HW)
+/**
+ * Generates @p count pulses on the pin of @p counter, which must belong to
+ * an emulated GPIO controller.
+ */
+int pulse_counter_emulate(struct pulse_counter *counter, uint32_t count);
+#endif // defined(CONFIG_GPIO_EMUL) && !defined(CONFIG_APP_WATER_METER_CAPTURE_HW)
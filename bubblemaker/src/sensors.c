@@ -31,6 +31,8 @@
 
 LOG_MODULE_REGISTER(sensor);
 
+#define MICRO INT64_C(1000000)
+
 #define ADC_HAS_SENSOR(Sensor) DT_PROP_HAS_NAME(DT_PATH(zephyr_user), io_channels, Sensor)
 
 #define PRESSURE_0_AVAILABLE ADC_HAS_SENSOR(pressure0)
@@ -82,7 +84,10 @@ const struct device *const temperature_dev_1 = DEVICE_DT_GET(TEMPERATURE_1_NODE)
 
 struct basic_sensor_driver {
 	int (*init)(void);
-	int (*read)(double *out_value);
+	// in millionths of the unit of the IPSO object
+	int (*read)(int64_t *out_value);
+	// set by basic_sensors_init()
+	bool initialized;
 	bool installed;
 };
 
@@ -148,7 +153,7 @@ static int adc_channel_init(enum adc_channels channel)
 }
 
 #if PRESSURE_0_AVAILABLE || PRESSURE_1_AVAILABLE
-static int pressure_get(enum adc_channels channel, double *out_pressure)
+static int pressure_get(enum adc_channels channel, int64_t *out_pressure)
 {
 	int32_t val_raw = adc_get_raw_value(channel);
 
@@ -161,28 +166,27 @@ static int pressure_get(enum adc_channels channel, double *out_pressure)
 	adc_raw_to_millivolts_dt(&available_adc_channels[channel], &val_mv);
 
 	// sensor output pressure range: 0-30 psi
-	static const double SENSOR_PRESSURE_RANGE_PSI = 30.;
+	static const int64_t SENSOR_PRESSURE_RANGE_PSI = 30;
 	// sensor output voltage: 0.5-4.5 V with 5 V source
-	static const double SENSOR_VOLTAGE_MIN = 0.5;
-	static const double SENSOR_VOLTAGE_MAX = 4.5;
-	// 1 psi = 6.895 kPa
-	static const double SENSOR_PSI_TO_KPA = 6.895;
-	// 1 atm = 101.325 kPa
-	static const double SENSOR_ATM_IN_KPA = 101.325;
-
-	*out_pressure =
-		((double)val_mv / 1000. - SENSOR_VOLTAGE_MIN) *
-			(SENSOR_PRESSURE_RANGE_PSI / (SENSOR_VOLTAGE_MAX - SENSOR_VOLTAGE_MIN)) *
-			SENSOR_PSI_TO_KPA +
-		SENSOR_ATM_IN_KPA; // kPa
-	*out_pressure = *out_pressure * 1000.; // Pa
+	static const int64_t SENSOR_VOLTAGE_MIN_MV = 500;
+	static const int64_t SENSOR_VOLTAGE_MAX_MV = 4500;
+	// 1 psi = 6895 Pa
+	static const int64_t SENSOR_PSI_TO_PA = 6895;
+	// 1 atm = 101325 Pa
+	static const int64_t SENSOR_ATM_IN_PA = 101325;
+
+	// exact in integers: the gain is a whole number of micropascals per millivolt
+	*out_pressure = (val_mv - SENSOR_VOLTAGE_MIN_MV) * SENSOR_PRESSURE_RANGE_PSI *
+				SENSOR_PSI_TO_PA * MICRO /
+				(SENSOR_VOLTAGE_MAX_MV - SENSOR_VOLTAGE_MIN_MV) +
+			SENSOR_ATM_IN_PA * MICRO; // uPa
 
 	return 0;
 }
 #endif // PRESSURE_0_AVAILABLE || PRESSURE_1_AVAILABLE
 
 #if ACIDITY_0_AVAILABLE || ACIDITY_1_AVAILABLE
-static int acidity_get(enum adc_channels channel, double *out_acidity)
+static int acidity_get(enum adc_channels channel, int64_t *out_acidity)
 {
 	int32_t val_raw = adc_get_raw_value(channel);
 
@@ -195,8 +199,7 @@ static int acidity_get(enum adc_channels channel, double *out_acidity)
 	adc_raw_to_millivolts_dt(&available_adc_channels[channel], &val_mv);
 
 	// based on: https://wiki.dfrobot.com/PH_meter_SKU__SEN0161_
-	*out_acidity = (double)val_mv / 1000.;
-	*out_acidity *= 3.5;
+	*out_acidity = val_mv * INT64_C(3500); // 3.5 pH per volt, in millionths of pH
 
 	return 0;
 }
@@ -208,7 +211,7 @@ static int pressure_0_init(void)
 	return adc_channel_init(ADC_CHANNEL_PRESSURE_0);
 }
 
-static int pressure_0_get(double *out_pressure)
+static int pressure_0_get(int64_t *out_pressure)
 {
 	return pressure_get(ADC_CHANNEL_PRESSURE_0, out_pressure);
 }
@@ -220,7 +223,7 @@ static int acidity_0_init(void)
 	return adc_channel_init(ADC_CHANNEL_ACIDITY_0);
 }
 
-static int acidity_0_get(double *out_acidity)
+static int acidity_0_get(int64_t *out_acidity)
 {
 	return acidity_get(ADC_CHANNEL_ACIDITY_0, out_acidity);
 }
@@ -232,7 +235,7 @@ static int pressure_1_init(void)
 	return adc_channel_init(ADC_CHANNEL_PRESSURE_1);
 }
 
-static int pressure_1_get(double *out_pressure)
+static int pressure_1_get(int64_t *out_pressure)
 {
 	return pressure_get(ADC_CHANNEL_PRESSURE_1, out_pressure);
 }
@@ -244,7 +247,7 @@ static int acidity_1_init(void)
 	return adc_channel_init(ADC_CHANNEL_ACIDITY_1);
 }
 
-static int acidity_1_get(double *out_acidity)
+static int acidity_1_get(int64_t *out_acidity)
 {
 	return acidity_get(ADC_CHANNEL_ACIDITY_1, out_acidity);
 }
@@ -318,13 +321,13 @@ static int temperature_0_init(void)
 	return 0;
 }
 
-static int temperature_0_get(double *out_temperature)
+static int temperature_0_get(int64_t *out_temperature)
 {
 	struct sensor_value temperature;
 
 	sensor_sample_fetch(temperature_dev_0);
 	sensor_channel_get(temperature_dev_0, SENSOR_CHAN_AMBIENT_TEMP, &temperature);
-	*out_temperature = sensor_value_to_double(&temperature);
+	*out_temperature = sensor_value_to_micro(&temperature);
 	return 0;
 }
 #endif // TEMPERATURE_0_AVAILABLE
@@ -354,13 +357,13 @@ static int temperature_1_init(void)
 	return 0;
 }
 
-static int temperature_1_get(double *out_temperature)
+static int temperature_1_get(int64_t *out_temperature)
 {
 	struct sensor_value temperature;
 
 	sensor_sample_fetch(temperature_dev_1);
 	sensor_channel_get(temperature_dev_1, SENSOR_CHAN_AMBIENT_TEMP, &temperature);
-	*out_temperature = sensor_value_to_double(&temperature);
+	*out_temperature = sensor_value_to_micro(&temperature);
 	return 0;
 }
 #endif // TEMPERATURE_1_AVAILABLE
@@ -416,13 +419,29 @@ static int read_value(anjay_iid_t iid, void *_ctx, double *out_value)
 	const struct basic_sensor_driver *driver =
 		&(((const struct sensor_context *)_ctx)->drivers[iid]);
 
-	if (driver->read(out_value)) {
+	int64_t value;
+
+	if (driver->read(&value)) {
 		return -1;
 	}
 
+	// the only floating point operation on the way from the sensor to the server
+	*out_value = (double)value * 1e-6;
+
 	return 0;
 }
 
+void basic_sensors_init(void)
+{
+	for (int i = 0; i < AVS_ARRAY_SIZE(basic_sensors_def); i++) {
+		struct sensor_context *ctx = &basic_sensors_def[i];
+
+		for (int j = 0; j < ctx->instances_count; j++) {
+			ctx->drivers[j].initialized = !ctx->drivers[j].init();
+		}
+	}
+}
+
 void basic_sensor_objects_install(anjay_t *anjay)
 {
 	for (int i = 0; i < AVS_ARRAY_SIZE(basic_sensors_def); i++) {
@@ -439,7 +458,7 @@ void basic_sensor_objects_install(anjay_t *anjay)
 		for (int j = 0; j < ctx->instances_count; j++) {
 			struct basic_sensor_driver *driver = &ctx->drivers[j];
 
-			if (driver->init()) {
+			if (!driver->initialized) {
 				driver->installed = false;
 				continue;
 			}
@@ -19,5 +19,12 @@
 #include <anjay/ipso_objects.h>
 #include <anjay_zephyr/ipso_objects.h>
 
+/**
+ * Initializes the sensor drivers. The 1-Wire bus search takes more than a
+ * second, so this is meant to run while the network is being brought up. Must
+ * be called once before the first @ref basic_sensor_objects_install.
+ */
+void basic_sensors_init(void);
+
 void basic_sensor_objects_install(anjay_t *anjay);
 void basic_sensor_objects_update(anjay_t *anjay);
@@ -16,8 +16,16 @@
 
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
-#include <zephyr/drivers/gpio.h>
+#include <math.h>
+#include <stdlib.h>
 
+#include <zephyr/shell/shell.h>
+
+#include <avsystem/commons/avs_sched.h>
+
+#include "dm_table.h"
+#include "latency_stats.h"
+#include "pulse_counter.h"
 #include "water_meter.h"
 #include "bubblemaker.h"
 
@@ -52,203 +60,156 @@ LOG_MODULE_REGISTER(water_meter);
  */
 #define RID_MAXIMUM_FLOW_RATE 8
 
-#define SYNCHRONIZED(Mtx)                                                                          \
-	for (int _synchronized_exit = k_mutex_lock(&(Mtx), K_FOREVER); !_synchronized_exit;        \
-	     _synchronized_exit = -1, k_mutex_unlock(&(Mtx)))
+#define WM_TIMER_CYCLE K_MSEC(CONFIG_APP_WATER_METER_UPDATE_PERIOD_MS)
+#define WM_IDLE_TIMER_CYCLE K_MSEC(CONFIG_APP_WATER_METER_IDLE_UPDATE_PERIOD_MS)
 
-#define WM_TIMER_CYCLE K_SECONDS(1)
+// m3 and m3/s
+#define WM_NOTIFY_VOLUME_THRESHOLD (CONFIG_APP_WATER_METER_NOTIFY_VOLUME_ML / 1e6)
+#define WM_NOTIFY_FLOW_THRESHOLD (CONFIG_APP_WATER_METER_NOTIFY_FLOW_ML_S / 1e6)
+
+// based on: https://forum.seeedstudio.com/t/tutorial-reading-water-flow-rate-with-water-flow-sensor/647
+#define WM_PULSES_PER_M3 (CONFIG_APP_WATER_METER_PULSES_PER_LITER * 1000.0)
 
 static struct k_thread water_meter_thread;
 static K_THREAD_STACK_DEFINE(water_meter_stack, 1024);
 static K_MUTEX_DEFINE(water_meter_mutex);
+static K_CONDVAR_DEFINE(water_meter_created);
+// given on every state change of the game
+static K_SEM_DEFINE(water_meter_wakeup, 0, 1);
+static atomic_t game_in_progress;
 
 struct water_meter_instance {
-	anjay_iid_t iid;
 	double cumulated_volume;
-	double temp_volume;
 	double curr_flow;
 	double max_flow;
+	// since last reset, cumulated_volume is derived from it
+	uint64_t pulses;
 };
 
-struct water_meter_object {
-	const anjay_dm_object_def_t *def;
+/* Resources for which notifications are sent, and absolute thresholds of their changes */
+static const anjay_rid_t notified_rids[] = { RID_CUMULATED_WATER_VOLUME, RID_CURRENT_FLOW,
+					     RID_MAXIMUM_FLOW_RATE };
+static const double notify_thresholds[] = { WM_NOTIFY_VOLUME_THRESHOLD, WM_NOTIFY_FLOW_THRESHOLD,
+					    WM_NOTIFY_FLOW_THRESHOLD };
+#define WM_NOTIFIED_COUNT ARRAY_SIZE(notified_rids)
+
+/* Flow measurement and notification state, only accessed by the water meter thread */
+struct water_meter_channel {
+	struct pulse_counter counter;
+	struct pulse_count last_count;
+	// whether last_count.last_pulse is the start of the interval to the next pulse
+	bool interval_started;
+	// m3/s, before the decay that applies while no pulses are seen
+	double flow;
+	// values of notified_rids when the last notification was requested
+	double reported[WM_NOTIFIED_COUNT];
+	int64_t reported_ms;
+};
 
-	AVS_LIST(struct water_meter_instance) instances;
+/*
+ * Instance IDs are assigned in devicetree order to the meters that are
+ * available, so they index the instances array directly.
+ */
+#define WATER_METER_INSTANCE_COUNT (WATER_METER_0_AVAILABLE + WATER_METER_1_AVAILABLE)
+#define WATER_METER_0_IID 0
+#define WATER_METER_1_IID WATER_METER_0_AVAILABLE
+
+static struct water_meter_instance water_meter_instances[WATER_METER_INSTANCE_COUNT];
+
+static const struct dm_table_resource water_meter_resources[] = {
+	DM_TABLE_RESOURCE(RID_CUMULATED_WATER_VOLUME, ANJAY_DM_RES_R, DM_TABLE_DOUBLE,
+			  struct water_meter_instance, cumulated_volume),
+	DM_TABLE_EXECUTABLE(RID_CUMULATED_WATER_METER_VALUE_RESET),
+	DM_TABLE_RESOURCE(RID_CURRENT_FLOW, ANJAY_DM_RES_R, DM_TABLE_DOUBLE,
+			  struct water_meter_instance, curr_flow),
+	DM_TABLE_RESOURCE(RID_MAXIMUM_FLOW_RATE, ANJAY_DM_RES_R, DM_TABLE_DOUBLE,
+			  struct water_meter_instance, max_flow)
 };
 
-#if WATER_METER_0_AVAILABLE
-struct water_meter_instance *wm_inst_0_ptr;
-atomic_t water_meter_0_irq_count = ATOMIC_INIT(0);
-#endif // WATER_METER_0_AVAILABLE
-#if WATER_METER_1_AVAILABLE
-struct water_meter_instance *wm_inst_1_ptr;
-atomic_t water_meter_1_irq_count = ATOMIC_INIT(0);
-#endif // WATER_METER_1_AVAILABLE
+static struct dm_table_object water_meter_object = {
+	.resources = water_meter_resources,
+	.resource_count = ARRAY_SIZE(water_meter_resources),
+	.instances = water_meter_instances,
+	.instance_size = sizeof(struct water_meter_instance),
+	.instance_count = WATER_METER_INSTANCE_COUNT,
+	.present_offset = DM_TABLE_ALWAYS_PRESENT,
+	.mutex = &water_meter_mutex
+};
 
-void water_meter_instances_reset(void)
-{
-	SYNCHRONIZED(water_meter_mutex)
-	{
+// indexed by Instance ID, like the instances
+static struct water_meter_channel water_meter_channels[WATER_METER_INSTANCE_COUNT] = {
 #if WATER_METER_0_AVAILABLE
-		wm_inst_0_ptr->cumulated_volume = 0;
-		wm_inst_0_ptr->max_flow = 0;
-		wm_inst_0_ptr->curr_flow = 0;
+	[WATER_METER_0_IID] = { .counter = PULSE_COUNTER_INITIALIZER(WATER_METER_0_NODE, 1) },
 #endif // WATER_METER_0_AVAILABLE
-
 #if WATER_METER_1_AVAILABLE
-		wm_inst_1_ptr->cumulated_volume = 0;
-		wm_inst_1_ptr->max_flow = 0;
-		wm_inst_1_ptr->curr_flow = 0;
+	[WATER_METER_1_IID] = { .counter = PULSE_COUNTER_INITIALIZER(WATER_METER_1_NODE, 2) },
 #endif // WATER_METER_1_AVAILABLE
-	}
-}
+};
 
-bool water_meter_is_null(void)
-{
 #if WATER_METER_0_AVAILABLE
-	if (!wm_inst_0_ptr) {
-		return true;
-	}
+static struct water_meter_instance *const wm_inst_0_ptr =
+	&water_meter_instances[WATER_METER_0_IID];
 #endif // WATER_METER_0_AVAILABLE
 #if WATER_METER_1_AVAILABLE
-	if (!wm_inst_1_ptr) {
-		return true;
-	}
+static struct water_meter_instance *const wm_inst_1_ptr =
+	&water_meter_instances[WATER_METER_1_IID];
 #endif // WATER_METER_1_AVAILABLE
 
-	return false;
-}
-
-#if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-void water_meter_get_cumulated_volumes(double *out_result)
+static void init_instance(struct water_meter_instance *inst)
 {
 	SYNCHRONIZED(water_meter_mutex)
 	{
-		out_result[0] = wm_inst_0_ptr->cumulated_volume;
-		out_result[1] = wm_inst_1_ptr->cumulated_volume;
+		inst->cumulated_volume = 0;
+		inst->curr_flow = 0;
+		inst->max_flow = 0;
+		inst->pulses = 0;
 	}
 }
-#endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
-
-static inline struct water_meter_object *get_obj(const anjay_dm_object_def_t *const *obj_ptr)
-{
-	assert(obj_ptr);
-	return AVS_CONTAINER_OF(obj_ptr, struct water_meter_object, def);
-}
 
-static struct water_meter_instance *find_instance(const struct water_meter_object *obj,
-						  anjay_iid_t iid)
+void water_meter_instances_reset(void)
 {
-	AVS_LIST(struct water_meter_instance) it;
-	AVS_LIST_FOREACH(it, obj->instances)
+	SYNCHRONIZED(water_meter_mutex)
 	{
-		if (it->iid == iid) {
-			return it;
-		} else if (it->iid > iid) {
-			break;
+		for (int i = 0; i < WATER_METER_INSTANCE_COUNT; i++) {
+			water_meter_instances[i].cumulated_volume = 0;
+			water_meter_instances[i].max_flow = 0;
+			water_meter_instances[i].curr_flow = 0;
+			water_meter_instances[i].pulses = 0;
 		}
 	}
-
-	return NULL;
-}
-
-static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
-			  anjay_dm_list_ctx_t *ctx)
-{
-	(void)anjay;
-
-	AVS_LIST(struct water_meter_instance) it;
-	AVS_LIST_FOREACH(it, get_obj(obj_ptr)->instances)
-	{
-		anjay_dm_emit(ctx, it->iid);
-	}
-
-	return 0;
 }
 
-static int init_instance(struct water_meter_instance *inst, anjay_iid_t iid)
+void water_meter_wait_created(void)
 {
-	assert(iid != ANJAY_ID_INVALID);
-
 	SYNCHRONIZED(water_meter_mutex)
 	{
-		inst->iid = iid;
-		inst->cumulated_volume = 0;
-		inst->temp_volume = 0;
-		inst->curr_flow = 0;
-		inst->max_flow = 0;
+		while (!water_meter_object.def) {
+			k_condvar_wait(&water_meter_created, &water_meter_mutex, K_FOREVER);
+		}
 	}
-	return 0;
 }
 
-static void release_instance(struct water_meter_instance *inst)
-{
-	(void)inst;
-}
-
-static struct water_meter_instance *add_instance(struct water_meter_object *obj, anjay_iid_t iid)
+#if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
+void water_meter_get_cumulated_volumes(double *out_result)
 {
-	assert(find_instance(obj, iid) == NULL);
-
-	AVS_LIST(struct water_meter_instance)
-	created = AVS_LIST_NEW_ELEMENT(struct water_meter_instance);
-	if (!created) {
-		return NULL;
-	}
-
-	int result;
-
-	result = init_instance(created, iid);
-	if (result) {
-		AVS_LIST_CLEAR(&created);
-		return NULL;
-	}
-
-	AVS_LIST(struct water_meter_instance) * ptr;
-	AVS_LIST_FOREACH_PTR(ptr, &obj->instances)
+	SYNCHRONIZED(water_meter_mutex)
 	{
-		if ((*ptr)->iid > created->iid) {
-			break;
-		}
+		out_result[0] = wm_inst_0_ptr->cumulated_volume;
+		out_result[1] = wm_inst_1_ptr->cumulated_volume;
 	}
-
-	AVS_LIST_INSERT(ptr, created);
-	return created;
 }
+#endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
 
 static int instance_reset(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
 			  anjay_iid_t iid)
 {
 	(void)anjay;
 
-	struct water_meter_object *obj = get_obj(obj_ptr);
-
-	assert(obj);
-	struct water_meter_instance *inst = find_instance(obj, iid);
+	struct water_meter_instance *inst =
+		dm_table_find_instance(dm_table_get_obj(obj_ptr), iid);
 
 	assert(inst);
-	SYNCHRONIZED(water_meter_mutex)
-	{
-		inst->cumulated_volume = 0;
-		inst->max_flow = 0;
-		inst->temp_volume = 0;
-		inst->curr_flow = 0;
-	}
-	return 0;
-}
-
-static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
-			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
-{
-	(void)anjay;
-	(void)obj_ptr;
-	(void)iid;
-
-	anjay_dm_emit_res(ctx, RID_CUMULATED_WATER_VOLUME, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
-	anjay_dm_emit_res(ctx, RID_CUMULATED_WATER_METER_VALUE_RESET, ANJAY_DM_RES_E,
-			  ANJAY_DM_RES_PRESENT);
-	anjay_dm_emit_res(ctx, RID_CURRENT_FLOW, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
-	anjay_dm_emit_res(ctx, RID_MAXIMUM_FLOW_RATE, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	init_instance(inst);
 	return 0;
 }
 
@@ -256,31 +217,13 @@ static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj
 			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
 			 anjay_output_ctx_t *ctx)
 {
-	(void)anjay;
-
-	struct water_meter_object *obj = get_obj(obj_ptr);
-
-	assert(obj);
-	struct water_meter_instance *inst = find_instance(obj, iid);
-
-	assert(inst);
-
-	switch (rid) {
-	case RID_CUMULATED_WATER_VOLUME:
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_ret_double(ctx, inst->cumulated_volume);
-
-	case RID_CURRENT_FLOW:
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_ret_double(ctx, inst->curr_flow);
-
-	case RID_MAXIMUM_FLOW_RATE:
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_ret_double(ctx, inst->max_flow);
+	int result;
 
-	default:
-		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	LATENCY_MEASURE(LATENCY_PROBE_WATER_METER_READ)
+	{
+		result = dm_table_resource_read(anjay, obj_ptr, iid, rid, riid, ctx);
 	}
+	return result;
 }
 
 static int resource_execute(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
@@ -289,173 +232,264 @@ static int resource_execute(anjay_t *anjay, const anjay_dm_object_def_t *const *
 	(void)anjay;
 	(void)arg_ctx;
 
-	struct water_meter_object *obj = get_obj(obj_ptr);
-
-	assert(obj);
-	struct water_meter_instance *inst = find_instance(obj, iid);
+	struct water_meter_instance *inst =
+		dm_table_find_instance(dm_table_get_obj(obj_ptr), iid);
 
 	assert(inst);
 
 	switch (rid) {
 	case RID_CUMULATED_WATER_METER_VALUE_RESET:
-		if (bm_state == BUBBLEMAKER_IDLE) {
-			water_meter_instances_reset();
-			bm_state = BUBBLEMAKER_START_RED_LIGHT;
-		}
+		bubblemaker_request_start();
 		return 0;
 	default:
 		return ANJAY_ERR_METHOD_NOT_ALLOWED;
 	}
 }
 
-static const anjay_dm_object_def_t OBJ_DEF = { .oid = 3424,
-					       .handlers = { .list_instances = list_instances,
-							     .instance_reset = instance_reset,
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = 3424,
+	.handlers = { .list_instances = dm_table_list_instances,
+		      .instance_reset = instance_reset,
 
-							     .list_resources = list_resources,
-							     .resource_read = resource_read,
-							     .resource_execute =
-								     resource_execute } };
+		      .list_resources = dm_table_list_resources,
+		      .resource_read = resource_read,
+		      .resource_execute = resource_execute }
+};
 
 const anjay_dm_object_def_t **water_meter_object_create(void)
 {
-	struct water_meter_object *obj =
-		(struct water_meter_object *)avs_calloc(1, sizeof(struct water_meter_object));
-	if (!obj) {
-		return NULL;
+	for (int i = 0; i < WATER_METER_INSTANCE_COUNT; i++) {
+		init_instance(&water_meter_instances[i]);
+	}
+	SYNCHRONIZED(water_meter_mutex)
+	{
+		water_meter_object.def = &OBJ_DEF;
+		k_condvar_broadcast(&water_meter_created);
 	}
-	obj->def = &OBJ_DEF;
 
-	static int instance_counter;
+	return &water_meter_object.def;
+}
 
-#if WATER_METER_0_AVAILABLE
-	wm_inst_0_ptr = add_instance(obj, instance_counter++);
+void water_meter_object_release(const anjay_dm_object_def_t **def)
+{
+	if (def) {
+		// the instances stay valid for the water meter thread
+		dm_table_get_obj(def)->def = NULL;
+	}
+}
 
-	if (!wm_inst_0_ptr) {
-		avs_free(obj);
-		return NULL;
+/*
+ * Notifications are decided in the water meter thread, which marks the
+ * resources due for a notification and schedules a single job that calls
+ * anjay_notify_changed() for them on the Anjay thread.
+ */
+static K_MUTEX_DEFINE(notify_mutex);
+static anjay_t *notify_anjay;
+// bit WM_NOTIFIED_COUNT * iid + index in notified_rids
+static atomic_t notify_pending;
+static atomic_t notify_scheduled;
+
+BUILD_ASSERT(WATER_METER_INSTANCE_COUNT * WM_NOTIFIED_COUNT <= ATOMIC_BITS);
+
+static void notify_job(avs_sched_t *sched, const void *dummy)
+{
+	(void)sched;
+	(void)dummy;
+
+	atomic_clear(&notify_scheduled);
+
+	atomic_val_t pending = atomic_clear(&notify_pending);
+
+	SYNCHRONIZED(notify_mutex)
+	{
+		for (int i = 0; notify_anjay && i < WATER_METER_INSTANCE_COUNT * WM_NOTIFIED_COUNT;
+		     i++) {
+			if (pending & BIT(i)) {
+				anjay_notify_changed(notify_anjay, OBJ_DEF.oid,
+						     (anjay_iid_t)(i / WM_NOTIFIED_COUNT),
+						     notified_rids[i % WM_NOTIFIED_COUNT]);
+			}
+		}
 	}
-#endif // WATER_METER_0_AVAILABLE
+}
 
-#if WATER_METER_1_AVAILABLE
-	wm_inst_1_ptr = add_instance(obj, instance_counter++);
+static void notify_request(atomic_val_t resources)
+{
+	atomic_or(&notify_pending, resources);
 
-	if (!wm_inst_1_ptr) {
-		avs_free(obj);
-		return NULL;
+	SYNCHRONIZED(notify_mutex)
+	{
+		if (notify_anjay && !atomic_set(&notify_scheduled, 1) &&
+		    AVS_SCHED_NOW(anjay_get_scheduler(notify_anjay), NULL, notify_job, NULL, 0)) {
+			LOG_ERR("Could not schedule water meter notifications");
+			atomic_clear(&notify_scheduled);
+		}
 	}
-#endif // WATER_METER_1_AVAILABLE
+}
 
-	return &obj->def;
+void water_meter_notify_start(anjay_t *anjay)
+{
+	atomic_clear(&notify_scheduled);
+	SYNCHRONIZED(notify_mutex)
+	{
+		notify_anjay = anjay;
+	}
 }
 
-void water_meter_object_release(const anjay_dm_object_def_t **def)
+void water_meter_notify_stop(void)
 {
-	if (def) {
-		struct water_meter_object *obj = get_obj(def);
+	SYNCHRONIZED(notify_mutex)
+	{
+		notify_anjay = NULL;
+	}
+}
 
-		AVS_LIST_CLEAR(&obj->instances)
-		{
-			release_instance(obj->instances);
-		}
-		avs_free(obj);
+static bool change_significant(double reported, double value, double threshold)
+{
+	double change = fabs(value - reported);
+
+	if (change == 0) {
+		return false;
 	}
+	// e.g. the flow stopping or the volume being reset
+	if (reported == 0 || value == 0) {
+		return true;
+	}
+	return change >= threshold ||
+	       (CONFIG_APP_WATER_METER_NOTIFY_RELATIVE &&
+		change >= fabs(reported) * CONFIG_APP_WATER_METER_NOTIFY_RELATIVE / 100);
 }
 
-#if WATER_METER_0_AVAILABLE
-static void water_meter_0_callback_handler(const struct device *port, struct gpio_callback *cb,
-					   gpio_port_pins_t pins)
+static void water_meter_check_notify(struct water_meter_channel *channel, anjay_iid_t iid,
+				     const double *values)
 {
-	atomic_inc(&water_meter_0_irq_count);
+	int64_t now_ms = k_uptime_get();
+
+	if (now_ms - channel->reported_ms < CONFIG_APP_WATER_METER_NOTIFY_MIN_PERIOD_MS) {
+		return;
+	}
+
+	atomic_val_t due = 0;
+
+	for (int i = 0; i < WM_NOTIFIED_COUNT; i++) {
+		if (change_significant(channel->reported[i], values[i], notify_thresholds[i])) {
+			channel->reported[i] = values[i];
+			due |= BIT(WM_NOTIFIED_COUNT * iid + i);
+		}
+	}
+	if (due) {
+		channel->reported_ms = now_ms;
+		notify_request(due);
+	}
 }
-#endif // WATER_METER_0_AVAILABLE
 
-#if WATER_METER_1_AVAILABLE
-static void water_meter_1_callback_handler(const struct device *port, struct gpio_callback *cb,
-					   gpio_port_pins_t pins)
+static double flow_from_interval(uint32_t pulses, uint32_t interval_ticks)
 {
-	atomic_inc(&water_meter_1_irq_count);
+	uint32_t interval_us = MAX(pulse_counter_ticks_to_us(interval_ticks), 1);
+
+	return (double)pulses * USEC_PER_SEC / interval_us / WM_PULSES_PER_M3;
 }
-#endif // WATER_METER_1_AVAILABLE
 
-static void water_meter_update_values(struct water_meter_instance *wm_instance,
-				      atomic_val_t *multiplier)
+/*
+ * The flow is measured over the interval between the last pulse seen by the
+ * previous measurement and the last pulse seen now, so its resolution is set
+ * by the timestamps rather than by the update period. While no pulses are seen, the
+ * flow cannot be higher than one pulse over the time since the last one, and
+ * it drops to zero after CONFIG_APP_WATER_METER_FLOW_TIMEOUT_MS.
+ */
+static void water_meter_update_values(struct water_meter_channel *channel, anjay_iid_t iid)
 {
-	// based on: https://forum.seeedstudio.com/t/tutorial-reading-water-flow-rate-with-water-flow-sensor/647
+	struct water_meter_instance *wm_instance = &water_meter_instances[iid];
+	struct pulse_count count;
+
+	pulse_counter_read(&channel->counter, &count);
+
+	uint32_t new_pulses = count.pulses - channel->last_count.pulses;
+	double flow;
+	// in the order of notified_rids
+	double values[WM_NOTIFIED_COUNT];
+
+	if (new_pulses) {
+		if (channel->interval_started) {
+			double measured = flow_from_interval(
+				new_pulses, count.last_pulse - channel->last_count.last_pulse);
+
+			channel->flow += (measured - channel->flow) *
+					 CONFIG_APP_WATER_METER_FLOW_SMOOTHING / 100;
+		}
+		channel->interval_started = true;
+		channel->last_count = count;
+		flow = channel->flow;
+	} else if (channel->interval_started) {
+		uint32_t idle_ticks = pulse_counter_now() - count.last_pulse;
+
+		if (pulse_counter_ticks_to_us(idle_ticks) >=
+		    CONFIG_APP_WATER_METER_FLOW_TIMEOUT_MS * USEC_PER_MSEC) {
+			channel->interval_started = false;
+			channel->flow = 0;
+		}
+		flow = MIN(channel->flow, flow_from_interval(1, idle_ticks));
+	} else {
+		flow = 0;
+	}
+
 	SYNCHRONIZED(water_meter_mutex)
 	{
-		wm_instance->curr_flow = (float)*multiplier * 60.0f / 7.5f; // L/h
-		wm_instance->curr_flow = wm_instance->curr_flow / 3600.0f / 1000.0f; // m^3/s
-		wm_instance->temp_volume = wm_instance->curr_flow; // readings every second
-		wm_instance->cumulated_volume += wm_instance->temp_volume;
+		wm_instance->pulses += new_pulses;
+		wm_instance->cumulated_volume = (double)wm_instance->pulses / WM_PULSES_PER_M3;
+		wm_instance->curr_flow = flow;
 		if (wm_instance->max_flow < wm_instance->curr_flow) {
 			wm_instance->max_flow = wm_instance->curr_flow;
 		}
+		values[0] = wm_instance->cumulated_volume;
+		values[1] = wm_instance->curr_flow;
+		values[2] = wm_instance->max_flow;
 	}
+
+	water_meter_check_notify(channel, iid, values);
 }
 
 static void water_meter_periodic(void *arg1, void *arg2, void *arg3)
 {
-	while (water_meter_is_null()) {
-		k_sleep(K_SECONDS(1));
+	water_meter_wait_created();
+
+	for (int i = 0; i < WATER_METER_INSTANCE_COUNT; i++) {
+		pulse_counter_read(&water_meter_channels[i].counter,
+				   &water_meter_channels[i].last_count);
 	}
 
 	while (1) {
-#if WATER_METER_0_AVAILABLE
-		atomic_val_t water_meter_0_multiplier = atomic_get(&water_meter_0_irq_count);
-
-		atomic_clear(&water_meter_0_irq_count);
-		water_meter_update_values(wm_inst_0_ptr, &water_meter_0_multiplier);
-#endif // WATER_METER_0_AVAILABLE
+		for (int i = 0; i < WATER_METER_INSTANCE_COUNT; i++) {
+			water_meter_update_values(&water_meter_channels[i], (anjay_iid_t)i);
+		}
+		k_sem_take(&water_meter_wakeup,
+			   atomic_get(&game_in_progress) ? WM_TIMER_CYCLE : WM_IDLE_TIMER_CYCLE);
+	}
+}
 
-#if WATER_METER_1_AVAILABLE
-		atomic_val_t water_meter_1_multiplier = atomic_get(&water_meter_1_irq_count);
+static void water_meter_state_changed(enum bubblemaker_state state)
+{
+	bool in_game = state == BUBBLEMAKER_START_RED_LIGHT ||
+		       state == BUBBLEMAKER_START_YELLOW_LIGHT || state == BUBBLEMAKER_MEASURE;
 
-		atomic_clear(&water_meter_1_irq_count);
-		water_meter_update_values(wm_inst_1_ptr, &water_meter_1_multiplier);
-#endif // WATER_METER_1_AVAILABLE
-		k_sleep(WM_TIMER_CYCLE);
-	}
+	// the meters are updated right away, and then more often during a game
+	atomic_set(&game_in_progress, in_game);
+	k_sem_give(&water_meter_wakeup);
 }
 
 int water_meter_init(void)
 {
-#if WATER_METER_0_AVAILABLE
-	static const struct gpio_dt_spec water_meter_0_spec =
-		GPIO_DT_SPEC_GET(WATER_METER_0_NODE, gpios);
-
-	if (!device_is_ready(water_meter_0_spec.port)) {
-		LOG_ERR("Water meter 0 is not ready");
+	if (bubblemaker_subscribe(water_meter_state_changed)) {
 		return -1;
 	}
 
-	static struct gpio_callback water_meter_0_callback;
-
-	gpio_pin_configure_dt(&water_meter_0_spec, GPIO_INPUT);
-	gpio_init_callback(&water_meter_0_callback, water_meter_0_callback_handler,
-			   BIT(water_meter_0_spec.pin));
-	gpio_add_callback(water_meter_0_spec.port, &water_meter_0_callback);
-	gpio_pin_interrupt_configure_dt(&water_meter_0_spec, GPIO_INT_EDGE_RISING);
-#endif // WATER_METER_0_AVAILABLE
-
-#if WATER_METER_1_AVAILABLE
-	static const struct gpio_dt_spec water_meter_1_spec =
-		GPIO_DT_SPEC_GET(WATER_METER_1_NODE, gpios);
-
-	if (!device_is_ready(water_meter_1_spec.port)) {
-		LOG_ERR("Water meter 1 is not ready");
-		return -1;
+	for (int i = 0; i < WATER_METER_INSTANCE_COUNT; i++) {
+		if (pulse_counter_start(&water_meter_channels[i].counter)) {
+			LOG_ERR("Water meter %d is not ready", i);
+			return -1;
+		}
 	}
 
-	static struct gpio_callback water_meter_1_callback;
-
-	gpio_pin_configure_dt(&water_meter_1_spec, GPIO_INPUT);
-	gpio_init_callback(&water_meter_1_callback, water_meter_1_callback_handler,
-			   BIT(water_meter_1_spec.pin));
-	gpio_add_callback(water_meter_1_spec.port, &water_meter_1_callback);
-	gpio_pin_interrupt_configure_dt(&water_meter_1_spec, GPIO_INT_EDGE_RISING);
-#endif // WATER_METER_1_AVAILABLE
-
 	if (!k_thread_create(&water_meter_thread, water_meter_stack,
 			     K_THREAD_STACK_SIZEOF(water_meter_stack), water_meter_periodic, NULL,
 			     NULL, NULL, 1, 0, K_NO_WAIT)) {
@@ -465,3 +499,34 @@ int water_meter_init(void)
 
 	return 0;
 }
+
+#if defined(CONFIG_SHELL) && defined(CONFIG_GPIO_EMUL) &&                                          \
+	!defined(CONFIG_APP_WATER_METER_CAPTURE_HW)
+static int cmd_water_meter_pulses(const struct shell *sh, size_t argc, char **argv)
+{
+	char *endptr;
+	unsigned long iid = strtoul(argv[1], &endptr, 10);
+
+	if (*endptr || iid >= WATER_METER_INSTANCE_COUNT) {
+		shell_error(sh, "Invalid water meter: %s", argv[1]);
+		return -EINVAL;
+	}
+
+	unsigned long count = strtoul(argv[2], &endptr, 10);
+
+	if (*endptr) {
+		shell_error(sh, "Invalid pulse count: %s", argv[2]);
+		return -EINVAL;
+	}
+	return pulse_counter_emulate(&water_meter_channels[iid].counter, (uint32_t)count);
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_water_meter,
+			       SHELL_CMD_ARG(pulses, NULL,
+					     "<meter> <count> Generate pulses on an emulated input",
+					     cmd_water_meter_pulses, 3, 0),
+			       SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(water_meter, &sub_water_meter, "Water meter commands", NULL);
+#endif // defined(CONFIG_SHELL) && defined(CONFIG_GPIO_EMUL) &&
+       // !defined(CONFIG_APP_WATER_METER_CAPTURE_HW)
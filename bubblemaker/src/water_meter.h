@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <anjay/anjay.h>
 #include <anjay/dm.h>
 
 #define WATER_METER_0_NODE DT_ALIAS(water_meter_0)
@@ -30,10 +31,20 @@
 
 int water_meter_init(void);
 void water_meter_instances_reset(void);
-bool water_meter_is_null(void);
+/**
+ * Blocks until the Water Meter object is created, which also resets the
+ * instances.
+ */
+void water_meter_wait_created(void);
 #if WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
 void water_meter_get_cumulated_volumes(double *out_result);
 #endif // WATER_METER_0_AVAILABLE && WATER_METER_1_AVAILABLE
 
 const anjay_dm_object_def_t **water_meter_object_create(void);
+/**
+ * Starts or stops sending notifications of the changes of the Water Meter
+ * resources. Called from the Anjay thread.
+ */
+void water_meter_notify_start(anjay_t *anjay);
+void water_meter_notify_stop(void);
 void water_meter_object_release(const anjay_dm_object_def_t **def);
@@ -17,10 +17,15 @@
 #include "water_pump.h"
 
 #if WATER_PUMP_0_AVAILABLE
+#include <string.h>
+
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
 
+#include "dm_table.h"
+#include "latency_stats.h"
+
 LOG_MODULE_REGISTER(water_pump);
 
 /**
@@ -69,10 +74,6 @@ LOG_MODULE_REGISTER(water_pump);
  */
 #define RID_ON_TIME 5852
 
-#define SYNCHRONIZED(Mtx)                                                                          \
-	for (int _synchronized_exit = k_mutex_lock(&(Mtx), K_FOREVER); !_synchronized_exit;        \
-	     _synchronized_exit = -1, k_mutex_unlock(&(Mtx)))
-
 static K_MUTEX_DEFINE(water_pump_mutex);
 
 static struct k_work gpio_toggle_work;
@@ -82,132 +83,93 @@ static const struct gpio_dt_spec button_0_spec = GPIO_DT_SPEC_GET(BUTTON_0_NODE,
 
 static struct gpio_callback button_0_callback;
 
+/*
+ * There is a single water pump, so the object has room for one instance. The
+ * instance ID indexes the instances array directly.
+ */
+#define POWER_CONTROL_INSTANCE_COUNT 1
+
 struct power_control_instance {
-	anjay_iid_t iid;
+	bool present;
 	char application_type[64];
 	bool state;
 };
 
-struct power_control_object {
-	const anjay_dm_object_def_t *def;
+static struct power_control_instance power_control_instances[POWER_CONTROL_INSTANCE_COUNT];
 
-	AVS_LIST(struct power_control_instance) instances;
+/*
+ * The optional Cumulative active power, Power factor, Dimmer and On time
+ * resources are not supported, so they are left out of the table.
+ */
+static const struct dm_table_resource power_control_resources[] = {
+	DM_TABLE_RESOURCE(RID_APPLICATION_TYPE, ANJAY_DM_RES_RW, DM_TABLE_STRING,
+			  struct power_control_instance, application_type),
+	DM_TABLE_RESOURCE(RID_ON_OFF, ANJAY_DM_RES_RW, DM_TABLE_BOOL,
+			  struct power_control_instance, state)
 };
 
-static inline struct power_control_object *get_obj(const anjay_dm_object_def_t *const *obj_ptr)
+static void before_read(void *inst, const struct dm_table_resource *res)
 {
-	assert(obj_ptr);
-	return AVS_CONTAINER_OF(obj_ptr, struct power_control_object, def);
-}
-
-static struct power_control_instance *find_instance(const struct power_control_object *obj,
-						    anjay_iid_t iid)
-{
-	AVS_LIST(struct power_control_instance) it;
-	AVS_LIST_FOREACH(it, obj->instances)
-	{
-		if (it->iid == iid) {
-			return it;
-		} else if (it->iid > iid) {
-			break;
-		}
+	if (res->rid == RID_ON_OFF) {
+		((struct power_control_instance *)inst)->state =
+			gpio_pin_get_dt(&water_pump_0_spec);
 	}
-
-	return NULL;
 }
 
-static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
-			  anjay_dm_list_ctx_t *ctx)
+static void after_write(void *inst, const struct dm_table_resource *res)
 {
-	(void)anjay;
-
-	AVS_LIST(struct power_control_instance) it;
-	AVS_LIST_FOREACH(it, get_obj(obj_ptr)->instances)
-	{
-		anjay_dm_emit(ctx, it->iid);
+	if (res->rid == RID_ON_OFF) {
+		gpio_pin_set_dt(&water_pump_0_spec,
+				((struct power_control_instance *)inst)->state);
 	}
-
-	return 0;
 }
 
-static int init_instance(struct power_control_instance *inst, anjay_iid_t iid)
-{
-	assert(iid != ANJAY_ID_INVALID);
+static struct dm_table_object power_control_object = {
+	.resources = power_control_resources,
+	.resource_count = ARRAY_SIZE(power_control_resources),
+	.instances = power_control_instances,
+	.instance_size = sizeof(struct power_control_instance),
+	.instance_count = POWER_CONTROL_INSTANCE_COUNT,
+	.present_offset = offsetof(struct power_control_instance, present),
+	.mutex = &water_pump_mutex,
+	.before_read = before_read,
+	.after_write = after_write
+};
 
-	inst->iid = iid;
+static void init_instance(struct power_control_instance *inst)
+{
+	inst->present = true;
 	strncpy(inst->application_type, "Water pump", sizeof(inst->application_type));
 	SYNCHRONIZED(water_pump_mutex)
 	{
 		inst->state = gpio_pin_get_dt(&water_pump_0_spec);
 	}
-
-	return 0;
-}
-
-static void release_instance(struct power_control_instance *inst)
-{
-	(void)inst;
-}
-
-static struct power_control_instance *add_instance(struct power_control_object *obj,
-						   anjay_iid_t iid)
-{
-	assert(find_instance(obj, iid) == NULL);
-
-	AVS_LIST(struct power_control_instance)
-	created = AVS_LIST_NEW_ELEMENT(struct power_control_instance);
-	if (!created) {
-		return NULL;
-	}
-
-	int result = init_instance(created, iid);
-
-	if (result) {
-		AVS_LIST_CLEAR(&created);
-		return NULL;
-	}
-
-	AVS_LIST(struct power_control_instance) * ptr;
-	AVS_LIST_FOREACH_PTR(ptr, &obj->instances)
-	{
-		if ((*ptr)->iid > created->iid) {
-			break;
-		}
-	}
-
-	AVS_LIST_INSERT(ptr, created);
-	return created;
 }
 
 static int instance_create(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
 			   anjay_iid_t iid)
 {
 	(void)anjay;
-	struct power_control_object *obj = get_obj(obj_ptr);
 
-	return add_instance(obj, iid) ? 0 : ANJAY_ERR_INTERNAL;
+	assert(!dm_table_find_instance(dm_table_get_obj(obj_ptr), iid));
+	if (iid >= POWER_CONTROL_INSTANCE_COUNT) {
+		return ANJAY_ERR_BAD_REQUEST;
+	}
+
+	init_instance(&power_control_instances[iid]);
+	return 0;
 }
 
 static int instance_remove(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
 			   anjay_iid_t iid)
 {
 	(void)anjay;
-	struct power_control_object *obj = get_obj(obj_ptr);
+	struct power_control_instance *inst =
+		dm_table_find_instance(dm_table_get_obj(obj_ptr), iid);
 
-	AVS_LIST(struct power_control_instance) * it;
-	AVS_LIST_FOREACH_PTR(it, &obj->instances)
-	{
-		if ((*it)->iid == iid) {
-			release_instance(*it);
-			AVS_LIST_DELETE(it);
-			return 0;
-		} else if ((*it)->iid > iid) {
-			break;
-		}
-	}
-
-	assert(0);
-	return ANJAY_ERR_NOT_FOUND;
+	assert(inst);
+	inst->present = false;
+	return 0;
 }
 
 static int instance_reset(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
@@ -215,105 +177,37 @@ static int instance_reset(anjay_t *anjay, const anjay_dm_object_def_t *const *ob
 {
 	(void)anjay;
 
-	struct power_control_object *obj = get_obj(obj_ptr);
-	struct power_control_instance *inst = find_instance(obj, iid);
+	struct power_control_instance *inst =
+		dm_table_find_instance(dm_table_get_obj(obj_ptr), iid);
 
 	assert(inst);
 
 	return 0;
 }
 
-static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
-			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
-{
-	(void)anjay;
-	(void)obj_ptr;
-	(void)iid;
-
-	anjay_dm_emit_res(ctx, RID_APPLICATION_TYPE, ANJAY_DM_RES_RW, ANJAY_DM_RES_PRESENT);
-	anjay_dm_emit_res(ctx, RID_CUMULATIVE_ACTIVE_POWER, ANJAY_DM_RES_R, ANJAY_DM_RES_ABSENT);
-	anjay_dm_emit_res(ctx, RID_POWER_FACTOR, ANJAY_DM_RES_R, ANJAY_DM_RES_ABSENT);
-	anjay_dm_emit_res(ctx, RID_ON_OFF, ANJAY_DM_RES_RW, ANJAY_DM_RES_PRESENT);
-	anjay_dm_emit_res(ctx, RID_DIMMER, ANJAY_DM_RES_RW, ANJAY_DM_RES_ABSENT);
-	anjay_dm_emit_res(ctx, RID_ON_TIME, ANJAY_DM_RES_RW, ANJAY_DM_RES_ABSENT);
-	return 0;
-}
-
 static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
 			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
 			 anjay_output_ctx_t *ctx)
 {
-	(void)anjay;
-
-	struct power_control_object *obj = get_obj(obj_ptr);
-	struct power_control_instance *inst = find_instance(obj, iid);
-
-	assert(inst);
-
-	switch (rid) {
-	case RID_APPLICATION_TYPE:
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_ret_string(ctx, inst->application_type);
-
-	case RID_ON_OFF:
-		assert(riid == ANJAY_ID_INVALID);
-		SYNCHRONIZED(water_pump_mutex)
-		{
-			inst->state = gpio_pin_get_dt(&water_pump_0_spec);
-		}
-		return anjay_ret_bool(ctx, inst->state);
-
-	default:
-		return ANJAY_ERR_METHOD_NOT_ALLOWED;
-	}
-}
-
-static int resource_write(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
-			  anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
-			  anjay_input_ctx_t *ctx)
-{
-	(void)anjay;
-
-	struct power_control_object *obj = get_obj(obj_ptr);
-	struct power_control_instance *inst = find_instance(obj, iid);
-
-	assert(inst);
+	int result;
 
-	switch (rid) {
-	case RID_APPLICATION_TYPE: {
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_get_string(ctx, inst->application_type,
-					sizeof(inst->application_type));
-	}
-
-	case RID_ON_OFF: {
-		assert(riid == ANJAY_ID_INVALID);
-		bool value;
-		int ret = anjay_get_bool(ctx, &value);
-
-		SYNCHRONIZED(water_pump_mutex)
-		{
-			inst->state = value;
-			gpio_pin_set_dt(&water_pump_0_spec, value);
-		}
-		return ret;
-	}
-
-	default:
-		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	LATENCY_MEASURE(LATENCY_PROBE_WATER_PUMP_READ)
+	{
+		result = dm_table_resource_read(anjay, obj_ptr, iid, rid, riid, ctx);
 	}
+	return result;
 }
 
 static const anjay_dm_object_def_t OBJ_DEF = {
 	.oid = 3312,
-	.handlers = { .list_instances = list_instances,
+	.handlers = { .list_instances = dm_table_list_instances,
 		      .instance_create = instance_create,
 		      .instance_remove = instance_remove,
 		      .instance_reset = instance_reset,
 
-		      .list_resources = list_resources,
+		      .list_resources = dm_table_list_resources,
 		      .resource_read = resource_read,
-		      .resource_write = resource_write,
+		      .resource_write = dm_table_resource_write,
 
 		      .transaction_begin = anjay_dm_transaction_NOOP,
 		      .transaction_validate = anjay_dm_transaction_NOOP,
@@ -323,32 +217,16 @@ static const anjay_dm_object_def_t OBJ_DEF = {
 
 const anjay_dm_object_def_t **power_control_object_create(void)
 {
-	struct power_control_object *obj =
-		(struct power_control_object *)avs_calloc(1, sizeof(struct power_control_object));
-	if (!obj) {
-		return NULL;
-	}
-	obj->def = &OBJ_DEF;
-
-	if (!add_instance(obj, 0)) {
-		avs_free(obj);
-		return NULL;
-	}
+	memset(power_control_instances, 0, sizeof(power_control_instances));
+	init_instance(&power_control_instances[0]);
+	power_control_object.def = &OBJ_DEF;
 
-	return &obj->def;
+	return &power_control_object.def;
 }
 
 void power_control_object_release(const anjay_dm_object_def_t **def)
 {
-	if (def) {
-		struct power_control_object *obj = get_obj(def);
-
-		AVS_LIST_CLEAR(&obj->instances)
-		{
-			release_instance(obj->instances);
-		}
-		avs_free(obj);
-	}
+	(void)def;
 }
 
 static void button_0_callback_handler(const struct device *port, struct gpio_callback *cb,
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr/drivers/gpio/gpio_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "pulse_counter.h"
+
+/*
+ * The water meter inputs are toggled on the GPIO emulator, which calls the
+ * interrupt handler of pulse_counter.c synchronously, so the counts can be
+ * checked right after.
+ */
+
+#define WATER_METER_0_NODE DT_ALIAS(water_meter_0)
+#define WATER_METER_1_NODE DT_ALIAS(water_meter_1)
+
+static struct pulse_counter counters[] = {
+	PULSE_COUNTER_INITIALIZER(WATER_METER_0_NODE, 1),
+	PULSE_COUNTER_INITIALIZER(WATER_METER_1_NODE, 2),
+};
+
+// the inputs are active low, like the open collector outputs of the sensors
+static void pin_set(struct pulse_counter *counter, bool active)
+{
+	zassert_ok(gpio_emul_input_set(counter->spec.port, counter->spec.pin, active ? 0 : 1));
+}
+
+static void toggle(struct pulse_counter *counter, uint32_t pulses)
+{
+	for (uint32_t i = 0; i < pulses; i++) {
+		pin_set(counter, true);
+		pin_set(counter, false);
+	}
+}
+
+static uint32_t pulses_since(struct pulse_counter *counter, const struct pulse_count *start)
+{
+	struct pulse_count count;
+
+	pulse_counter_read(counter, &count);
+	return count.pulses - start->pulses;
+}
+
+ZTEST(pulse_counter, test_pulses_counted)
+{
+	struct pulse_count start;
+	struct pulse_count end;
+
+	pulse_counter_read(&counters[0], &start);
+	toggle(&counters[0], 100);
+	pulse_counter_read(&counters[0], &end);
+	zassert_equal(end.pulses - start.pulses, 100);
+}
+
+ZTEST(pulse_counter, test_counted_on_the_active_edge)
+{
+	struct pulse_count start;
+
+	pulse_counter_read(&counters[0], &start);
+	pin_set(&counters[0], true);
+	zassert_equal(pulses_since(&counters[0], &start), 1);
+	// holding the level or releasing it is not another pulse
+	pin_set(&counters[0], true);
+	pin_set(&counters[0], false);
+	zassert_equal(pulses_since(&counters[0], &start), 1);
+}
+
+ZTEST(pulse_counter, test_last_pulse_timestamp)
+{
+	struct pulse_count count;
+	struct pulse_count later;
+	uint32_t before;
+	uint32_t after;
+
+	k_busy_wait(1000);
+	before = pulse_counter_now();
+	toggle(&counters[0], 1);
+	after = pulse_counter_now();
+	pulse_counter_read(&counters[0], &count);
+	zassert_true(count.last_pulse - before <= after - before);
+
+	// no pulse since, so the timestamp stays
+	k_busy_wait(1000);
+	pulse_counter_read(&counters[0], &later);
+	zassert_equal(later.last_pulse, count.last_pulse);
+	zassert_true(pulse_counter_ticks_to_us(pulse_counter_now() - count.last_pulse) >= 1000);
+}
+
+ZTEST(pulse_counter, test_meters_counted_separately)
+{
+	struct pulse_count start[ARRAY_SIZE(counters)];
+
+	for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+		pulse_counter_read(&counters[i], &start[i]);
+	}
+	toggle(&counters[0], 7);
+	toggle(&counters[1], 3);
+	zassert_equal(pulses_since(&counters[0], &start[0]), 7);
+	zassert_equal(pulses_since(&counters[1], &start[1]), 3);
+}
+
+ZTEST(pulse_counter, test_emulated_pulses)
+{
+	struct pulse_count start;
+
+	// as generated by the "water_meter pulses" shell command
+	pulse_counter_read(&counters[1], &start);
+	zassert_ok(pulse_counter_emulate(&counters[1], 450));
+	zassert_equal(pulses_since(&counters[1], &start), 450);
+}
+
+static void *pulse_counter_setup(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(counters); i++) {
+		zassert_ok(pulse_counter_start(&counters[i]));
+		// idle inputs are pulled up
+		pin_set(&counters[i], false);
+	}
+	return NULL;
+}
+
+ZTEST_SUITE(pulse_counter, NULL, pulse_counter_setup, NULL, NULL, NULL);
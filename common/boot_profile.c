@@ -0,0 +1,299 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#ifdef CONFIG_HWINFO
+#include <zephyr/drivers/hwinfo.h>
+#endif // CONFIG_HWINFO
+
+#include <anjay/anjay.h>
+
+#include "boot_profile.h"
+
+LOG_MODULE_REGISTER(boot_profile);
+
+/*
+ * The registration state is polled, as Anjay has no callback for it. The
+ * period doubles from the first to the maximum one, which also bounds the
+ * error of the recorded registration time, and the polling stops if the
+ * registration does not complete within the timeout.
+ */
+#define REGISTRATION_CHECK_FIRST_PERIOD_MS 100
+#define REGISTRATION_CHECK_MAX_PERIOD_MS 1600
+#define REGISTRATION_WATCH_TIMEOUT_MS (10 * 60 * 1000)
+
+/**
+ * Boot Profile: custom object in the private range, one instance per boot
+ * phase
+ */
+#define OID_BOOT_PROFILE 26245
+
+/**
+ * Phase Name: R, Single, Mandatory
+ * type: string, range: N/A, unit: N/A
+ * Name of the boot phase.
+ */
+#define RID_PHASE_NAME 0
+
+/**
+ * Time Since Boot: R, Single, Optional
+ * type: integer, range: N/A, unit: ms
+ * Uptime at which the phase has been reached. Absent until then.
+ */
+#define RID_TIME_SINCE_BOOT 1
+
+static const char *const phase_names[] = {
+	[BOOT_PHASE_MAIN] = "main",
+	[BOOT_PHASE_SETTINGS_LOADED] = "settings_loaded",
+	[BOOT_PHASE_LWM2M_STARTED] = "lwm2m_started",
+	[BOOT_PHASE_PERIPHERALS_READY] = "peripherals_ready",
+	[BOOT_PHASE_OBJECTS_REGISTERED] = "objects_registered",
+	[BOOT_PHASE_ANJAY_READY] = "anjay_ready",
+	[BOOT_PHASE_REGISTERED] = "registered",
+};
+
+BUILD_ASSERT(ARRAY_SIZE(phase_names) == _BOOT_PHASE_COUNT);
+
+// -1 until the phase is reached
+static int64_t phase_times_ms[_BOOT_PHASE_COUNT] = { [0 ... _BOOT_PHASE_COUNT - 1] = -1 };
+static struct k_spinlock phase_times_lock;
+
+static avs_sched_handle_t registration_check_handle;
+static bool registration_pending_seen;
+static int32_t registration_check_period_ms;
+static int64_t registration_watch_deadline_ms;
+static int64_t registration_last_check_ms;
+
+static int64_t phase_time_get(enum boot_phase phase)
+{
+	k_spinlock_key_t key = k_spin_lock(&phase_times_lock);
+	int64_t result = phase_times_ms[phase];
+
+	k_spin_unlock(&phase_times_lock, key);
+	return result;
+}
+
+void boot_profile_mark(enum boot_phase phase)
+{
+	int64_t now_ms = k_uptime_get();
+	bool first = false;
+	k_spinlock_key_t key = k_spin_lock(&phase_times_lock);
+
+	if (phase_times_ms[phase] < 0) {
+		phase_times_ms[phase] = now_ms;
+		first = true;
+	}
+	k_spin_unlock(&phase_times_lock, key);
+
+	if (first) {
+		LOG_INF("Boot phase %s reached after %lld ms", phase_names[phase],
+			(long long)now_ms);
+	}
+}
+
+static void registration_report(void)
+{
+	int64_t registered_ms = phase_time_get(BOOT_PHASE_REGISTERED);
+	int64_t ready_ms = phase_time_get(BOOT_PHASE_ANJAY_READY);
+
+	// it has completed at some point since the previous check
+	LOG_INF("Registered to the LwM2M Server %lld ms after boot, %lld ms after Anjay was "
+		"ready (up to %lld ms earlier)",
+		(long long)registered_ms, (long long)(registered_ms - ready_ms),
+		(long long)(registered_ms - registration_last_check_ms));
+}
+
+static void check_registration(avs_sched_t *sched, const void *anjay_ptr)
+{
+	anjay_t *anjay = *(anjay_t *const *)anjay_ptr;
+
+	/*
+	 * Until the servers are loaded, no registration is pending either, so
+	 * the phase is only marked once a pending registration has been seen.
+	 */
+	if (anjay_ongoing_registration_exists(anjay)) {
+		registration_pending_seen = true;
+	} else if (registration_pending_seen && !anjay_all_connections_failed(anjay)) {
+		boot_profile_mark(BOOT_PHASE_REGISTERED);
+		registration_report();
+		return;
+	}
+
+	registration_last_check_ms = k_uptime_get();
+	if (registration_last_check_ms >= registration_watch_deadline_ms) {
+		LOG_WRN("Registration not completed within %d s, no longer watching",
+			REGISTRATION_WATCH_TIMEOUT_MS / 1000);
+		return;
+	}
+
+	AVS_SCHED_DELAYED(sched, &registration_check_handle,
+			  avs_time_duration_from_scalar(registration_check_period_ms, AVS_TIME_MS),
+			  check_registration, &anjay, sizeof(anjay));
+	registration_check_period_ms =
+		MIN(2 * registration_check_period_ms, REGISTRATION_CHECK_MAX_PERIOD_MS);
+}
+
+void boot_profile_registration_watch(anjay_t *anjay)
+{
+	if (phase_time_get(BOOT_PHASE_REGISTERED) >= 0) {
+		return;
+	}
+	registration_pending_seen = false;
+	registration_check_period_ms = REGISTRATION_CHECK_FIRST_PERIOD_MS;
+	registration_watch_deadline_ms = k_uptime_get() + REGISTRATION_WATCH_TIMEOUT_MS;
+	check_registration(anjay_get_scheduler(anjay), &anjay);
+}
+
+void boot_profile_registration_unwatch(void)
+{
+	avs_sched_del(&registration_check_handle);
+}
+
+static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	for (anjay_iid_t iid = 0; iid < _BOOT_PHASE_COUNT; iid++) {
+		anjay_dm_emit(ctx, iid);
+	}
+	return 0;
+}
+
+static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	assert(iid < _BOOT_PHASE_COUNT);
+	anjay_dm_emit_res(ctx, RID_PHASE_NAME, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_TIME_SINCE_BOOT, ANJAY_DM_RES_R,
+			  phase_time_get((enum boot_phase)iid) >= 0 ? ANJAY_DM_RES_PRESENT :
+								      ANJAY_DM_RES_ABSENT);
+	return 0;
+}
+
+static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			 anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	assert(iid < _BOOT_PHASE_COUNT);
+
+	switch (rid) {
+	case RID_PHASE_NAME:
+		assert(riid == ANJAY_ID_INVALID);
+		return anjay_ret_string(ctx, phase_names[iid]);
+
+	case RID_TIME_SINCE_BOOT: {
+		assert(riid == ANJAY_ID_INVALID);
+		int64_t time_ms = phase_time_get((enum boot_phase)iid);
+
+		return time_ms >= 0 ? anjay_ret_i64(ctx, time_ms) : ANJAY_ERR_NOT_FOUND;
+	}
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = OID_BOOT_PROFILE,
+	.handlers = { .list_instances = list_instances,
+
+		      .list_resources = list_resources,
+		      .resource_read = resource_read }
+};
+
+static const anjay_dm_object_def_t *const OBJ_DEF_PTR = &OBJ_DEF;
+
+int boot_profile_object_install(anjay_t *anjay)
+{
+	return anjay_register_object(anjay, &OBJ_DEF_PTR);
+}
+
+#ifdef CONFIG_SHELL
+#ifdef CONFIG_HWINFO
+static void print_reset_cause(const struct shell *shell)
+{
+	static const struct {
+		uint32_t flag;
+		const char *name;
+	} causes[] = { { RESET_PIN, "pin" },
+		       { RESET_SOFTWARE, "software" },
+		       { RESET_BROWNOUT, "brownout" },
+		       { RESET_POR, "power-on" },
+		       { RESET_WATCHDOG, "watchdog" },
+		       { RESET_DEBUG, "debug" },
+		       { RESET_CPU_LOCKUP, "cpu lockup" } };
+	uint32_t cause;
+
+	if (hwinfo_get_reset_cause(&cause)) {
+		return;
+	}
+
+	shell_print(shell, "reset cause: 0x%08x", cause);
+	for (size_t i = 0; i < ARRAY_SIZE(causes); i++) {
+		if (cause & causes[i].flag) {
+			shell_print(shell, "  %s", causes[i].name);
+		}
+	}
+}
+#endif // CONFIG_HWINFO
+
+static int cmd_stats_boot(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	int64_t previous_ms = 0;
+
+	shell_print(shell, "%-20s %10s %10s", "phase", "time [ms]", "delta [ms]");
+	for (int i = 0; i < _BOOT_PHASE_COUNT; i++) {
+		int64_t time_ms = phase_time_get((enum boot_phase)i);
+
+		if (time_ms < 0) {
+			shell_print(shell, "%-20s %10s %10s", phase_names[i], "-", "-");
+			continue;
+		}
+		// phases reached concurrently may complete out of order
+		shell_print(shell, "%-20s %10lld %10lld", phase_names[i], (long long)time_ms,
+			    (long long)(time_ms - previous_ms));
+		previous_ms = time_ms;
+	}
+
+	int64_t registered_ms = phase_time_get(BOOT_PHASE_REGISTERED);
+
+	if (registered_ms >= 0) {
+		shell_print(shell, "boot to registration: %lld ms", (long long)registered_ms);
+	}
+#ifdef CONFIG_HWINFO
+	print_reset_cause(shell);
+#endif // CONFIG_HWINFO
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((stats), boot, NULL, "Show the time at which each boot phase has been reached",
+		 cmd_stats_boot, 1, 0);
+#endif // CONFIG_SHELL
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <anjay/anjay.h>
+
+enum boot_phase {
+	// entry to main(), after the kernel and the drivers have been initialized
+	BOOT_PHASE_MAIN,
+	BOOT_PHASE_SETTINGS_LOADED,
+	BOOT_PHASE_LWM2M_STARTED,
+	// the application's own initialization, done while the network comes up
+	BOOT_PHASE_PERIPHERALS_READY,
+	BOOT_PHASE_OBJECTS_REGISTERED,
+	BOOT_PHASE_ANJAY_READY,
+	// first time no registration to a LwM2M Server is pending
+	BOOT_PHASE_REGISTERED,
+	_BOOT_PHASE_COUNT
+};
+
+#ifdef CONFIG_APP_BOOT_PROFILE
+/**
+ * Records the time since boot at which @p phase has been reached. Only the
+ * first call for each phase is recorded, so restarts of Anjay do not
+ * overwrite the boot timeline. May be called from any thread.
+ */
+void boot_profile_mark(enum boot_phase phase);
+
+/**
+ * Polls the registration state on the scheduler of @p anjay, with a growing
+ * period, until BOOT_PHASE_REGISTERED is reached, and logs the
+ * boot-to-registration time then. Gives up if the registration does not
+ * complete within a timeout. Does nothing if the phase has already been
+ * reached.
+ */
+void boot_profile_registration_watch(anjay_t *anjay);
+void boot_profile_registration_unwatch(void);
+
+/**
+ * Registers the Boot Profile object, with one instance per phase.
+ */
+int boot_profile_object_install(anjay_t *anjay);
+#else // CONFIG_APP_BOOT_PROFILE
+static inline void boot_profile_mark(enum boot_phase phase)
+{
+	(void)phase;
+}
+
+static inline void boot_profile_registration_watch(anjay_t *anjay)
+{
+	(void)anjay;
+}
+
+static inline void boot_profile_registration_unwatch(void)
+{
+}
+#endif // CONFIG_APP_BOOT_PROFILE
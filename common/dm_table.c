@@ -0,0 +1,208 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+
+#include <anjay/anjay.h>
+
+#include "dm_table.h"
+
+void *dm_table_find_instance(const struct dm_table_object *obj, anjay_iid_t iid)
+{
+	if (iid >= obj->instance_count) {
+		return NULL;
+	}
+
+	char *inst = (char *)obj->instances + (size_t)iid * obj->instance_size;
+
+	if (obj->present_offset != DM_TABLE_ALWAYS_PRESENT &&
+	    !*(const bool *)(inst + obj->present_offset)) {
+		return NULL;
+	}
+	return inst;
+}
+
+static const struct dm_table_resource *find_resource(const struct dm_table_object *obj,
+						     anjay_rid_t rid)
+{
+	size_t lo = 0;
+	size_t hi = obj->resource_count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (obj->resources[mid].rid == rid) {
+			return &obj->resources[mid];
+		} else if (obj->resources[mid].rid < rid) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return NULL;
+}
+
+int dm_table_list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+
+	struct dm_table_object *obj = dm_table_get_obj(obj_ptr);
+
+	for (anjay_iid_t iid = 0; iid < obj->instance_count; iid++) {
+		if (dm_table_find_instance(obj, iid)) {
+			anjay_dm_emit(ctx, iid);
+		}
+	}
+
+	return 0;
+}
+
+int dm_table_list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)iid;
+
+	struct dm_table_object *obj = dm_table_get_obj(obj_ptr);
+
+	for (size_t i = 0; i < obj->resource_count; i++) {
+		assert(i == 0 || obj->resources[i - 1].rid < obj->resources[i].rid);
+		anjay_dm_emit_res(ctx, obj->resources[i].rid,
+				  (anjay_dm_resource_kind_t)obj->resources[i].kind,
+				  ANJAY_DM_RES_PRESENT);
+	}
+	return 0;
+}
+
+static int ret_value(anjay_output_ctx_t *ctx, const struct dm_table_resource *res,
+		     const void *value)
+{
+	switch (res->type) {
+	case DM_TABLE_BOOL:
+		return anjay_ret_bool(ctx, *(const bool *)value);
+	case DM_TABLE_I32:
+		return anjay_ret_i32(ctx, *(const int32_t *)value);
+	case DM_TABLE_DOUBLE:
+		return anjay_ret_double(ctx, *(const double *)value);
+	case DM_TABLE_STRING:
+		return anjay_ret_string(ctx, (const char *)value);
+	case DM_TABLE_STRING_PTR:
+		return anjay_ret_string(ctx, *(const char *const *)value);
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+int dm_table_resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			   anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			   anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)riid;
+
+	struct dm_table_object *obj = dm_table_get_obj(obj_ptr);
+	char *inst = dm_table_find_instance(obj, iid);
+	const struct dm_table_resource *res = find_resource(obj, rid);
+
+	assert(inst);
+	assert(riid == ANJAY_ID_INVALID);
+	if (!res) {
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+
+	int result;
+
+	if (obj->mutex) {
+		k_mutex_lock(obj->mutex, K_FOREVER);
+	}
+	if (obj->before_read) {
+		obj->before_read(inst, res);
+	}
+	result = ret_value(ctx, res, inst + res->offset);
+	if (obj->mutex) {
+		k_mutex_unlock(obj->mutex);
+	}
+	return result;
+}
+
+static int get_value(anjay_input_ctx_t *ctx, const struct dm_table_resource *res, void *value)
+{
+	int result;
+
+	switch (res->type) {
+	case DM_TABLE_BOOL: {
+		bool parsed;
+
+		if (!(result = anjay_get_bool(ctx, &parsed))) {
+			*(bool *)value = parsed;
+		}
+		return result;
+	}
+	case DM_TABLE_I32: {
+		int32_t parsed;
+
+		if (!(result = anjay_get_i32(ctx, &parsed))) {
+			*(int32_t *)value = parsed;
+		}
+		return result;
+	}
+	case DM_TABLE_DOUBLE: {
+		double parsed;
+
+		if (!(result = anjay_get_double(ctx, &parsed))) {
+			*(double *)value = parsed;
+		}
+		return result;
+	}
+	case DM_TABLE_STRING:
+		return anjay_get_string(ctx, (char *)value, res->size);
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+int dm_table_resource_write(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			    anjay_input_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)riid;
+
+	struct dm_table_object *obj = dm_table_get_obj(obj_ptr);
+	char *inst = dm_table_find_instance(obj, iid);
+	const struct dm_table_resource *res = find_resource(obj, rid);
+
+	assert(inst);
+	assert(riid == ANJAY_ID_INVALID);
+	if (!res) {
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+
+	int result;
+
+	if (obj->mutex) {
+		k_mutex_lock(obj->mutex, K_FOREVER);
+	}
+	result = get_value(ctx, res, inst + res->offset);
+	if (!result && obj->after_write) {
+		obj->after_write(inst, res);
+	}
+	if (obj->mutex) {
+		k_mutex_unlock(obj->mutex);
+	}
+	return result;
+}
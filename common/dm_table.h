@@ -0,0 +1,111 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include <anjay/dm.h>
+#include <avsystem/commons/avs_defs.h>
+
+#include "synchronized.h"
+
+enum dm_table_type {
+	// no value stored in the instance, e.g. executable resources
+	DM_TABLE_NONE,
+	DM_TABLE_BOOL,
+	DM_TABLE_I32,
+	DM_TABLE_DOUBLE,
+	// char array embedded in the instance
+	DM_TABLE_STRING,
+	// const char * to a string owned by someone else, read-only
+	DM_TABLE_STRING_PTR
+};
+
+/**
+ * Describes a Single resource whose value lives at a fixed offset within the
+ * instance structure. Tables must be sorted by rid.
+ */
+struct dm_table_resource {
+	anjay_rid_t rid;
+	// anjay_dm_resource_kind_t and enum dm_table_type, narrowed to keep tables small
+	uint8_t kind;
+	uint8_t type;
+	uint16_t offset;
+	uint16_t size;
+};
+
+#define DM_TABLE_RESOURCE(Rid, Kind, Type, Instance, Field)                                        \
+	{                                                                                          \
+		.rid = (Rid), .kind = (Kind), .type = (Type), .offset = offsetof(Instance, Field), \
+		.size = sizeof(((Instance *)0)->Field)                                             \
+	}
+
+#define DM_TABLE_EXECUTABLE(Rid)                                                                   \
+	{                                                                                          \
+		.rid = (Rid), .kind = ANJAY_DM_RES_E, .type = DM_TABLE_NONE                        \
+	}
+
+#define DM_TABLE_ALWAYS_PRESENT UINT16_MAX
+
+/**
+ * Object whose instances are stored in a contiguous array indexed by the
+ * instance ID. The dm_table_* handlers below may be used directly in the
+ * object definition; anything they do not cover (Execute, instance creation
+ * and so on) stays in the object's own handlers.
+ */
+struct dm_table_object {
+	const anjay_dm_object_def_t *def;
+
+	const struct dm_table_resource *resources;
+	uint16_t resource_count;
+
+	void *instances;
+	uint16_t instance_size;
+	anjay_iid_t instance_count;
+	// offset of a bool telling whether the instance exists, or DM_TABLE_ALWAYS_PRESENT
+	uint16_t present_offset;
+
+	// held while values are read or written, may be NULL
+	struct k_mutex *mutex;
+	// called with the mutex held before a value is read, may be NULL
+	void (*before_read)(void *inst, const struct dm_table_resource *res);
+	// called with the mutex held after a value is written, may be NULL
+	void (*after_write)(void *inst, const struct dm_table_resource *res);
+};
+
+static inline struct dm_table_object *dm_table_get_obj(const anjay_dm_object_def_t *const *obj_ptr)
+{
+	assert(obj_ptr);
+	return AVS_CONTAINER_OF(obj_ptr, struct dm_table_object, def);
+}
+
+void *dm_table_find_instance(const struct dm_table_object *obj, anjay_iid_t iid);
+
+int dm_table_list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_dm_list_ctx_t *ctx);
+int dm_table_list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx);
+int dm_table_resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			   anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			   anjay_output_ctx_t *ctx);
+int dm_table_resource_write(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			    anjay_input_ctx_t *ctx);
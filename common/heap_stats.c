@@ -0,0 +1,541 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/sys_heap.h>
+
+#include <anjay/anjay.h>
+
+#include "heap_stats.h"
+
+/*
+ * avs_malloc(), avs_calloc(), avs_realloc() and avs_free() are wrapped at link
+ * time (see CMakeLists.txt), so that every allocation made through them, also
+ * from within Anjay and AVS_LIST, passes through here. Each block is prefixed
+ * with a header that holds its size and tag, so that it can be accounted for
+ * when freed.
+ *
+ * Fragmentation of the heap is not tracked as such, as that would need a walk
+ * over the heap on every read. Failed allocations, with the size of the largest
+ * one, are counted instead: a failure while Heap Free is well above the size
+ * requested means that the free space is fragmented. The "stats heap" shell
+ * command additionally probes the largest block that can currently be
+ * allocated.
+ */
+
+/**
+ * Heap Statistics: custom object in the private range, one instance per tag
+ * and one for all of them together
+ */
+#define OID_HEAP_STATS 26242
+
+/**
+ * Subsystem: R, Single, Mandatory
+ * type: string, range: N/A, unit: N/A
+ * Name of the tag, or "total".
+ */
+#define RID_SUBSYSTEM 0
+
+/**
+ * Current Usage: R, Single, Mandatory
+ * type: integer, range: N/A, unit: B
+ * Bytes currently allocated, not counting the accounting headers.
+ */
+#define RID_CURRENT_USAGE 1
+
+/**
+ * Peak Usage: R, Single, Mandatory
+ * type: integer, range: N/A, unit: B
+ * Highest value of Current Usage since boot or the last reset.
+ */
+#define RID_PEAK_USAGE 2
+
+/**
+ * Block Count: R, Single, Mandatory
+ * type: integer, range: N/A, unit: N/A
+ * Number of blocks currently allocated.
+ */
+#define RID_BLOCK_COUNT 3
+
+/**
+ * Heap Free: R, Single, Optional
+ * type: integer, range: N/A, unit: B
+ * Free space in the C library heap. Present in the "total" instance only.
+ */
+#define RID_HEAP_FREE 4
+
+/**
+ * Heap Allocated: R, Single, Optional
+ * type: integer, range: N/A, unit: B
+ * Space allocated from the C library heap, by any code and including the
+ * accounting headers. Present in the "total" instance only.
+ */
+#define RID_HEAP_ALLOCATED 5
+
+/**
+ * Heap Peak Allocated: R, Single, Optional
+ * type: integer, range: N/A, unit: B
+ * Highest value of Heap Allocated since boot. Present in the "total" instance
+ * only.
+ */
+#define RID_HEAP_PEAK_ALLOCATED 6
+
+/**
+ * Reset Peak Usage: E, Single, Mandatory
+ * type: N/A, range: N/A, unit: N/A
+ * Sets Peak Usage to Current Usage.
+ */
+#define RID_RESET_PEAK_USAGE 7
+
+/**
+ * Failed Allocations: R, Single, Optional
+ * type: integer, range: N/A, unit: N/A
+ * Number of allocations that the heap could not satisfy since boot. Present
+ * in the "total" instance only.
+ */
+#define RID_FAILED_ALLOCATIONS 8
+
+/**
+ * Largest Failed Allocation: R, Single, Optional
+ * type: integer, range: N/A, unit: B
+ * Size of the largest allocation that the heap could not satisfy since boot,
+ * 0 if none failed. Compared with Heap Free, it indicates fragmentation.
+ * Present in the "total" instance only.
+ */
+#define RID_LARGEST_FAILED_ALLOCATION 9
+
+#define IID_TOTAL _HEAP_TAG_COUNT
+
+union alloc_header {
+	struct {
+		size_t size;
+		enum heap_tag tag;
+	} info;
+	max_align_t align;
+};
+
+struct usage {
+	size_t current;
+	size_t peak;
+	size_t blocks;
+};
+
+struct failures {
+	size_t count;
+	size_t largest_size;
+};
+
+static const char *const tag_names[] = {
+	[HEAP_TAG_OTHER] = "other",
+#define HEAP_TAG_NAME(Name, Label) [HEAP_TAG_##Name] = Label,
+	HEAP_TAGS(HEAP_TAG_NAME)
+#undef HEAP_TAG_NAME
+};
+
+BUILD_ASSERT(ARRAY_SIZE(tag_names) == _HEAP_TAG_COUNT);
+
+// the last element holds the sum of all tags
+static struct usage usages[_HEAP_TAG_COUNT + 1];
+static struct failures failures;
+static struct k_spinlock usages_lock;
+
+static enum heap_tag current_tag;
+static k_tid_t current_tag_thread;
+
+#ifdef CONFIG_COMMON_LIBC_MALLOC
+int malloc_runtime_stats_get(struct sys_memory_stats *stats);
+#endif // CONFIG_COMMON_LIBC_MALLOC
+
+void *__real_avs_malloc(size_t size);
+void *__real_avs_calloc(size_t nmemb, size_t size);
+void *__real_avs_realloc(void *ptr, size_t size);
+void __real_avs_free(void *ptr);
+
+enum heap_tag heap_stats_tag_push(enum heap_tag tag)
+{
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+	enum heap_tag previous =
+		current_tag_thread == k_current_get() ? current_tag : HEAP_TAG_OTHER;
+
+	current_tag = tag;
+	current_tag_thread = k_current_get();
+	k_spin_unlock(&usages_lock, key);
+	return previous;
+}
+
+void heap_stats_tag_pop(enum heap_tag previous)
+{
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+
+	current_tag = previous;
+	if (previous == HEAP_TAG_OTHER) {
+		current_tag_thread = NULL;
+	}
+	k_spin_unlock(&usages_lock, key);
+}
+
+static void usage_add(struct usage *usage, size_t size)
+{
+	usage->current += size;
+	usage->blocks++;
+	if (usage->current > usage->peak) {
+		usage->peak = usage->current;
+	}
+}
+
+static void usage_sub(struct usage *usage, size_t size)
+{
+	usage->current -= size;
+	usage->blocks--;
+}
+
+static void failure_add(size_t size)
+{
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+
+	failures.count++;
+	if (size > failures.largest_size) {
+		failures.largest_size = size;
+	}
+	k_spin_unlock(&usages_lock, key);
+}
+
+static void *track(union alloc_header *header, size_t size, enum heap_tag tag)
+{
+	if (!header) {
+		failure_add(size);
+		return NULL;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+
+
+	if (tag == _HEAP_TAG_COUNT) {
+		tag = current_tag_thread == k_current_get() ? current_tag : HEAP_TAG_OTHER;
+	}
+	header->info.size = size;
+	header->info.tag = tag;
+	usage_add(&usages[tag], size);
+	usage_add(&usages[IID_TOTAL], size);
+	k_spin_unlock(&usages_lock, key);
+	return header + 1;
+}
+
+static union alloc_header *untrack(void *ptr)
+{
+	union alloc_header *header = (union alloc_header *)ptr - 1;
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+
+	usage_sub(&usages[header->info.tag], header->info.size);
+	usage_sub(&usages[IID_TOTAL], header->info.size);
+	k_spin_unlock(&usages_lock, key);
+	return header;
+}
+
+void *__wrap_avs_malloc(size_t size)
+{
+	if (size > SIZE_MAX - sizeof(union alloc_header)) {
+		return NULL;
+	}
+	return track(__real_avs_malloc(sizeof(union alloc_header) + size), size, _HEAP_TAG_COUNT);
+}
+
+void *__wrap_avs_calloc(size_t nmemb, size_t size)
+{
+	if (size && nmemb > (SIZE_MAX - sizeof(union alloc_header)) / size) {
+		return NULL;
+	}
+	return track(__real_avs_calloc(1, sizeof(union alloc_header) + nmemb * size), nmemb * size,
+		     _HEAP_TAG_COUNT);
+}
+
+void __wrap_avs_free(void *ptr)
+{
+	if (ptr) {
+		__real_avs_free(untrack(ptr));
+	}
+}
+
+void *__wrap_avs_realloc(void *ptr, size_t size)
+{
+	if (!ptr) {
+		return __wrap_avs_malloc(size);
+	}
+	if (!size) {
+		__wrap_avs_free(ptr);
+		return NULL;
+	}
+	if (size > SIZE_MAX - sizeof(union alloc_header)) {
+		return NULL;
+	}
+
+	union alloc_header *header = untrack(ptr);
+	size_t old_size = header->info.size;
+	enum heap_tag tag = header->info.tag;
+	union alloc_header *resized =
+		(union alloc_header *)__real_avs_realloc(header, sizeof(union alloc_header) + size);
+
+	if (!resized) {
+		// the original block is left intact
+		failure_add(size);
+		track(header, old_size, tag);
+		return NULL;
+	}
+	return track(resized, size, tag);
+}
+
+static struct usage usage_get(anjay_iid_t iid)
+{
+	struct usage result;
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+
+	result = usages[iid];
+	k_spin_unlock(&usages_lock, key);
+	return result;
+}
+
+static struct failures failures_get(void)
+{
+	struct failures result;
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+
+	result = failures;
+	k_spin_unlock(&usages_lock, key);
+	return result;
+}
+
+static void peak_reset(anjay_iid_t iid)
+{
+	k_spinlock_key_t key = k_spin_lock(&usages_lock);
+
+	usages[iid].peak = usages[iid].current;
+	k_spin_unlock(&usages_lock, key);
+}
+
+static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	for (anjay_iid_t iid = 0; iid <= IID_TOTAL; iid++) {
+		anjay_dm_emit(ctx, iid);
+	}
+	return 0;
+}
+
+static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	anjay_dm_emit_res(ctx, RID_SUBSYSTEM, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_CURRENT_USAGE, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_PEAK_USAGE, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_BLOCK_COUNT, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+
+	anjay_dm_resource_presence_t total_presence =
+		iid == IID_TOTAL ? ANJAY_DM_RES_PRESENT : ANJAY_DM_RES_ABSENT;
+
+#ifdef CONFIG_COMMON_LIBC_MALLOC
+	anjay_dm_emit_res(ctx, RID_HEAP_FREE, ANJAY_DM_RES_R, total_presence);
+	anjay_dm_emit_res(ctx, RID_HEAP_ALLOCATED, ANJAY_DM_RES_R, total_presence);
+	anjay_dm_emit_res(ctx, RID_HEAP_PEAK_ALLOCATED, ANJAY_DM_RES_R, total_presence);
+#endif // CONFIG_COMMON_LIBC_MALLOC
+	anjay_dm_emit_res(ctx, RID_RESET_PEAK_USAGE, ANJAY_DM_RES_E, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_FAILED_ALLOCATIONS, ANJAY_DM_RES_R, total_presence);
+	anjay_dm_emit_res(ctx, RID_LARGEST_FAILED_ALLOCATION, ANJAY_DM_RES_R, total_presence);
+	return 0;
+}
+
+static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			 anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	assert(iid <= IID_TOTAL);
+	assert(riid == ANJAY_ID_INVALID);
+	struct usage usage = usage_get(iid);
+
+	switch (rid) {
+	case RID_SUBSYSTEM:
+		return anjay_ret_string(ctx, iid == IID_TOTAL ? "total" : tag_names[iid]);
+
+	case RID_CURRENT_USAGE:
+		return anjay_ret_i64(ctx, usage.current);
+
+	case RID_PEAK_USAGE:
+		return anjay_ret_i64(ctx, usage.peak);
+
+	case RID_BLOCK_COUNT:
+		return anjay_ret_i64(ctx, usage.blocks);
+
+	case RID_FAILED_ALLOCATIONS:
+		return anjay_ret_i64(ctx, failures_get().count);
+
+	case RID_LARGEST_FAILED_ALLOCATION:
+		return anjay_ret_i64(ctx, failures_get().largest_size);
+
+#ifdef CONFIG_COMMON_LIBC_MALLOC
+	case RID_HEAP_FREE:
+	case RID_HEAP_ALLOCATED:
+	case RID_HEAP_PEAK_ALLOCATED: {
+		struct sys_memory_stats stats;
+
+		// counters kept by the heap itself, so reading them does not allocate
+		if (malloc_runtime_stats_get(&stats)) {
+			return ANJAY_ERR_INTERNAL;
+		}
+		if (rid == RID_HEAP_FREE) {
+			return anjay_ret_i64(ctx, stats.free_bytes);
+		}
+		if (rid == RID_HEAP_ALLOCATED) {
+			return anjay_ret_i64(ctx, stats.allocated_bytes);
+		}
+		return anjay_ret_i64(ctx, stats.max_allocated_bytes);
+	}
+#endif // CONFIG_COMMON_LIBC_MALLOC
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static int resource_execute(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_iid_t iid, anjay_rid_t rid, anjay_execute_ctx_t *arg_ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)arg_ctx;
+
+	assert(iid <= IID_TOTAL);
+
+	switch (rid) {
+	case RID_RESET_PEAK_USAGE:
+		peak_reset(iid);
+		return 0;
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = OID_HEAP_STATS,
+	.handlers = { .list_instances = list_instances,
+
+		      .list_resources = list_resources,
+		      .resource_read = resource_read,
+		      .resource_execute = resource_execute }
+};
+
+static const anjay_dm_object_def_t *const OBJ_DEF_PTR = &OBJ_DEF;
+
+int heap_stats_object_install(anjay_t *anjay)
+{
+	return anjay_register_object(anjay, &OBJ_DEF_PTR);
+}
+
+#ifdef CONFIG_SHELL
+#ifdef CONFIG_COMMON_LIBC_MALLOC
+/*
+ * Finds the largest block that malloc() can currently satisfy with a binary
+ * search over allocations, each freed right away. This is only done on
+ * request from the shell: other threads may see an allocation fail while a
+ * probe holds most of the heap, and the result may be outdated as soon as it
+ * is returned.
+ */
+static size_t largest_free_block_probe(size_t free_bytes)
+{
+	size_t low = 0;
+	size_t high = free_bytes;
+
+	while (low < high) {
+		size_t mid = low + (high - low + 1) / 2;
+		void *block = malloc(mid);
+
+		if (block) {
+			free(block);
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+	return low;
+}
+#endif // CONFIG_COMMON_LIBC_MALLOC
+
+static int cmd_stats_heap(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	shell_print(shell, "%-20s %10s %10s %10s", "subsystem", "current", "peak", "blocks");
+	for (anjay_iid_t iid = 0; iid <= IID_TOTAL; iid++) {
+		struct usage usage = usage_get(iid);
+
+		shell_print(shell, "%-20s %10zu %10zu %10zu",
+			    iid == IID_TOTAL ? "total" : tag_names[iid], usage.current, usage.peak,
+			    usage.blocks);
+	}
+
+	struct failures failed = failures_get();
+
+	shell_print(shell, "failed allocations: %zu, largest: %zu B", failed.count,
+		    failed.largest_size);
+
+#ifdef CONFIG_COMMON_LIBC_MALLOC
+	struct sys_memory_stats stats;
+
+	if (!malloc_runtime_stats_get(&stats)) {
+		shell_print(shell, "heap free: %zu B, allocated: %zu B, peak allocated: %zu B",
+			    stats.free_bytes, stats.allocated_bytes, stats.max_allocated_bytes);
+		shell_print(shell, "largest allocatable block: %zu B (probed)",
+			    largest_free_block_probe(stats.free_bytes));
+	}
+#endif // CONFIG_COMMON_LIBC_MALLOC
+	return 0;
+}
+
+static int cmd_stats_heap_reset(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)shell;
+	(void)argc;
+	(void)argv;
+
+	for (anjay_iid_t iid = 0; iid <= IID_TOTAL; iid++) {
+		peak_reset(iid);
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((stats), heap, NULL,
+		 "Show heap usage per subsystem, failed allocations and the largest "
+		 "allocatable block",
+		 cmd_stats_heap, 1, 0);
+SHELL_SUBCMD_ADD((stats), heap_reset, NULL, "Reset the peak heap usage", cmd_stats_heap_reset, 1,
+		 0);
+#endif // CONFIG_SHELL
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <anjay/dm.h>
+
+/*
+ * The application defines its tags in heap_tags.h, as HEAP_TAGS(X) expanding
+ * to X(Name, "label") for each of them. Tag Name is then HEAP_TAG_Name and
+ * "label" is its name in the shell and the Heap Statistics object.
+ */
+#include "heap_tags.h"
+
+enum heap_tag {
+	// allocations outside of any HEAP_STATS_TAG() block, mostly Anjay itself
+	HEAP_TAG_OTHER,
+#define HEAP_TAG_ENUM(Name, Label) HEAP_TAG_##Name,
+	HEAP_TAGS(HEAP_TAG_ENUM)
+#undef HEAP_TAG_ENUM
+	_HEAP_TAG_COUNT
+};
+
+#ifdef CONFIG_APP_HEAP_STATS
+enum heap_tag heap_stats_tag_push(enum heap_tag tag);
+void heap_stats_tag_pop(enum heap_tag previous);
+
+/**
+ * Registers the Heap Statistics object, with one instance per tag and one for
+ * the whole heap.
+ */
+int heap_stats_object_install(anjay_t *anjay);
+
+/**
+ * Attributes the avs_malloc() family calls made by the current thread in the
+ * statement or block that follows to @p Tag. Leaving that block with return,
+ * break or goto leaves the tag set. Only one thread at a time is expected to
+ * use tags.
+ */
+#define HEAP_STATS_TAG(Tag)                                                                        \
+	for (int _heap_tag_previous = heap_stats_tag_push(Tag), _heap_tag_exit = 0;                \
+	     !_heap_tag_exit; _heap_tag_exit = 1, heap_stats_tag_pop(_heap_tag_previous))
+#else // CONFIG_APP_HEAP_STATS
+#define HEAP_STATS_TAG(Tag)
+#endif // CONFIG_APP_HEAP_STATS
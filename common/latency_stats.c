@@ -0,0 +1,327 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include <anjay/anjay.h>
+
+#include "latency_stats.h"
+
+/*
+ * Histogram bucket 0 counts calls that took less than 1 us and bucket i counts
+ * calls that took [2^(i-1), 2^i) us. The last bucket also counts everything
+ * longer than that.
+ */
+#define LATENCY_STATS_BUCKETS 20
+
+/**
+ * Latency Statistics: custom object in the private range, one instance per
+ * probe
+ */
+#define OID_LATENCY_STATS 26241
+
+/**
+ * Probe Name: R, Single, Mandatory
+ * type: string, range: N/A, unit: N/A
+ * Name of the measured callback.
+ */
+#define RID_PROBE_NAME 0
+
+/**
+ * Call Count: R, Single, Mandatory
+ * type: integer, range: N/A, unit: N/A
+ * Number of calls measured since the last reset.
+ */
+#define RID_CALL_COUNT 1
+
+/**
+ * Min Latency: R, Single, Mandatory
+ * type: integer, range: N/A, unit: us
+ * Shortest measured call.
+ */
+#define RID_MIN_LATENCY 2
+
+/**
+ * Max Latency: R, Single, Mandatory
+ * type: integer, range: N/A, unit: us
+ * Longest measured call.
+ */
+#define RID_MAX_LATENCY 3
+
+/**
+ * Mean Latency: R, Single, Mandatory
+ * type: integer, range: N/A, unit: us
+ * Mean duration of the measured calls.
+ */
+#define RID_MEAN_LATENCY 4
+
+/**
+ * Latency Histogram: R, Multiple, Mandatory
+ * type: integer, range: N/A, unit: N/A
+ * Number of calls per log2 duration bucket. Instance 0 counts calls shorter
+ * than 1 us and instance i calls that took from 2^(i-1) to 2^i us.
+ */
+#define RID_LATENCY_HISTOGRAM 5
+
+/**
+ * Reset Statistics: E, Single, Mandatory
+ * type: N/A, range: N/A, unit: N/A
+ * Resets the statistics of this probe.
+ */
+#define RID_RESET_STATISTICS 6
+
+struct latency_histogram {
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us;
+	uint32_t buckets[LATENCY_STATS_BUCKETS];
+};
+
+static const char *const probe_names[] = {
+#define LATENCY_PROBE_NAME(Name, Label) [LATENCY_PROBE_##Name] = Label,
+	LATENCY_PROBES(LATENCY_PROBE_NAME)
+#undef LATENCY_PROBE_NAME
+};
+
+BUILD_ASSERT(ARRAY_SIZE(probe_names) == _LATENCY_PROBE_COUNT);
+
+static struct latency_histogram histograms[_LATENCY_PROBE_COUNT];
+static struct k_spinlock histograms_lock;
+
+static struct latency_histogram histogram_get(enum latency_probe probe)
+{
+	struct latency_histogram result;
+	k_spinlock_key_t key = k_spin_lock(&histograms_lock);
+
+	result = histograms[probe];
+	k_spin_unlock(&histograms_lock, key);
+	return result;
+}
+
+static uint32_t histogram_mean_us(const struct latency_histogram *histogram)
+{
+	return histogram->count ? (uint32_t)(histogram->total_us / histogram->count) : 0;
+}
+
+void latency_stats_record(enum latency_probe probe, uint32_t start_cycles)
+{
+	// unsigned subtraction is correct across a single wrap of the cycle counter
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start_cycles);
+	size_t bucket = us ? 32 - __builtin_clz(us) : 0;
+
+	if (bucket >= LATENCY_STATS_BUCKETS) {
+		bucket = LATENCY_STATS_BUCKETS - 1;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&histograms_lock);
+	struct latency_histogram *histogram = &histograms[probe];
+
+	if (!histogram->count || us < histogram->min_us) {
+		histogram->min_us = us;
+	}
+	if (us > histogram->max_us) {
+		histogram->max_us = us;
+	}
+	histogram->count++;
+	histogram->total_us += us;
+	histogram->buckets[bucket]++;
+	k_spin_unlock(&histograms_lock, key);
+}
+
+void latency_stats_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&histograms_lock);
+
+	memset(histograms, 0, sizeof(histograms));
+	k_spin_unlock(&histograms_lock, key);
+}
+
+static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	for (anjay_iid_t iid = 0; iid < _LATENCY_PROBE_COUNT; iid++) {
+		anjay_dm_emit(ctx, iid);
+	}
+	return 0;
+}
+
+static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+
+	anjay_dm_emit_res(ctx, RID_PROBE_NAME, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_CALL_COUNT, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_MIN_LATENCY, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_MAX_LATENCY, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_MEAN_LATENCY, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_LATENCY_HISTOGRAM, ANJAY_DM_RES_RM, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_RESET_STATISTICS, ANJAY_DM_RES_E, ANJAY_DM_RES_PRESENT);
+	return 0;
+}
+
+static int list_resource_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+				   anjay_iid_t iid, anjay_rid_t rid, anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+
+	switch (rid) {
+	case RID_LATENCY_HISTOGRAM:
+		for (anjay_riid_t riid = 0; riid < LATENCY_STATS_BUCKETS; riid++) {
+			anjay_dm_emit(ctx, riid);
+		}
+		return 0;
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			 anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	assert(iid < _LATENCY_PROBE_COUNT);
+	struct latency_histogram histogram = histogram_get((enum latency_probe)iid);
+
+	switch (rid) {
+	case RID_PROBE_NAME:
+		assert(riid == ANJAY_ID_INVALID);
+		return anjay_ret_string(ctx, probe_names[iid]);
+
+	case RID_CALL_COUNT:
+		assert(riid == ANJAY_ID_INVALID);
+		return anjay_ret_i64(ctx, histogram.count);
+
+	case RID_MIN_LATENCY:
+		assert(riid == ANJAY_ID_INVALID);
+		return anjay_ret_i64(ctx, histogram.min_us);
+
+	case RID_MAX_LATENCY:
+		assert(riid == ANJAY_ID_INVALID);
+		return anjay_ret_i64(ctx, histogram.max_us);
+
+	case RID_MEAN_LATENCY:
+		assert(riid == ANJAY_ID_INVALID);
+		return anjay_ret_i64(ctx, histogram_mean_us(&histogram));
+
+	case RID_LATENCY_HISTOGRAM:
+		assert(riid < LATENCY_STATS_BUCKETS);
+		return anjay_ret_i64(ctx, histogram.buckets[riid]);
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static int resource_execute(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_iid_t iid, anjay_rid_t rid, anjay_execute_ctx_t *arg_ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)arg_ctx;
+
+	assert(iid < _LATENCY_PROBE_COUNT);
+
+	switch (rid) {
+	case RID_RESET_STATISTICS: {
+		k_spinlock_key_t key = k_spin_lock(&histograms_lock);
+
+		memset(&histograms[iid], 0, sizeof(histograms[iid]));
+		k_spin_unlock(&histograms_lock, key);
+		return 0;
+	}
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = OID_LATENCY_STATS,
+	.handlers = { .list_instances = list_instances,
+
+		      .list_resources = list_resources,
+		      .list_resource_instances = list_resource_instances,
+		      .resource_read = resource_read,
+		      .resource_execute = resource_execute }
+};
+
+static const anjay_dm_object_def_t *const OBJ_DEF_PTR = &OBJ_DEF;
+
+int latency_stats_object_install(anjay_t *anjay)
+{
+	return anjay_register_object(anjay, &OBJ_DEF_PTR);
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_stats_latency(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	shell_print(shell, "%-20s %10s %10s %10s %10s", "probe", "count", "min [us]", "max [us]",
+		    "mean [us]");
+	for (int i = 0; i < _LATENCY_PROBE_COUNT; i++) {
+		struct latency_histogram histogram = histogram_get((enum latency_probe)i);
+
+		shell_print(shell, "%-20s %10u %10u %10u %10u", probe_names[i], histogram.count,
+			    histogram.min_us, histogram.max_us,
+			    histogram_mean_us(&histogram));
+		for (int bucket = 0; bucket < LATENCY_STATS_BUCKETS - 1; bucket++) {
+			if (histogram.buckets[bucket]) {
+				shell_print(shell, "   < %8lu us: %u", 1UL << bucket,
+					    histogram.buckets[bucket]);
+			}
+		}
+		if (histogram.buckets[LATENCY_STATS_BUCKETS - 1]) {
+			shell_print(shell, "  >= %8lu us: %u", 1UL << (LATENCY_STATS_BUCKETS - 2),
+				    histogram.buckets[LATENCY_STATS_BUCKETS - 1]);
+		}
+	}
+	return 0;
+}
+
+static int cmd_stats_latency_reset(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)shell;
+	(void)argc;
+	(void)argv;
+
+	latency_stats_reset();
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((stats), latency, NULL, "Show latency histograms of the instrumented callbacks",
+		 cmd_stats_latency, 1, 0);
+SHELL_SUBCMD_ADD((stats), latency_reset, NULL, "Reset the latency histograms",
+		 cmd_stats_latency_reset, 1, 0);
+#endif // CONFIG_SHELL
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include <anjay/dm.h>
+
+/*
+ * The application defines its probes in latency_probes.h, as
+ * LATENCY_PROBES(X) expanding to X(Name, "label") for each of them. Probe
+ * Name is then LATENCY_PROBE_Name and "label" is its name in the shell and
+ * the Latency Statistics object.
+ */
+#include "latency_probes.h"
+
+enum latency_probe {
+#define LATENCY_PROBE_ENUM(Name, Label) LATENCY_PROBE_##Name,
+	LATENCY_PROBES(LATENCY_PROBE_ENUM)
+#undef LATENCY_PROBE_ENUM
+	_LATENCY_PROBE_COUNT
+};
+
+#ifdef CONFIG_APP_LATENCY_STATS
+void latency_stats_record(enum latency_probe probe, uint32_t start_cycles);
+void latency_stats_reset(void);
+
+/**
+ * Registers the Latency Statistics object, with one instance per probe.
+ */
+int latency_stats_object_install(anjay_t *anjay);
+
+/**
+ * Records the time spent in the statement or block that follows under
+ * @p Probe. Leaving that block with return, break or goto skips the record.
+ */
+#define LATENCY_MEASURE(Probe)                                                                     \
+	for (uint32_t _latency_start = k_cycle_get_32(), _latency_exit = 0; !_latency_exit;        \
+	     _latency_exit = 1, latency_stats_record((Probe), _latency_start))
+#else // CONFIG_APP_LATENCY_STATS
+#define LATENCY_MEASURE(Probe)
+#endif // CONFIG_APP_LATENCY_STATS
@@ -0,0 +1,22 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr/shell/shell.h>
+
+// subcommands are added with SHELL_SUBCMD_ADD((stats), ...) by the statistics modules
+SHELL_SUBCMD_SET_CREATE(sub_stats, (stats));
+
+SHELL_CMD_REGISTER(stats, &sub_stats, "Runtime statistics commands", NULL);
@@ -0,0 +1,27 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <zephyr/kernel.h>
+
+/**
+ * Runs the statement or block that follows with the k_mutex @p Mtx locked.
+ * Leaving that block with return, break or goto leaves the mutex locked.
+ */
+#define SYNCHRONIZED(Mtx)                                                                          \
+	for (int _synchronized_exit = k_mutex_lock(&(Mtx), K_FOREVER); !_synchronized_exit;        \
+	     _synchronized_exit = -1, k_mutex_unlock(&(Mtx)))
@@ -0,0 +1,306 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "peripherals.h"
+
+#if BUZZER_AVAILABLE
+
+#include <assert.h>
+#include <stdbool.h>
+
+#include <zephyr/drivers/pwm.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <anjay/anjay.h>
+
+#include "buzzer.h"
+#include "object_refresh.h"
+
+LOG_MODULE_REGISTER(buzzer);
+
+#define OID_BUZZER 3338
+
+/**
+ * On/Off: RW, Single, Mandatory
+ * type: boolean, range: N/A, unit: N/A
+ * On/off control. Boolean value where True is On and False is Off.
+ */
+#define RID_ON_OFF 5850
+
+/**
+ * Delay Duration: RW, Single, Optional
+ * type: float, range: N/A, unit: s
+ * The duration of the time delay.
+ */
+#define RID_DELAY_DURATION 5521
+
+/**
+ * Minimum Off-time: RW, Single, Mandatory
+ * type: float, range: N/A, unit: s
+ * The duration of the time in which the buzzer is off after having been on.
+ */
+#define RID_MINIMAL_OFF_TIME 5525
+
+#define BUZZER_DEFAULT_DELAY_DURATION_S 1.0
+
+/*
+ * The buzzer is switched on from the Anjay thread, and off from the system
+ * workqueue once its Delay Duration expires, or once the Minimum Off-time has
+ * passed if it was requested while that was still running. The Anjay thread
+ * is asked to notify the change only when the buzzer went off on its own.
+ */
+struct buzzer_state {
+	bool requested;
+	bool sounding;
+	bool reported;
+	double delay_duration;
+	double min_off_time;
+	int64_t off_since_ms;
+};
+
+// the channel, period (i.e. the tone) and polarity come from the pwms property
+static const struct pwm_dt_spec buzzer_pwm = PWM_DT_SPEC_GET(BUZZER_NODE);
+
+static K_MUTEX_DEFINE(buzzer_mutex);
+static struct buzzer_state buzzer = { .delay_duration = BUZZER_DEFAULT_DELAY_DURATION_S };
+
+static void buzzer_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(buzzer_work, buzzer_work_handler);
+
+static k_timeout_t seconds_to_timeout(double seconds)
+{
+	return K_MSEC((int64_t)(seconds * MSEC_PER_SEC));
+}
+
+static void buzzer_pwm_set(bool on)
+{
+	if (pwm_set_dt(&buzzer_pwm, buzzer_pwm.period, on ? buzzer_pwm.period / 2 : 0)) {
+		LOG_ERR("Could not switch the buzzer %s", on ? "on" : "off");
+	}
+}
+
+static void buzzer_start(void)
+{
+	buzzer_pwm_set(true);
+	buzzer.sounding = true;
+	if (buzzer.delay_duration > 0.0) {
+		k_work_reschedule(&buzzer_work, seconds_to_timeout(buzzer.delay_duration));
+	} else {
+		k_work_cancel_delayable(&buzzer_work);
+	}
+}
+
+static void buzzer_stop(void)
+{
+	if (buzzer.sounding) {
+		buzzer_pwm_set(false);
+		buzzer.sounding = false;
+		buzzer.off_since_ms = k_uptime_get();
+	}
+	k_work_cancel_delayable(&buzzer_work);
+}
+
+static void buzzer_request(bool on)
+{
+	buzzer.requested = on;
+	if (!on) {
+		buzzer_stop();
+		return;
+	}
+	if (buzzer.sounding) {
+		// a repeated On restarts the delay
+		buzzer_start();
+		return;
+	}
+
+	int64_t off_ms = k_uptime_get() - buzzer.off_since_ms;
+	int64_t min_off_ms = (int64_t)(buzzer.min_off_time * MSEC_PER_SEC);
+
+	if (buzzer.off_since_ms && off_ms < min_off_ms) {
+		k_work_reschedule(&buzzer_work, K_MSEC(min_off_ms - off_ms));
+	} else {
+		buzzer_start();
+	}
+}
+
+static void buzzer_work_handler(struct k_work *work)
+{
+	(void)work;
+	bool expired = false;
+
+	k_mutex_lock(&buzzer_mutex, K_FOREVER);
+	if (buzzer.sounding) {
+		buzzer.requested = false;
+		buzzer_stop();
+		expired = true;
+	} else if (buzzer.requested) {
+		buzzer_start();
+	}
+	k_mutex_unlock(&buzzer_mutex);
+
+	if (expired) {
+		object_refresh_request(OBJECT_REFRESH_BUZZER);
+	}
+}
+
+static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+
+	anjay_dm_emit_res(ctx, RID_ON_OFF, ANJAY_DM_RES_RW, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_DELAY_DURATION, ANJAY_DM_RES_RW, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_MINIMAL_OFF_TIME, ANJAY_DM_RES_RW, ANJAY_DM_RES_PRESENT);
+	return 0;
+}
+
+static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			 anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+	(void)riid;
+
+	assert(riid == ANJAY_ID_INVALID);
+	int result;
+
+	k_mutex_lock(&buzzer_mutex, K_FOREVER);
+	switch (rid) {
+	case RID_ON_OFF:
+		buzzer.reported = buzzer.requested;
+		result = anjay_ret_bool(ctx, buzzer.requested);
+		break;
+
+	case RID_DELAY_DURATION:
+		result = anjay_ret_double(ctx, buzzer.delay_duration);
+		break;
+
+	case RID_MINIMAL_OFF_TIME:
+		result = anjay_ret_double(ctx, buzzer.min_off_time);
+		break;
+
+	default:
+		result = ANJAY_ERR_METHOD_NOT_ALLOWED;
+		break;
+	}
+	k_mutex_unlock(&buzzer_mutex);
+
+	return result;
+}
+
+static int resource_write(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			  anjay_input_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+	(void)riid;
+
+	assert(riid == ANJAY_ID_INVALID);
+	int result;
+
+	switch (rid) {
+	case RID_ON_OFF: {
+		bool on;
+
+		if ((result = anjay_get_bool(ctx, &on))) {
+			return result;
+		}
+		k_mutex_lock(&buzzer_mutex, K_FOREVER);
+		buzzer_request(on);
+		k_mutex_unlock(&buzzer_mutex);
+		return 0;
+	}
+
+	case RID_DELAY_DURATION:
+	case RID_MINIMAL_OFF_TIME: {
+		double value;
+
+		if ((result = anjay_get_double(ctx, &value))) {
+			return result;
+		}
+		if (!(value >= 0.0)) {
+			return ANJAY_ERR_BAD_REQUEST;
+		}
+		k_mutex_lock(&buzzer_mutex, K_FOREVER);
+		if (rid == RID_DELAY_DURATION) {
+			buzzer.delay_duration = value;
+		} else {
+			buzzer.min_off_time = value;
+		}
+		k_mutex_unlock(&buzzer_mutex);
+		return 0;
+	}
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = OID_BUZZER,
+	.handlers = { .list_instances = anjay_dm_list_instances_SINGLE,
+
+		      .list_resources = list_resources,
+		      .resource_read = resource_read,
+		      .resource_write = resource_write,
+
+		      .transaction_begin = anjay_dm_transaction_NOOP,
+		      .transaction_validate = anjay_dm_transaction_NOOP,
+		      .transaction_commit = anjay_dm_transaction_NOOP,
+		      .transaction_rollback = anjay_dm_transaction_NOOP }
+};
+
+static const anjay_dm_object_def_t *const OBJ_DEF_PTR = &OBJ_DEF;
+
+int buzzer_object_install(anjay_t *anjay)
+{
+	if (!pwm_is_ready_dt(&buzzer_pwm)) {
+		LOG_ERR("Buzzer PWM not ready");
+		return -1;
+	}
+	return anjay_register_object(anjay, &OBJ_DEF_PTR);
+}
+
+void buzzer_object_update(anjay_t *anjay)
+{
+	bool changed;
+
+	k_mutex_lock(&buzzer_mutex, K_FOREVER);
+	changed = (buzzer.reported != buzzer.requested);
+	k_mutex_unlock(&buzzer_mutex);
+
+	if (changed) {
+		anjay_notify_changed(anjay, OID_BUZZER, 0, RID_ON_OFF);
+	}
+}
+
+void buzzer_object_release(void)
+{
+	k_mutex_lock(&buzzer_mutex, K_FOREVER);
+	buzzer.requested = false;
+	buzzer.reported = false;
+	buzzer_stop();
+	k_mutex_unlock(&buzzer_mutex);
+}
+#endif // BUZZER_AVAILABLE
@@ -0,0 +1,38 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <anjay/anjay.h>
+
+/**
+ * Installs the Buzzer object (/3338) driving the PWM given by the pwms property
+ * of the node with the buzzer_pwm devicetree alias. The buzzer is switched off
+ * by a timer when its Delay Duration expires, so the object needs no periodic
+ * refresh.
+ */
+int buzzer_object_install(anjay_t *anjay);
+
+/**
+ * Notifies the LwM2M Server if the buzzer switched itself off. Called from the
+ * Anjay thread after @ref OBJECT_REFRESH_BUZZER has been requested.
+ */
+void buzzer_object_update(anjay_t *anjay);
+
+/**
+ * Silences the buzzer and cancels its timer.
+ */
+void buzzer_object_release(void);
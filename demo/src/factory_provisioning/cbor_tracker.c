@@ -0,0 +1,160 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "cbor_tracker.h"
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NEGATIVE_INT 1
+#define CBOR_MAJOR_BYTE_STRING 2
+#define CBOR_MAJOR_TEXT_STRING 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_TAG 6
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_ADDITIONAL_INFO_1_BYTE 24
+#define CBOR_ADDITIONAL_INFO_8_BYTES 27
+#define CBOR_ADDITIONAL_INFO_INDEFINITE 31
+#define CBOR_BREAK 0xFF
+
+#define INDEFINITE UINT64_MAX
+
+void cbor_tracker_init(struct cbor_tracker *tracker)
+{
+	memset(tracker, 0, sizeof(*tracker));
+	tracker->state = CBOR_TRACKER_IN_PROGRESS;
+}
+
+static void item_done(struct cbor_tracker *tracker)
+{
+	while (tracker->depth) {
+		uint64_t *remaining = &tracker->remaining[tracker->depth - 1];
+
+		if (*remaining == INDEFINITE || --*remaining) {
+			return;
+		}
+		// the container is complete, and is an item of its parent
+		tracker->depth--;
+	}
+	tracker->state = CBOR_TRACKER_COMPLETE;
+}
+
+static void container_open(struct cbor_tracker *tracker, uint64_t items)
+{
+	if (tracker->depth == CBOR_TRACKER_MAX_DEPTH) {
+		tracker->state = CBOR_TRACKER_ERROR;
+		return;
+	}
+	tracker->remaining[tracker->depth++] = items;
+}
+
+static void header_complete(struct cbor_tracker *tracker)
+{
+	uint64_t argument = tracker->argument;
+
+	switch (tracker->major_type) {
+	case CBOR_MAJOR_BYTE_STRING:
+	case CBOR_MAJOR_TEXT_STRING:
+		if (argument) {
+			tracker->payload_bytes = argument;
+		} else {
+			item_done(tracker);
+		}
+		break;
+	case CBOR_MAJOR_ARRAY:
+	case CBOR_MAJOR_MAP:
+		if (tracker->major_type == CBOR_MAJOR_MAP) {
+			if (argument > INDEFINITE / 2 - 1) {
+				tracker->state = CBOR_TRACKER_ERROR;
+				return;
+			}
+			argument *= 2;
+		} else if (argument == INDEFINITE) {
+			tracker->state = CBOR_TRACKER_ERROR;
+			return;
+		}
+		if (argument) {
+			container_open(tracker, argument);
+		} else {
+			item_done(tracker);
+		}
+		break;
+	case CBOR_MAJOR_TAG:
+		// the tag and the item that follows count as one
+		break;
+	default:
+		item_done(tracker);
+		break;
+	}
+}
+
+static void initial_byte(struct cbor_tracker *tracker, uint8_t byte)
+{
+	uint8_t additional_info = byte & 0x1F;
+
+	tracker->major_type = byte >> 5;
+	tracker->argument = 0;
+
+	if (byte == CBOR_BREAK) {
+		if (!tracker->depth || tracker->remaining[tracker->depth - 1] != INDEFINITE) {
+			tracker->state = CBOR_TRACKER_ERROR;
+			return;
+		}
+		tracker->depth--;
+		item_done(tracker);
+	} else if (additional_info < CBOR_ADDITIONAL_INFO_1_BYTE) {
+		tracker->argument = additional_info;
+		header_complete(tracker);
+	} else if (additional_info <= CBOR_ADDITIONAL_INFO_8_BYTES) {
+		tracker->argument_bytes = 1 << (additional_info - CBOR_ADDITIONAL_INFO_1_BYTE);
+	} else if (additional_info == CBOR_ADDITIONAL_INFO_INDEFINITE &&
+		   tracker->major_type >= CBOR_MAJOR_BYTE_STRING &&
+		   tracker->major_type <= CBOR_MAJOR_MAP) {
+		// chunks of an indefinite-length string are counted as items
+		container_open(tracker, INDEFINITE);
+	} else {
+		tracker->state = CBOR_TRACKER_ERROR;
+	}
+}
+
+size_t cbor_tracker_feed(struct cbor_tracker *tracker, const uint8_t *data, size_t length)
+{
+	size_t consumed = 0;
+
+	while (consumed < length && tracker->state == CBOR_TRACKER_IN_PROGRESS) {
+		if (tracker->payload_bytes) {
+			size_t skipped = (size_t)(tracker->payload_bytes < length - consumed ?
+							  tracker->payload_bytes :
+							  length - consumed);
+
+			consumed += skipped;
+			tracker->payload_bytes -= skipped;
+			if (!tracker->payload_bytes) {
+				item_done(tracker);
+			}
+		} else if (tracker->argument_bytes) {
+			tracker->argument = tracker->argument << 8 | data[consumed++];
+			if (!--tracker->argument_bytes) {
+				header_complete(tracker);
+			}
+		} else {
+			initial_byte(tracker, data[consumed++]);
+		}
+	}
+	return consumed;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* SenML CBOR nests maps in an array, the rest is for tags and such */
+#define CBOR_TRACKER_MAX_DEPTH 8
+
+enum cbor_tracker_state {
+	CBOR_TRACKER_IN_PROGRESS,
+	// the first top-level data item is complete
+	CBOR_TRACKER_COMPLETE,
+	// not well-formed CBOR, or nested too deeply
+	CBOR_TRACKER_ERROR
+};
+
+/**
+ * Follows the structure of a CBOR stream, without decoding any values, to
+ * find where its first top-level data item ends. This lets a stream that has
+ * no other means of signalling EOF end as soon as the last byte of the item
+ * arrives.
+ */
+struct cbor_tracker {
+	enum cbor_tracker_state state;
+	// data items left in each open container, or UINT64_MAX until a break
+	uint64_t remaining[CBOR_TRACKER_MAX_DEPTH];
+	uint8_t depth;
+	// of the item whose argument is being read
+	uint8_t major_type;
+	uint8_t argument_bytes;
+	uint64_t argument;
+	// of a byte or text string
+	uint64_t payload_bytes;
+};
+
+void cbor_tracker_init(struct cbor_tracker *tracker);
+
+/**
+ * Feeds the next @p length bytes of the stream to @p tracker. Stops at the
+ * byte that completes the top-level item or makes the stream invalid.
+ *
+ * @returns number of bytes consumed
+ */
+size_t cbor_tracker_feed(struct cbor_tracker *tracker, const uint8_t *data, size_t length);
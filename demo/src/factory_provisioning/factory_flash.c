@@ -28,6 +28,7 @@
 
 #include <anjay_zephyr/config.h>
 
+#include "cbor_tracker.h"
 #include "factory_flash.h"
 
 /*
@@ -65,12 +66,15 @@
  *    - close - it's not implemented, so it's a no-op
  *    - go back to provision_fs_open() again, and repeat until the whole file is
  *      transferred
- * 3. Controlled by factory_flash_mutex and factory_flash_condvar, the data
- *    written through these write operations is passed as the stream read by
- *    anjay_factory_provision().
+ * 3. Controlled by factory_flash_mutex and factory_flash_condvar, the buffer
+ *    passed to each of these write operations is handed over to the stream
+ *    read by anjay_factory_provision(), which copies the data straight from
+ *    it. provision_fs_write() returns once all of it has been read.
  * 4. Unfortunately, mcumgr API does not inform the file system driver in any
- *    way whether EOF has been reached. For that reason, we wait either for
- *    timeout or for opening the result file.
+ *    way whether EOF has been reached. For that reason, the stream follows the
+ *    structure of the CBOR data and ends right after the top-level data item.
+ *    For a truncated file, we wait either for timeout or for opening the
+ *    result file.
  * 5. mcumgr starts reading the /factory/result.txt file. This will call:
  *    - provision_fs_stat() - this needs to success for the read operation to
  *      succeed; we need to know the file size at this point, so this operation
@@ -84,11 +88,11 @@
  *      transferred
  */
 
-// circular buffer
-static char received_data[512];
-static size_t received_data_start;
-static size_t received_data_length;
+// part of the buffer of the pending provision_fs_write() call not read yet
+static const char *pending_data;
+static size_t pending_data_length;
 static size_t received_data_total;
+static struct cbor_tracker received_data_tracker;
 
 static enum {
 	FACTORY_FLASH_INITIAL,
@@ -117,7 +121,7 @@ static struct provision_fs_file_info {
 	[EP_FILE] = { .name = PROVISION_FS_MOUNT_POINT "/endpoint.txt" },
 };
 
-// 15 seconds of inactivity is treated as EOF
+// 15 seconds of inactivity is treated as EOF of a truncated file
 #define PROVISION_FS_UPLOAD_TIMEOUT_MS 15000
 
 static int provision_fs_open(struct fs_file_t *filp, const char *fs_path, fs_mode_t flags)
@@ -183,36 +187,24 @@ static ssize_t provision_fs_write(struct fs_file_t *filp, const void *src, size_
 		return 0;
 	}
 
-	if (nbytes > sizeof(received_data)) {
-		return -ENOSPC;
-	}
-
 	int result = k_mutex_lock(&factory_flash_mutex, K_FOREVER);
 
 	if (result) {
 		return result;
 	}
 
-	const char *src_ptr = (const char *)src;
-	const char *const src_end = src_ptr + nbytes;
-
-	while (src_ptr < src_end) {
-		size_t write_start =
-			(received_data_start + received_data_length) % sizeof(received_data);
-		size_t immediate_size = AVS_MIN(
-			AVS_MIN(sizeof(received_data) - received_data_length, src_end - src_ptr),
-			sizeof(received_data) - write_start);
+	pending_data = (const char *)src;
+	pending_data_length = nbytes;
+	received_data_total += nbytes;
+	k_condvar_broadcast(&factory_flash_condvar);
 
-		if (!immediate_size) {
-			k_condvar_wait(&factory_flash_condvar, &factory_flash_mutex, K_FOREVER);
-		} else {
-			memcpy(received_data + write_start, src_ptr, immediate_size);
-			received_data_length += immediate_size;
-			received_data_total += immediate_size;
-			src_ptr += immediate_size;
-			k_condvar_broadcast(&factory_flash_condvar);
-		}
+	// if the reader has already given up, e.g. on invalid data, the rest is
+	// dropped, and the error is reported through the result file
+	while (pending_data_length && factory_flash_state != FACTORY_FLASH_FINISHED) {
+		k_condvar_wait(&factory_flash_condvar, &factory_flash_mutex, K_FOREVER);
 	}
+	pending_data = NULL;
+	pending_data_length = 0;
 
 	k_mutex_unlock(&factory_flash_mutex);
 
@@ -335,21 +327,40 @@ static avs_error_t provision_stream_read(avs_stream_t *stream, size_t *out_bytes
 		timeout = K_TIMEOUT_ABS_MS(uptime + PROVISION_FS_UPLOAD_TIMEOUT_MS);
 	}
 
-	while (!received_data_length && factory_flash_state == FACTORY_FLASH_INITIAL &&
+	while (!pending_data_length && factory_flash_state == FACTORY_FLASH_INITIAL &&
 	       (K_TIMEOUT_EQ(timeout, K_FOREVER) || k_uptime_ticks() < Z_TICK_ABS(timeout.ticks))) {
 		k_condvar_wait(&factory_flash_condvar, &factory_flash_mutex, timeout);
 	}
 
-	*out_bytes_read = AVS_MIN(AVS_MIN(received_data_length, buffer_length),
-				  sizeof(received_data) - received_data_start);
-	memcpy(buffer, received_data + received_data_start, *out_bytes_read);
-	received_data_start = (received_data_start + *out_bytes_read) % sizeof(received_data);
-	received_data_length -= *out_bytes_read;
+	bool data_pending = (pending_data_length > 0);
+
+	*out_bytes_read = cbor_tracker_feed(&received_data_tracker, (const uint8_t *)pending_data,
+					    AVS_MIN(pending_data_length, buffer_length));
+	if (*out_bytes_read) {
+		memcpy(buffer, pending_data, *out_bytes_read);
+		pending_data += *out_bytes_read;
+		pending_data_length -= *out_bytes_read;
+	}
+
+	// also if the data is not valid CBOR, which is then up to the parser to report
+	bool data_complete = (received_data_tracker.state != CBOR_TRACKER_IN_PROGRESS);
+
+	if (data_complete) {
+		if (factory_flash_state == FACTORY_FLASH_INITIAL) {
+			factory_flash_state = FACTORY_FLASH_EOF;
+		}
+		// anything after the data item is dropped
+		pending_data_length = 0;
+	}
+	if (data_pending && !pending_data_length) {
+		// release the writer
+		k_condvar_broadcast(&factory_flash_condvar);
+	}
 
 	k_mutex_unlock(&factory_flash_mutex);
 
 	if (out_message_finished) {
-		*out_message_finished = (*out_bytes_read == 0);
+		*out_message_finished = (*out_bytes_read == 0 || data_complete);
 	}
 
 	return AVS_OK;
@@ -367,6 +378,8 @@ avs_stream_t *factory_flash_input_stream_init(void)
 		return NULL;
 	}
 
+	cbor_tracker_init(&received_data_tracker);
+
 	return (avs_stream_t *)&provision_stream;
 }
 
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// probes of the Latency Statistics object, see latency_stats.h
+#define LATENCY_PROBES(X)                                                                          \
+	X(LWM2M_CALLBACK, "lwm2m_callback")                                                        \
+	/* one probe per object refresh source, in the order of enum object_refresh_source */      \
+	X(REFRESH_SWITCH, "refresh_switch")                                                        \
+	X(REFRESH_BUZZER, "refresh_buzzer")                                                        \
+	X(REFRESH_SENSORS, "refresh_sensors")                                                      \
+	X(REFRESH_LOCATION, "refresh_location")                                                    \
+	X(REFRESH_TELEMETRY, "refresh_telemetry")                                                  \
+	X(REFRESH_SENSOR_STATS, "refresh_sensor_stats")
+
+#define LATENCY_PROBE_REFRESH(Source)                                                              \
+	((enum latency_probe)(LATENCY_PROBE_REFRESH_SWITCH + (int)(Source)))
@@ -0,0 +1,526 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#ifdef CONFIG_APP_LOCATION_NMEA_UART
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/ring_buffer.h>
+#endif // CONFIG_APP_LOCATION_NMEA_UART
+
+#ifdef CONFIG_ARCH_POSIX
+#include <native_rtc.h>
+#endif // CONFIG_ARCH_POSIX
+
+#include <anjay/anjay.h>
+
+#include "location.h"
+#include "nmea.h"
+#include "object_refresh.h"
+#include "telemetry.h"
+
+LOG_MODULE_REGISTER(location);
+
+#define OID_LOCATION 6
+
+/**
+ * Latitude: R, Single, Mandatory
+ * type: float, range: N/A, unit: deg
+ * The decimal notation of latitude, e.g. -43.5723 [World Geodetic System 1984].
+ */
+#define RID_LATITUDE 0
+
+/**
+ * Longitude: R, Single, Mandatory
+ * type: float, range: N/A, unit: deg
+ * The decimal notation of longitude, e.g. 153.21760 [World Geodetic System 1984].
+ */
+#define RID_LONGITUDE 1
+
+/**
+ * Altitude: R, Single, Optional
+ * type: float, range: N/A, unit: m
+ * The decimal notation of altitude in meters above sea level.
+ */
+#define RID_ALTITUDE 2
+
+/**
+ * Radius: R, Single, Optional
+ * type: float, range: N/A, unit: m
+ * The value in this resource indicates the radius of a circular area in
+ * meters. The circular area is used to describe uncertainty about a point for
+ * coordinates in a two-dimensional coordinate reference systems (CRS).
+ */
+#define RID_RADIUS 3
+
+/**
+ * Timestamp: R, Single, Mandatory
+ * type: time, range: N/A, unit: N/A
+ * The timestamp of when the location measurement was performed.
+ */
+#define RID_TIMESTAMP 5
+
+/**
+ * Speed: R, Single, Optional
+ * type: float, range: N/A, unit: m/s
+ * Speed is the time rate of change in position.
+ */
+#define RID_SPEED 6
+
+/* the Radius is HDOP times this user equivalent range error */
+#define UERE_M 5.0f
+
+/* mean Earth radius * pi / 180 / 1e7 */
+#define DEG_E7_TO_M 0.011119508f
+#define DEG_E7_TO_RAD 1.7453293e-9f
+
+#define LOCATION_MAX_INTERVAL_MS (CONFIG_APP_LOCATION_MAX_INTERVAL_S * INT64_C(1000))
+
+static struct k_thread pipeline_thread;
+static K_THREAD_STACK_DEFINE(pipeline_stack, 1536);
+static bool pipeline_thread_started;
+
+static struct nmea_parser parser;
+
+/* the fields below are written by the pipeline thread and read by the Anjay thread */
+static struct k_spinlock lock;
+static bool has_reported;
+static struct nmea_fix reported;
+static int64_t reported_at_ms;
+
+static struct {
+	uint32_t fixes;
+	uint32_t reported;
+	uint32_t time_min_ns;
+	uint32_t time_max_ns;
+	uint64_t time_total_ns;
+} stats;
+
+/* accessed only from the Anjay thread */
+static bool has_notified;
+static struct nmea_fix notified;
+
+#ifdef CONFIG_ARCH_POSIX
+/*
+ * The cycle counter of native_sim follows the simulated time, which stands
+ * still while code runs, so the time spent is measured on the host clock.
+ */
+static uint32_t cpu_time_get(void)
+{
+	return (uint32_t)native_rtc_gettime_us(RTC_CLOCK_PSEUDOHOSTREALTIME);
+}
+
+static uint64_t cpu_time_to_ns(uint32_t time)
+{
+	return (uint64_t)time * NSEC_PER_USEC;
+}
+#else // CONFIG_ARCH_POSIX
+static uint32_t cpu_time_get(void)
+{
+	return k_cycle_get_32();
+}
+
+static uint64_t cpu_time_to_ns(uint32_t time)
+{
+	return k_cyc_to_ns_floor64(time);
+}
+#endif // CONFIG_ARCH_POSIX
+
+/* equirectangular approximation, accurate enough for thresholds of up to a few kilometers */
+static float distance_m(const struct nmea_fix *a, const struct nmea_fix *b)
+{
+	int64_t dlon_e7 = (int64_t)b->longitude_e7 - a->longitude_e7;
+
+	// the shorter way across the antimeridian
+	if (dlon_e7 > INT64_C(1800000000)) {
+		dlon_e7 -= INT64_C(3600000000);
+	} else if (dlon_e7 < -INT64_C(1800000000)) {
+		dlon_e7 += INT64_C(3600000000);
+	}
+
+	float dx = (float)dlon_e7 * DEG_E7_TO_M * cosf((float)a->latitude_e7 * DEG_E7_TO_RAD);
+	float dy = (float)((int64_t)b->latitude_e7 - a->latitude_e7) * DEG_E7_TO_M;
+
+	return sqrtf(dx * dx + dy * dy);
+}
+
+static void handle_fix(const struct nmea_fix *fix)
+{
+	int64_t now_ms = k_uptime_get();
+	bool report;
+
+	// only this thread writes the reported fix, so it can be read without the lock
+	report = !has_reported || now_ms - reported_at_ms >= LOCATION_MAX_INTERVAL_MS ||
+		 distance_m(&reported, fix) >= CONFIG_APP_LOCATION_MIN_DISTANCE_M;
+	if (report) {
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		has_reported = true;
+		reported = *fix;
+		reported_at_ms = now_ms;
+		stats.reported++;
+		k_spin_unlock(&lock, key);
+	}
+
+	if (report) {
+		object_refresh_request(OBJECT_REFRESH_LOCATION);
+	}
+}
+
+/**
+ * Parses a chunk of the stream. The time spent on it, including the handling
+ * of the fixes, is accounted to the fixes completed in it.
+ *
+ * Returns the number of fixes completed.
+ */
+static size_t feed(const char *data, size_t len)
+{
+	static uint64_t pending_ns;
+	uint32_t start = cpu_time_get();
+	size_t fixes = 0;
+	struct nmea_fix fix;
+
+	for (size_t i = 0; i < len; i++) {
+		if (nmea_parser_feed(&parser, data[i], &fix)) {
+			handle_fix(&fix);
+			fixes++;
+		}
+	}
+
+	pending_ns += cpu_time_to_ns(cpu_time_get() - start);
+	if (fixes) {
+		uint32_t time_ns = (uint32_t)MIN(pending_ns / fixes, UINT32_MAX);
+		k_spinlock_key_t key = k_spin_lock(&lock);
+
+		if (!stats.fixes || time_ns < stats.time_min_ns) {
+			stats.time_min_ns = time_ns;
+		}
+		if (time_ns > stats.time_max_ns) {
+			stats.time_max_ns = time_ns;
+		}
+		stats.time_total_ns += pending_ns;
+		stats.fixes += fixes;
+		k_spin_unlock(&lock, key);
+		pending_ns = 0;
+	}
+	return fixes;
+}
+
+#ifdef CONFIG_APP_LOCATION_NMEA_REPLAY
+static const char trace[] = {
+#include "nmea_trace.inc"
+};
+
+/* replays the trace in a loop, one fix per CONFIG_APP_LOCATION_NMEA_REPLAY_INTERVAL_MS */
+static void read_source(void)
+{
+	while (1) {
+		const char *line = trace;
+		const char *end = trace + sizeof(trace);
+
+		while (line < end) {
+			const char *next = memchr(line, '\n', (size_t)(end - line));
+
+			next = next ? next + 1 : end;
+			if (feed(line, (size_t)(next - line))) {
+				k_sleep(K_MSEC(CONFIG_APP_LOCATION_NMEA_REPLAY_INTERVAL_MS));
+			}
+			line = next;
+		}
+	}
+}
+#endif // CONFIG_APP_LOCATION_NMEA_REPLAY
+
+#ifdef CONFIG_APP_LOCATION_NMEA_UART
+#define GNSS_UART_NODE DT_ALIAS(gnss_uart)
+
+BUILD_ASSERT(DT_NODE_HAS_STATUS(GNSS_UART_NODE, okay),
+	     "CONFIG_APP_LOCATION_NMEA_UART requires the gnss-uart alias");
+
+static const struct device *const gnss_uart = DEVICE_DT_GET(GNSS_UART_NODE);
+
+#define RX_RING_SIZE 512
+
+RING_BUF_DECLARE(rx_ring, RX_RING_SIZE);
+static K_SEM_DEFINE(rx_sem, 0, 1);
+static atomic_t rx_dropped;
+
+static void uart_isr(const struct device *dev, void *user_data)
+{
+	(void)user_data;
+
+	if (!uart_irq_update(dev) || !uart_irq_rx_ready(dev)) {
+		return;
+	}
+
+	uint8_t buf[32];
+	int len;
+
+	while ((len = uart_fifo_read(dev, buf, sizeof(buf))) > 0) {
+		if (ring_buf_put(&rx_ring, buf, (uint32_t)len) < (uint32_t)len) {
+			// the parser recovers on the next '$'
+			atomic_inc(&rx_dropped);
+		}
+	}
+	k_sem_give(&rx_sem);
+}
+
+static void read_source(void)
+{
+	if (!device_is_ready(gnss_uart)) {
+		LOG_ERR("GNSS UART is not ready");
+		return;
+	}
+
+	uart_irq_callback_set(gnss_uart, uart_isr);
+	uart_irq_rx_enable(gnss_uart);
+
+	while (1) {
+		uint8_t *data;
+		uint32_t len;
+
+		k_sem_take(&rx_sem, K_FOREVER);
+		while ((len = ring_buf_get_claim(&rx_ring, &data, RX_RING_SIZE)) > 0) {
+			feed((const char *)data, len);
+			ring_buf_get_finish(&rx_ring, len);
+		}
+	}
+}
+#endif // CONFIG_APP_LOCATION_NMEA_UART
+
+static void run_pipeline(void *arg1, void *arg2, void *arg3)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+
+	nmea_parser_init(&parser);
+	read_source();
+}
+
+static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	anjay_dm_emit(ctx, 0);
+	return 0;
+}
+
+static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool has_fix = has_reported;
+	bool has_timestamp = has_reported && reported.timestamp >= 0;
+	bool has_speed = has_reported && reported.speed_mm_s >= 0;
+
+	k_spin_unlock(&lock, key);
+
+	// there is nothing to report before the first fix
+	anjay_dm_emit_res(ctx, RID_LATITUDE, ANJAY_DM_RES_R,
+			  has_fix ? ANJAY_DM_RES_PRESENT : ANJAY_DM_RES_ABSENT);
+	anjay_dm_emit_res(ctx, RID_LONGITUDE, ANJAY_DM_RES_R,
+			  has_fix ? ANJAY_DM_RES_PRESENT : ANJAY_DM_RES_ABSENT);
+	anjay_dm_emit_res(ctx, RID_ALTITUDE, ANJAY_DM_RES_R,
+			  has_fix ? ANJAY_DM_RES_PRESENT : ANJAY_DM_RES_ABSENT);
+	anjay_dm_emit_res(ctx, RID_RADIUS, ANJAY_DM_RES_R,
+			  has_fix ? ANJAY_DM_RES_PRESENT : ANJAY_DM_RES_ABSENT);
+	anjay_dm_emit_res(ctx, RID_TIMESTAMP, ANJAY_DM_RES_R,
+			  has_timestamp ? ANJAY_DM_RES_PRESENT : ANJAY_DM_RES_ABSENT);
+	anjay_dm_emit_res(ctx, RID_SPEED, ANJAY_DM_RES_R,
+			  has_speed ? ANJAY_DM_RES_PRESENT : ANJAY_DM_RES_ABSENT);
+	return 0;
+}
+
+static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			 anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+	(void)riid;
+
+	assert(riid == ANJAY_ID_INVALID);
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	struct nmea_fix fix = reported;
+
+	k_spin_unlock(&lock, key);
+
+	switch (rid) {
+	case RID_LATITUDE:
+		return anjay_ret_double(ctx, fix.latitude_e7 * 1e-7);
+
+	case RID_LONGITUDE:
+		return anjay_ret_double(ctx, fix.longitude_e7 * 1e-7);
+
+	case RID_ALTITUDE:
+		return anjay_ret_float(ctx, (float)fix.altitude_mm * 1e-3f);
+
+	case RID_RADIUS:
+		return anjay_ret_float(ctx, (float)fix.hdop_e2 * 1e-2f * UERE_M);
+
+	case RID_TIMESTAMP:
+		return anjay_ret_i64(ctx, fix.timestamp);
+
+	case RID_SPEED:
+		return anjay_ret_float(ctx, (float)fix.speed_mm_s * 1e-3f);
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = OID_LOCATION,
+	.handlers = { .list_instances = list_instances,
+
+		      .list_resources = list_resources,
+		      .resource_read = resource_read }
+};
+
+static const anjay_dm_object_def_t *const OBJ_DEF_PTR = &OBJ_DEF;
+
+#ifdef CONFIG_APP_TELEMETRY
+static const anjay_rid_t telemetry_rids[] = { RID_LATITUDE, RID_LONGITUDE, RID_ALTITUDE };
+
+static int telemetry_read_location(anjay_iid_t iid, void *arg, double *out_values)
+{
+	(void)iid;
+	(void)arg;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool has_fix = has_reported;
+	struct nmea_fix fix = reported;
+
+	k_spin_unlock(&lock, key);
+
+	if (!has_fix) {
+		return -ENODATA;
+	}
+	out_values[0] = fix.latitude_e7 * 1e-7;
+	out_values[1] = fix.longitude_e7 * 1e-7;
+	out_values[2] = fix.altitude_mm * 1e-3;
+	return 0;
+}
+#endif // CONFIG_APP_TELEMETRY
+
+int location_object_install(anjay_t *anjay)
+{
+	if (!pipeline_thread_started) {
+		if (!k_thread_create(&pipeline_thread, pipeline_stack,
+				     K_THREAD_STACK_SIZEOF(pipeline_stack), run_pipeline, NULL, NULL,
+				     NULL, K_LOWEST_APPLICATION_THREAD_PRIO, 0, K_NO_WAIT)) {
+			LOG_ERR("Failed to create location pipeline thread");
+			return -1;
+		}
+		k_thread_name_set(&pipeline_thread, "location");
+		pipeline_thread_started = true;
+	}
+
+	// a new Anjay instance has not been notified about anything yet
+	has_notified = false;
+
+	int result = anjay_register_object(anjay, &OBJ_DEF_PTR);
+
+#ifdef CONFIG_APP_TELEMETRY
+	if (!result) {
+		telemetry_source_add(OID_LOCATION, 0, telemetry_rids, AVS_ARRAY_SIZE(telemetry_rids),
+				     false, telemetry_read_location, NULL);
+	}
+#endif // CONFIG_APP_TELEMETRY
+	return result;
+}
+
+void location_object_notify(anjay_t *anjay)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	bool has_fix = has_reported;
+	struct nmea_fix fix = reported;
+
+	k_spin_unlock(&lock, key);
+
+	if (!has_fix) {
+		return;
+	}
+
+	if (!has_notified || fix.latitude_e7 != notified.latitude_e7) {
+		anjay_notify_changed(anjay, OBJ_DEF.oid, 0, RID_LATITUDE);
+	}
+	if (!has_notified || fix.longitude_e7 != notified.longitude_e7) {
+		anjay_notify_changed(anjay, OBJ_DEF.oid, 0, RID_LONGITUDE);
+	}
+	if (!has_notified || fix.altitude_mm != notified.altitude_mm) {
+		anjay_notify_changed(anjay, OBJ_DEF.oid, 0, RID_ALTITUDE);
+	}
+	if (!has_notified || fix.hdop_e2 != notified.hdop_e2) {
+		anjay_notify_changed(anjay, OBJ_DEF.oid, 0, RID_RADIUS);
+	}
+	if (!has_notified || fix.timestamp != notified.timestamp) {
+		anjay_notify_changed(anjay, OBJ_DEF.oid, 0, RID_TIMESTAMP);
+	}
+	if (!has_notified || fix.speed_mm_s != notified.speed_mm_s) {
+		anjay_notify_changed(anjay, OBJ_DEF.oid, 0, RID_SPEED);
+	}
+	has_notified = true;
+	notified = fix;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_location(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	uint32_t fixes = stats.fixes;
+	uint32_t reported_count = stats.reported;
+	uint32_t time_min_ns = stats.time_min_ns;
+	uint32_t time_max_ns = stats.time_max_ns;
+	uint64_t time_total_ns = stats.time_total_ns;
+
+	k_spin_unlock(&lock, key);
+
+	// the parser counters are only approximate while the pipeline runs
+	shell_print(shell, "sentences: %u, errors: %u", parser.sentences, parser.errors);
+	shell_print(shell, "fixes: %u, reported: %u", fixes, reported_count);
+	if (fixes) {
+		shell_print(shell, "time/fix: min %u ns, mean %u ns, max %u ns", time_min_ns,
+			    (uint32_t)(time_total_ns / fixes), time_max_ns);
+	}
+#ifdef CONFIG_APP_LOCATION_NMEA_UART
+	shell_print(shell, "dropped UART reads: %ld", (long)atomic_get(&rx_dropped));
+#endif // CONFIG_APP_LOCATION_NMEA_UART
+	return 0;
+}
+
+SHELL_CMD_REGISTER(location, NULL, "Show statistics of the NMEA location pipeline",
+		   cmd_location);
+#endif // CONFIG_SHELL
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <anjay/anjay.h>
+
+/**
+ * Registers the Location object and, on the first call, starts the thread
+ * that parses the NMEA stream. The thread keeps the most recent fix, and
+ * requests OBJECT_REFRESH_LOCATION whenever a fix is far enough from, or old
+ * enough compared to, the last reported one.
+ */
+int location_object_install(anjay_t *anjay);
+
+/**
+ * Notifies the LwM2M Server about the resources changed by the last reported
+ * fix. Called from the OBJECT_REFRESH_LOCATION handler.
+ */
+void location_object_notify(anjay_t *anjay);
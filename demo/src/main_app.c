@@ -24,22 +24,46 @@
 #include <anjay_zephyr/lwm2m.h>
 #include <anjay_zephyr/objects.h>
 
+#include "boot_profile.h"
+#include "buzzer.h"
+#include "heap_stats.h"
+#include "latency_stats.h"
+#ifdef CONFIG_APP_LOCATION_NMEA
+#include "location.h"
+#endif // CONFIG_APP_LOCATION_NMEA
+#include "object_refresh.h"
 #include "sensors_config.h"
+#ifdef CONFIG_APP_SENSORS_STATS
+#include "sensors_stats.h"
+#endif // CONFIG_APP_SENSORS_STATS
 #include "peripherals.h"
 #include "status_led.h"
+#include "telemetry.h"
 
 LOG_MODULE_REGISTER(main_app);
+
+#ifdef CONFIG_APP_TELEMETRY
+#define OID_ON_OFF_SWITCH 3342
+
+/**
+ * Digital Input State: R, Single, Mandatory
+ * type: boolean, range: N/A, unit: N/A
+ * The current state of a digital input.
+ */
+#define RID_DIGITAL_INPUT_STATE 5500
+#endif // CONFIG_APP_TELEMETRY
+#ifndef CONFIG_APP_LOCATION_NMEA
 static const anjay_dm_object_def_t **location_obj;
-#if BUZZER_AVAILABLE
-static const anjay_dm_object_def_t **buzzer_obj;
-#endif // BUZZER_AVAILABLE
+#endif // CONFIG_APP_LOCATION_NMEA
 #if LED_COLOR_LIGHT_AVAILABLE
 static const anjay_dm_object_def_t **led_color_light_obj;
 #endif // LED_COLOR_LIGHT_AVAILABLE
 #if SWITCH_AVAILABLE_ANY
 static const anjay_dm_object_def_t **switch_obj;
 #endif // SWITCH_AVAILABLE_ANY
-static avs_sched_handle_t update_objects_handle;
+
+// given by main() once the peripherals are initialized, and then kept given
+static K_SEM_DEFINE(peripherals_ready, 0, 1);
 
 #if LIGHT_CONTROL_AVAILABLE_ANY
 static const struct gpio_dt_spec leds[] = {
@@ -88,26 +112,63 @@ static struct anjay_zephyr_switch_instance switches[] = {
 	SWITCH_BUTTON_GLUE_ITEM(2),
 #endif // SWITCH_AVAILABLE(2)
 };
+
+static const struct gpio_dt_spec switch_specs[] = {
+#if SWITCH_AVAILABLE(0)
+	GPIO_DT_SPEC_GET(SWITCH_NODE(0), gpios),
+#endif // SWITCH_AVAILABLE(0)
+#if SWITCH_AVAILABLE(1)
+	GPIO_DT_SPEC_GET(SWITCH_NODE(1), gpios),
+#endif // SWITCH_AVAILABLE(1)
+#if SWITCH_AVAILABLE(2)
+	GPIO_DT_SPEC_GET(SWITCH_NODE(2), gpios),
+#endif // SWITCH_AVAILABLE(2)
+};
+static struct gpio_callback switch_callbacks[AVS_ARRAY_SIZE(switch_specs)];
+
+#ifdef CONFIG_APP_TELEMETRY
+static int telemetry_read_switch(anjay_iid_t iid, void *spec, double *out_values)
+{
+	(void)iid;
+
+	int state = gpio_pin_get_dt(spec);
+
+	if (state < 0) {
+		return -1;
+	}
+
+	out_values[0] = state;
+	return 0;
+}
+#endif // CONFIG_APP_TELEMETRY
 #endif // SWITCH_AVAILABLE_ANY
 struct anjay_zephyr_network_preferred_bearer_list_t anjay_zephyr_config_get_preferred_bearers(void);
 
 static int register_objects(anjay_t *anjay)
 {
+#ifdef CONFIG_APP_TELEMETRY
+	telemetry_reset();
+#endif // CONFIG_APP_TELEMETRY
+
+#ifdef CONFIG_APP_LOCATION_NMEA
+	location_object_install(anjay);
+#else  // CONFIG_APP_LOCATION_NMEA
 	location_obj = anjay_zephyr_location_object_create();
 	if (location_obj) {
 		anjay_register_object(anjay, location_obj);
 	}
+#endif // CONFIG_APP_LOCATION_NMEA
 
-	sensors_install(anjay);
+	HEAP_STATS_TAG(HEAP_TAG_SENSORS)
+	{
+		sensors_install(anjay);
+	}
 #if PUSH_BUTTON_AVAILABLE_ANY
 	anjay_zephyr_ipso_push_button_object_install(anjay, buttons, AVS_ARRAY_SIZE(buttons));
 #endif // PUSH_BUTTON_AVAILABLE_ANY
 
 #if BUZZER_AVAILABLE
-	buzzer_obj = anjay_zephyr_buzzer_object_create(BUZZER_NODE);
-	if (buzzer_obj) {
-		anjay_register_object(anjay, buzzer_obj);
-	}
+	buzzer_object_install(anjay);
 #endif // BUZZER_AVAILABLE
 
 #if LED_COLOR_LIGHT_AVAILABLE
@@ -128,67 +189,163 @@ static int register_objects(anjay_t *anjay)
 	switch_obj = anjay_zephyr_switch_object_create(switches, AVS_ARRAY_SIZE(switches));
 	if (switch_obj) {
 		anjay_register_object(anjay, switch_obj);
+#ifdef CONFIG_APP_TELEMETRY
+		static const anjay_rid_t rids[] = { RID_DIGITAL_INPUT_STATE };
+
+		for (size_t i = 0; i < AVS_ARRAY_SIZE(switch_specs); i++) {
+			telemetry_source_add(OID_ON_OFF_SWITCH, (anjay_iid_t)i, rids,
+					     AVS_ARRAY_SIZE(rids), true, telemetry_read_switch,
+					     (void *)&switch_specs[i]);
+		}
+#endif // CONFIG_APP_TELEMETRY
 	}
 #endif // SWITCH_AVAILABLE_ANY
+
+#ifdef CONFIG_APP_LATENCY_STATS
+	latency_stats_object_install(anjay);
+#endif // CONFIG_APP_LATENCY_STATS
+#ifdef CONFIG_APP_HEAP_STATS
+	heap_stats_object_install(anjay);
+#endif // CONFIG_APP_HEAP_STATS
+#ifdef CONFIG_APP_BOOT_PROFILE
+	boot_profile_object_install(anjay);
+#endif // CONFIG_APP_BOOT_PROFILE
 	return 0;
 }
 
-static void update_objects_frequent(anjay_t *anjay)
-{
 #if SWITCH_AVAILABLE_ANY
+static void refresh_switches(anjay_t *anjay)
+{
 	anjay_zephyr_switch_object_update(anjay, switch_obj);
+}
+
+static void switch_callback_handler(const struct device *port, struct gpio_callback *cb,
+				    gpio_port_pins_t pins)
+{
+	object_refresh_request(OBJECT_REFRESH_SWITCH);
+}
+
+static void switch_interrupts_configure(bool enable)
+{
+	for (size_t i = 0; i < AVS_ARRAY_SIZE(switch_specs); i++) {
+		const struct gpio_dt_spec *spec = &switch_specs[i];
+
+		if (enable) {
+			gpio_init_callback(&switch_callbacks[i], switch_callback_handler,
+					   BIT(spec->pin));
+			gpio_add_callback(spec->port, &switch_callbacks[i]);
+			gpio_pin_interrupt_configure_dt(spec, GPIO_INT_EDGE_BOTH);
+		} else {
+			gpio_pin_interrupt_configure_dt(spec, GPIO_INT_DISABLE);
+			gpio_remove_callback(spec->port, &switch_callbacks[i]);
+		}
+	}
+}
 #endif // SWITCH_AVAILABLE_ANY
+
 #if BUZZER_AVAILABLE
-	anjay_zephyr_buzzer_object_update(anjay, buzzer_obj);
-#endif // BUZZER_AVAILABLE
+static void refresh_buzzer(anjay_t *anjay)
+{
+	buzzer_object_update(anjay);
 }
+#endif // BUZZER_AVAILABLE
 
-static void update_objects_periodic(anjay_t *anjay)
+static void refresh_sensors(anjay_t *anjay)
 {
-	anjay_zephyr_ipso_sensors_update(anjay);
-	anjay_zephyr_location_object_update(anjay, location_obj);
+	object_refresh_deadline_set(OBJECT_REFRESH_SENSORS, sensors_update(anjay));
 }
 
-static void update_objects(avs_sched_t *sched, const void *anjay_ptr)
+#ifdef CONFIG_APP_SENSORS_STATS
+static void refresh_sensor_stats(anjay_t *anjay)
 {
-	anjay_t *anjay = *(anjay_t *const *)anjay_ptr;
+	sensors_stats_notify(anjay);
+}
+#endif // CONFIG_APP_SENSORS_STATS
 
-	static size_t cycle;
+static void refresh_location(anjay_t *anjay)
+{
+#ifdef CONFIG_APP_LOCATION_NMEA
+	location_object_notify(anjay);
+#else  // CONFIG_APP_LOCATION_NMEA
+	anjay_zephyr_location_object_update(anjay, location_obj);
+#endif // CONFIG_APP_LOCATION_NMEA
+}
 
-	update_objects_frequent(anjay);
-	if (cycle % 5 == 0) {
-		update_objects_periodic(anjay);
+#ifdef CONFIG_APP_TELEMETRY
+static void refresh_telemetry(anjay_t *anjay)
+{
+	HEAP_STATS_TAG(HEAP_TAG_TELEMETRY)
+	{
+		object_refresh_deadline_set(OBJECT_REFRESH_TELEMETRY, telemetry_update(anjay));
 	}
-
-	status_led_toggle();
-
-	cycle++;
-	AVS_SCHED_DELAYED(sched, &update_objects_handle,
-			  avs_time_duration_from_scalar(1, AVS_TIME_S), update_objects, &anjay,
-			  sizeof(anjay));
 }
+#endif // CONFIG_APP_TELEMETRY
 
 static int init_update_objects(anjay_t *anjay)
 {
-	avs_sched_t *sched = anjay_get_scheduler(anjay);
-
-	update_objects(sched, &anjay);
+	boot_profile_mark(BOOT_PHASE_ANJAY_READY);
+	boot_profile_registration_watch(anjay);
 
 	status_led_init();
 
-	return 0;
+#if SWITCH_AVAILABLE_ANY
+	// switch state changes are delivered by GPIO interrupts
+	object_refresh_source_set(OBJECT_REFRESH_SWITCH, refresh_switches,
+				  AVS_TIME_DURATION_INVALID);
+	switch_interrupts_configure(true);
+#endif // SWITCH_AVAILABLE_ANY
+#if BUZZER_AVAILABLE
+	// the buzzer requests a refresh when its Delay Duration expires
+	object_refresh_source_set(OBJECT_REFRESH_BUZZER, refresh_buzzer,
+				  AVS_TIME_DURATION_INVALID);
+#endif // BUZZER_AVAILABLE
+	// each sensor is sampled according to its own observation attributes
+	object_refresh_source_set(OBJECT_REFRESH_SENSORS, refresh_sensors,
+				  AVS_TIME_DURATION_INVALID);
+#ifdef CONFIG_APP_SENSORS_STATS
+	// the aggregated values change with every sample, so they are notified periodically
+	object_refresh_source_set(
+		OBJECT_REFRESH_SENSOR_STATS, refresh_sensor_stats,
+		avs_time_duration_from_scalar(CONFIG_APP_SENSORS_STATS_NOTIFY_PERIOD, AVS_TIME_S));
+#endif // CONFIG_APP_SENSORS_STATS
+#ifdef CONFIG_APP_LOCATION_NMEA
+	// the location pipeline requests a refresh only for fixes worth reporting
+	object_refresh_source_set(OBJECT_REFRESH_LOCATION, refresh_location,
+				  AVS_TIME_DURATION_INVALID);
+#else  // CONFIG_APP_LOCATION_NMEA
+	object_refresh_source_set(
+		OBJECT_REFRESH_LOCATION, refresh_location,
+		avs_time_duration_from_scalar(CONFIG_APP_REFRESH_LOCATION_PERIOD, AVS_TIME_S));
+#endif // CONFIG_APP_LOCATION_NMEA
+#ifdef CONFIG_APP_TELEMETRY
+	// sampling and flushing deadlines depend on runtime-tunable parameters
+	object_refresh_source_set(OBJECT_REFRESH_TELEMETRY, refresh_telemetry,
+				  AVS_TIME_DURATION_INVALID);
+#endif // CONFIG_APP_TELEMETRY
+
+	return object_refresh_start(anjay);
 }
 
 static int clean_before_anjay_destroy(anjay_t *anjay)
 {
-	avs_sched_del(&update_objects_handle);
+#if SWITCH_AVAILABLE_ANY
+	switch_interrupts_configure(false);
+#endif // SWITCH_AVAILABLE_ANY
+	object_refresh_stop();
+	boot_profile_registration_unwatch();
 
 	return 0;
 }
 
 static int release_objects(void)
 {
+#ifdef CONFIG_APP_TELEMETRY
+	telemetry_reset();
+#endif // CONFIG_APP_TELEMETRY
+
+#ifndef CONFIG_APP_LOCATION_NMEA
 	anjay_zephyr_location_object_release(&location_obj);
+#endif // CONFIG_APP_LOCATION_NMEA
 #if SWITCH_AVAILABLE_ANY
 	anjay_zephyr_switch_object_release(&switch_obj);
 #endif // SWITCH_AVAILABLE_ANY
@@ -199,16 +356,29 @@ static int release_objects(void)
 	anjay_zephyr_light_control_object_release(&light_control_obj);
 #endif // LIGHT_CONTROL_AVAILABLE_ANY
 #if BUZZER_AVAILABLE
-	anjay_zephyr_buzzer_object_release(&buzzer_obj);
+	buzzer_object_release();
 #endif // BUZZER_AVAILABLE
 	return 0;
 }
 
-int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reason)
+static int handle_lwm2m_callback(anjay_t *anjay,
+				 enum anjay_zephyr_lwm2m_callback_reasons reason)
 {
 	switch (reason) {
-	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_INIT:
-		return register_objects(anjay);
+	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_INIT: {
+		int result;
+
+		// the sensors and the telemetry store are set up by main()
+		k_sem_take(&peripherals_ready, K_FOREVER);
+		k_sem_give(&peripherals_ready);
+
+		HEAP_STATS_TAG(HEAP_TAG_OBJECTS)
+		{
+			result = register_objects(anjay);
+		}
+		boot_profile_mark(BOOT_PHASE_OBJECTS_REGISTERED);
+		return result;
+	}
 	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_ANJAY_READY:
 		return init_update_objects(anjay);
 	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_ANJAY_SHUTTING_DOWN:
@@ -220,14 +390,42 @@ int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reas
 	}
 }
 
+int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reason)
+{
+	int result;
+
+	LATENCY_MEASURE(LATENCY_PROBE_LWM2M_CALLBACK)
+	{
+		result = handle_lwm2m_callback(anjay, reason);
+	}
+	return result;
+}
+
+static void init_peripherals(void)
+{
+	sensors_prepare();
+#ifdef CONFIG_APP_TELEMETRY
+	telemetry_init();
+#endif // CONFIG_APP_TELEMETRY
+}
+
 int main(void)
 {
+	boot_profile_mark(BOOT_PHASE_MAIN);
 	LOG_INF("Initializing Anjay-zephyr-client demo " CONFIG_ANJAY_ZEPHYR_VERSION);
 
 	anjay_zephyr_lwm2m_set_user_callback(lwm2m_callback);
 
 	anjay_zephyr_lwm2m_init_from_settings();
+	boot_profile_mark(BOOT_PHASE_SETTINGS_LOADED);
 	anjay_zephyr_lwm2m_start();
+	boot_profile_mark(BOOT_PHASE_LWM2M_STARTED);
+
+	// the network is brought up by the Anjay thread in the meantime, and the
+	// objects are registered once both are done
+	init_peripherals();
+	boot_profile_mark(BOOT_PHASE_PERIPHERALS_READY);
+	k_sem_give(&peripherals_ready);
 
 	// Anjay runs in a separate thread and preceding function doesn't block
 	// add your own code here
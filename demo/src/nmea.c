@@ -0,0 +1,290 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "nmea.h"
+
+/* GGA has the most fields of the parsed sentences: 15 */
+#define NMEA_MAX_FIELDS 20
+
+#define MS_PER_DAY (24 * 60 * 60 * 1000)
+#define SECONDS_PER_DAY (24 * 60 * 60)
+
+void nmea_parser_init(struct nmea_parser *parser)
+{
+	memset(parser, 0, sizeof(*parser));
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	if (c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	}
+	return -1;
+}
+
+/**
+ * Parses a decimal number into an integer scaled by 10^@p decimals. Further
+ * decimal places are truncated.
+ */
+static int parse_decimal(const char *str, int decimals, int64_t *out_value)
+{
+	bool negative = (*str == '-');
+	bool any_digit = false;
+	int64_t value = 0;
+
+	if (negative) {
+		str++;
+	}
+	for (; *str >= '0' && *str <= '9'; str++) {
+		value = value * 10 + (*str - '0');
+		any_digit = true;
+	}
+	if (*str == '.') {
+		str++;
+	}
+	for (int i = 0; i < decimals; i++) {
+		value *= 10;
+		if (*str >= '0' && *str <= '9') {
+			value += *str++ - '0';
+			any_digit = true;
+		}
+	}
+	while (*str >= '0' && *str <= '9') {
+		str++;
+	}
+	if (!any_digit || *str) {
+		return -1;
+	}
+
+	*out_value = negative ? -value : value;
+	return 0;
+}
+
+/* hhmmss.sss */
+static int parse_time_ms(const char *str, int32_t *out_time_ms)
+{
+	int64_t value;
+
+	if (parse_decimal(str, 3, &value) || value < 0) {
+		return -1;
+	}
+
+	int32_t hhmmss = (int32_t)(value / 1000);
+	int32_t hours = hhmmss / 10000;
+	int32_t minutes = hhmmss / 100 % 100;
+	int32_t seconds = hhmmss % 100;
+
+	if (hours > 23 || minutes > 59 || seconds > 60) {
+		return -1;
+	}
+	*out_time_ms = ((hours * 60 + minutes) * 60 + seconds) * 1000 + (int32_t)(value % 1000);
+	return 0;
+}
+
+/* days since 1970-01-01 of a date in the proleptic Gregorian calendar */
+static int32_t days_from_civil(int32_t year, int32_t month, int32_t day)
+{
+	year -= month <= 2;
+	int32_t era = year / 400;
+	int32_t year_of_era = year - era * 400;
+	int32_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	int32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+
+	return era * 146097 + day_of_era - 719468;
+}
+
+/* ddmmyy, years 2000-2099 */
+static int parse_date_days(const char *str, int32_t *out_days)
+{
+	int64_t value;
+
+	if (strlen(str) != 6 || parse_decimal(str, 0, &value) || value < 0) {
+		return -1;
+	}
+
+	int32_t day = (int32_t)(value / 10000);
+	int32_t month = (int32_t)(value / 100 % 100);
+	int32_t year = 2000 + (int32_t)(value % 100);
+
+	if (day < 1 || day > 31 || month < 1 || month > 12) {
+		return -1;
+	}
+	*out_days = days_from_civil(year, month, day);
+	return 0;
+}
+
+/* ddmm.mmmm or dddmm.mmmm, followed by a hemisphere field */
+static int parse_coordinate(const char *str, const char *hemisphere, char negative_hemisphere,
+			    int32_t max_degrees, int32_t *out_e7)
+{
+	int64_t value;
+
+	if (parse_decimal(str, 7, &value) || value < 0) {
+		return -1;
+	}
+
+	// value is (degrees * 100 + minutes) * 1e7
+	int64_t degrees = value / 1000000000;
+	int64_t minutes_e7 = value % 1000000000;
+	int64_t result = degrees * 10000000 + minutes_e7 / 60;
+
+	if (minutes_e7 >= INT64_C(600000000) || result > (int64_t)max_degrees * 10000000) {
+		return -1;
+	}
+	if (hemisphere[0] == negative_hemisphere) {
+		result = -result;
+	} else if (!hemisphere[0] || hemisphere[1]) {
+		return -1;
+	}
+	*out_e7 = (int32_t)result;
+	return 0;
+}
+
+/* the talker ID, e.g. GP or GN, is not checked */
+static bool sentence_is(const char *address, const char *type)
+{
+	return strlen(address) == 5 && !strcmp(address + 2, type);
+}
+
+static void handle_rmc(struct nmea_parser *parser, char **fields, size_t count)
+{
+	int32_t time_ms;
+	int32_t days;
+	int64_t speed_knots_e3;
+
+	// 1: time, 2: status, 7: speed over ground [knots], 9: date
+	if (count < 10 || strcmp(fields[2], "A") || parse_time_ms(fields[1], &time_ms) ||
+	    parse_date_days(fields[9], &days)) {
+		parser->rmc_valid = false;
+		return;
+	}
+
+	parser->rmc_valid = true;
+	parser->rmc_days = days;
+	parser->rmc_time_ms = time_ms;
+	parser->rmc_speed_mm_s = parse_decimal(fields[7], 3, &speed_knots_e3) ?
+					 -1 :
+					 (int32_t)(speed_knots_e3 * 1852 / 3600);
+}
+
+static bool handle_gga(struct nmea_parser *parser, char **fields, size_t count,
+		       struct nmea_fix *out_fix)
+{
+	int32_t time_ms;
+	int64_t value;
+
+	// 1: time, 2-5: position, 6: fix quality, 7: satellites, 8: HDOP, 9: altitude
+	if (count < 10 || !strcmp(fields[6], "0") || !fields[6][0] ||
+	    parse_time_ms(fields[1], &time_ms) ||
+	    parse_coordinate(fields[2], fields[3], 'S', 90, &out_fix->latitude_e7) ||
+	    parse_coordinate(fields[4], fields[5], 'W', 180, &out_fix->longitude_e7)) {
+		return false;
+	}
+
+	out_fix->satellites = parse_decimal(fields[7], 0, &value) ? 0 : (uint8_t)value;
+	out_fix->hdop_e2 = parse_decimal(fields[8], 2, &value) || value > UINT16_MAX ?
+				   UINT16_MAX :
+				   (uint16_t)value;
+	out_fix->altitude_mm = parse_decimal(fields[9], 3, &value) ? 0 : (int32_t)value;
+
+	out_fix->speed_mm_s = -1;
+	out_fix->timestamp = -1;
+	if (parser->rmc_valid) {
+		int32_t days = parser->rmc_days;
+
+		// the RMC sentence may belong to the previous epoch, before midnight
+		if (time_ms < parser->rmc_time_ms - MS_PER_DAY / 2) {
+			days++;
+		}
+		out_fix->timestamp = (int64_t)days * SECONDS_PER_DAY + time_ms / 1000;
+		out_fix->speed_mm_s = parser->rmc_speed_mm_s;
+	}
+	return true;
+}
+
+static bool handle_sentence(struct nmea_parser *parser, struct nmea_fix *out_fix)
+{
+	char *checksum = strchr(parser->line, '*');
+
+	if (!checksum || strlen(checksum) != 3) {
+		parser->errors++;
+		return false;
+	}
+
+	int high = hex_digit(checksum[1]);
+	int low = hex_digit(checksum[2]);
+	uint8_t sum = 0;
+
+	for (const char *c = parser->line; c < checksum; c++) {
+		sum ^= (uint8_t)*c;
+	}
+	if (high < 0 || low < 0 || sum != (high << 4 | low)) {
+		parser->errors++;
+		return false;
+	}
+	*checksum = '\0';
+	parser->sentences++;
+
+	char *fields[NMEA_MAX_FIELDS];
+	size_t count = 0;
+	char *field = parser->line;
+
+	while (count < NMEA_MAX_FIELDS) {
+		fields[count++] = field;
+		field = strchr(field, ',');
+		if (!field) {
+			break;
+		}
+		*field++ = '\0';
+	}
+
+	if (sentence_is(fields[0], "RMC")) {
+		handle_rmc(parser, fields, count);
+	} else if (sentence_is(fields[0], "GGA")) {
+		return handle_gga(parser, fields, count, out_fix);
+	}
+	return false;
+}
+
+bool nmea_parser_feed(struct nmea_parser *parser, char c, struct nmea_fix *out_fix)
+{
+	if (c == '$') {
+		// also discards an unterminated sentence
+		parser->in_sentence = true;
+		parser->line_len = 0;
+		return false;
+	}
+	if (!parser->in_sentence) {
+		return false;
+	}
+	if (c == '\r' || c == '\n') {
+		parser->in_sentence = false;
+		parser->line[parser->line_len] = '\0';
+		return handle_sentence(parser, out_fix);
+	}
+	if (parser->line_len >= NMEA_MAX_SENTENCE_LEN) {
+		parser->in_sentence = false;
+		parser->errors++;
+		return false;
+	}
+	parser->line[parser->line_len++] = c;
+	return false;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* without the leading '$' and the trailing CR LF */
+#define NMEA_MAX_SENTENCE_LEN 79
+
+struct nmea_fix {
+	// degrees * 1e7, north and east are positive
+	int32_t latitude_e7;
+	int32_t longitude_e7;
+	// above mean sea level
+	int32_t altitude_mm;
+	// horizontal dilution of precision * 100
+	uint16_t hdop_e2;
+	uint8_t satellites;
+	// -1 if unknown
+	int32_t speed_mm_s;
+	// UTC seconds since the epoch, -1 if the date is unknown
+	int64_t timestamp;
+};
+
+/**
+ * Incremental parser of NMEA 0183 sentences. A fix is produced for every GGA
+ * sentence with a position, completed with the date and speed of the most
+ * recent RMC sentence. All talkers (GP, GL, GN, ...) are accepted, other
+ * sentence types are only checksummed and counted.
+ */
+struct nmea_parser {
+	char line[NMEA_MAX_SENTENCE_LEN + 1];
+	uint8_t line_len;
+	bool in_sentence;
+
+	bool rmc_valid;
+	int32_t rmc_days;
+	int32_t rmc_time_ms;
+	int32_t rmc_speed_mm_s;
+
+	uint32_t sentences;
+	uint32_t errors;
+};
+
+void nmea_parser_init(struct nmea_parser *parser);
+
+/**
+ * Feeds a single character of the stream to @p parser.
+ *
+ * @returns true if @p c completed a sentence that yielded a fix, which is then
+ *          stored in @p out_fix
+ */
+bool nmea_parser_feed(struct nmea_parser *parser, char c, struct nmea_fix *out_fix);
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <avsystem/commons/avs_sched.h>
+
+#include "latency_stats.h"
+#include "object_refresh.h"
+#include "status_led.h"
+#include "synchronized.h"
+
+LOG_MODULE_REGISTER(object_refresh);
+
+#ifdef CONFIG_APP_LATENCY_STATS
+BUILD_ASSERT(LATENCY_PROBE_REFRESH(_OBJECT_REFRESH_SOURCE_COUNT) == _LATENCY_PROBE_COUNT);
+#endif // CONFIG_APP_LATENCY_STATS
+
+/*
+ * Objects are refreshed from a single job on the Anjay scheduler. The job is
+ * only scheduled for the earliest deadline of all periodic sources, or
+ * immediately after some source has been requested from another context.
+ * Requests may come from interrupts, where the Anjay scheduler cannot be
+ * touched, so they are forwarded through the system workqueue.
+ */
+
+struct refresh_source {
+	object_refresh_handler_t *handler;
+	avs_time_duration_t period;
+	avs_time_monotonic_t deadline;
+};
+
+static struct refresh_source sources[_OBJECT_REFRESH_SOURCE_COUNT];
+
+static K_MUTEX_DEFINE(refresh_mutex);
+static anjay_t *refresh_anjay;
+static avs_sched_handle_t refresh_handle;
+
+static atomic_t requested_sources;
+static atomic_t kick_scheduled;
+
+static void refresh_job(avs_sched_t *sched, const void *dummy)
+{
+	(void)dummy;
+
+	atomic_clear(&kick_scheduled);
+	avs_sched_del(&refresh_handle);
+
+	if (!refresh_anjay) {
+		return;
+	}
+
+	atomic_val_t requested = atomic_clear(&requested_sources);
+	avs_time_monotonic_t now = avs_time_monotonic_now();
+	avs_time_monotonic_t next_deadline = AVS_TIME_MONOTONIC_INVALID;
+	bool refreshed = false;
+
+	for (int i = 0; i < _OBJECT_REFRESH_SOURCE_COUNT; i++) {
+		struct refresh_source *source = &sources[i];
+
+		if (!source->handler) {
+			continue;
+		}
+
+		bool due = avs_time_monotonic_valid(source->deadline) &&
+			   !avs_time_monotonic_before(now, source->deadline);
+
+		if ((requested & BIT(i)) || due) {
+			if (avs_time_duration_valid(source->period)) {
+				source->deadline = avs_time_monotonic_add(now, source->period);
+			} else if (due) {
+				source->deadline = AVS_TIME_MONOTONIC_INVALID;
+			}
+
+			// may call object_refresh_deadline_set()
+			LATENCY_MEASURE(LATENCY_PROBE_REFRESH(i))
+			{
+				source->handler(refresh_anjay);
+			}
+			refreshed = true;
+		}
+
+		if (avs_time_monotonic_valid(source->deadline) &&
+		    (!avs_time_monotonic_valid(next_deadline) ||
+		     avs_time_monotonic_before(source->deadline, next_deadline))) {
+			next_deadline = source->deadline;
+		}
+	}
+
+	if (refreshed) {
+		status_led_toggle();
+	}
+
+	if (avs_time_monotonic_valid(next_deadline)) {
+		AVS_SCHED_AT(sched, &refresh_handle, next_deadline, refresh_job, NULL, 0);
+	}
+}
+
+static void kick_work_handler(struct k_work *work)
+{
+	(void)work;
+
+	SYNCHRONIZED(refresh_mutex)
+	{
+		if (refresh_anjay && !atomic_set(&kick_scheduled, 1)) {
+			if (AVS_SCHED_NOW(anjay_get_scheduler(refresh_anjay), NULL, refresh_job,
+					  NULL, 0)) {
+				LOG_ERR("Could not schedule objects refresh");
+				atomic_clear(&kick_scheduled);
+			}
+		}
+	}
+}
+
+static K_WORK_DEFINE(kick_work, kick_work_handler);
+
+void object_refresh_source_set(enum object_refresh_source source,
+			       object_refresh_handler_t *handler, avs_time_duration_t period)
+{
+	sources[source] = (struct refresh_source){ .handler = handler,
+						   .period = period,
+						   .deadline = AVS_TIME_MONOTONIC_INVALID };
+}
+
+void object_refresh_deadline_set(enum object_refresh_source source,
+				 avs_time_monotonic_t deadline)
+{
+	sources[source].deadline = deadline;
+}
+
+int object_refresh_start(anjay_t *anjay)
+{
+	avs_time_monotonic_t now = avs_time_monotonic_now();
+
+	for (int i = 0; i < _OBJECT_REFRESH_SOURCE_COUNT; i++) {
+		if (avs_time_duration_valid(sources[i].period)) {
+			sources[i].deadline = now;
+		}
+	}
+
+	SYNCHRONIZED(refresh_mutex)
+	{
+		refresh_anjay = anjay;
+	}
+
+	// everything gets refreshed once on start
+	atomic_set(&requested_sources, BIT_MASK(_OBJECT_REFRESH_SOURCE_COUNT));
+	atomic_set(&kick_scheduled, 1);
+	refresh_job(anjay_get_scheduler(anjay), NULL);
+
+	return 0;
+}
+
+void object_refresh_stop(void)
+{
+	SYNCHRONIZED(refresh_mutex)
+	{
+		refresh_anjay = NULL;
+	}
+
+	avs_sched_del(&refresh_handle);
+}
+
+void object_refresh_request(enum object_refresh_source source)
+{
+	atomic_or(&requested_sources, BIT(source));
+	k_work_submit(&kick_work);
+}
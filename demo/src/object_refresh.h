@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <anjay/anjay.h>
+
+enum object_refresh_source {
+	OBJECT_REFRESH_SWITCH,
+	OBJECT_REFRESH_BUZZER,
+	OBJECT_REFRESH_SENSORS,
+	OBJECT_REFRESH_LOCATION,
+	OBJECT_REFRESH_TELEMETRY,
+	OBJECT_REFRESH_SENSOR_STATS,
+	_OBJECT_REFRESH_SOURCE_COUNT
+};
+
+typedef void object_refresh_handler_t(anjay_t *anjay);
+
+/**
+ * Sets the handler called from the Anjay thread whenever @p source needs work.
+ *
+ * If @p period is valid, the handler is additionally called once per @p period.
+ * Otherwise, the source is refreshed only on @ref object_refresh_request.
+ */
+void object_refresh_source_set(enum object_refresh_source source,
+			       object_refresh_handler_t *handler, avs_time_duration_t period);
+
+/**
+ * Sets the next refresh of @p source to @p deadline, or cancels it if
+ * @p deadline is invalid. Intended to be called from the handler of a source
+ * with no fixed period.
+ */
+void object_refresh_deadline_set(enum object_refresh_source source,
+				 avs_time_monotonic_t deadline);
+
+int object_refresh_start(anjay_t *anjay);
+void object_refresh_stop(void);
+
+/**
+ * Marks @p source as needing a refresh. Safe to call from any thread and from
+ * interrupt context.
+ */
+void object_refresh_request(enum object_refresh_source source);
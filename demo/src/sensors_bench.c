@@ -0,0 +1,162 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "sensors_fixed.h"
+
+#define SENSORS_BENCH_INPUTS 64
+#define SENSORS_BENCH_DEFAULT_SAMPLES 10000
+#define SENSORS_BENCH_RUNS 5
+
+/*
+ * The two scales of the demo: an integer one, from kPa to Pa for the pressure
+ * sensor, and one below 1, from gauss to tesla for the magnetometer.
+ */
+static const struct {
+	const char *name;
+	double factor;
+	uint32_t mul;
+	uint32_t div;
+} bench_scales[] = {
+	{ "kPa to Pa", 1e3, 1000, 1 },
+	{ "gauss to T", 1e-4, 1, 10000 },
+};
+
+static struct sensor_value inputs[SENSORS_BENCH_INPUTS];
+
+/*
+ * The scale is read through these in each run, so that the compiler cannot
+ * fold a constant one into the loops, as it could not in the demo either.
+ */
+static volatile double bench_factor;
+static volatile struct sensor_fixed_scale bench_scale;
+
+/* results are stored here so that the conversions are not optimized out */
+static volatile double double_sink;
+static volatile int64_t fixed_sink;
+
+static void inputs_init(void)
+{
+	uint32_t state = 12345;
+
+	for (size_t i = 0; i < SENSORS_BENCH_INPUTS; i++) {
+		state = state * 1103515245 + 12345;
+		// around the atmospheric pressure in kPa
+		inputs[i].val1 = 95 + (int32_t)(state >> 16) % 10;
+		state = state * 1103515245 + 12345;
+		inputs[i].val2 = (int32_t)(state % 1000000);
+	}
+}
+
+/* conversion used by the demo before switching to sensors_fixed.h */
+static uint32_t bench_double(uint32_t samples)
+{
+	double factor = bench_factor;
+	uint32_t start = k_cycle_get_32();
+
+	for (uint32_t i = 0; i < samples; i++) {
+		double_sink = sensor_value_to_double(&inputs[i % SENSORS_BENCH_INPUTS]) * factor;
+	}
+	return k_cycle_get_32() - start;
+}
+
+/* per-sample cost in the streaming and statistics paths */
+static uint32_t bench_fixed(uint32_t samples)
+{
+	struct sensor_fixed_scale scale = bench_scale;
+	uint32_t start = k_cycle_get_32();
+
+	for (uint32_t i = 0; i < samples; i++) {
+		fixed_sink = sensor_fixed_scale(
+			sensor_fixed_from_value(&inputs[i % SENSORS_BENCH_INPUTS]), scale);
+	}
+	return k_cycle_get_32() - start;
+}
+
+/* including the conversion to double for Anjay */
+static uint32_t bench_fixed_to_double(uint32_t samples)
+{
+	struct sensor_fixed_scale scale = bench_scale;
+	uint32_t start = k_cycle_get_32();
+
+	for (uint32_t i = 0; i < samples; i++) {
+		double_sink = sensor_fixed_to_double(sensor_fixed_scale(
+			sensor_fixed_from_value(&inputs[i % SENSORS_BENCH_INPUTS]), scale));
+	}
+	return k_cycle_get_32() - start;
+}
+
+static void print_result(const struct shell *shell, const char *name, uint32_t cycles,
+			 uint32_t samples)
+{
+	shell_print(shell, "%-16s %10u %10u.%02u", name, cycles, cycles / samples,
+		    (uint32_t)((uint64_t)(cycles % samples) * 100 / samples));
+}
+
+static int cmd_sensors_bench(const struct shell *shell, size_t argc, char **argv)
+{
+	uint32_t samples = SENSORS_BENCH_DEFAULT_SAMPLES;
+
+	if (argc > 1) {
+		int err = 0;
+
+		samples = (uint32_t)shell_strtoul(argv[1], 10, &err);
+		if (err || !samples) {
+			shell_error(shell, "Invalid number of samples: %s", argv[1]);
+			return -EINVAL;
+		}
+	}
+
+	inputs_init();
+
+	shell_print(shell, "%u samples, minimum of %d runs, %u cycles/s", samples,
+		    SENSORS_BENCH_RUNS, sys_clock_hw_cycles_per_sec());
+	for (size_t i = 0; i < ARRAY_SIZE(bench_scales); i++) {
+		uint32_t double_cycles = UINT32_MAX;
+		uint32_t fixed_cycles = UINT32_MAX;
+		uint32_t fixed_to_double_cycles = UINT32_MAX;
+
+		bench_factor = bench_scales[i].factor;
+		bench_scale = sensor_fixed_scale_make(bench_scales[i].mul, bench_scales[i].div);
+
+		// interrupts are still served, so the minimum of a few runs is the least disturbed
+		for (int run = 0; run < SENSORS_BENCH_RUNS; run++) {
+			k_sched_lock();
+			double_cycles = MIN(double_cycles, bench_double(samples));
+			fixed_cycles = MIN(fixed_cycles, bench_fixed(samples));
+			fixed_to_double_cycles =
+				MIN(fixed_to_double_cycles, bench_fixed_to_double(samples));
+			k_sched_unlock();
+		}
+
+		shell_print(shell, "%s:", bench_scales[i].name);
+		shell_print(shell, "%-16s %10s %13s", "conversion", "cycles", "cycles/sample");
+		print_result(shell, "double", double_cycles, samples);
+		print_result(shell, "fixed", fixed_cycles, samples);
+		print_result(shell, "fixed+to_double", fixed_to_double_cycles, samples);
+	}
+	return 0;
+}
+
+SHELL_CMD_ARG_REGISTER(sensors_bench, NULL,
+		       "Measure the cost of converting sensor values [samples]",
+		       cmd_sensors_bench, 1, 1);
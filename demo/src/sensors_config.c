@@ -15,142 +15,656 @@
  */
 #include <math.h>
 
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/logging/log.h>
+
+#include <anjay/ipso_objects.h>
+
 #include "sensors_config.h"
+#include "sensors_fetch.h"
+#ifdef CONFIG_APP_SENSORS_DEADBAND
+#include "sensors_filter.h"
+#endif // CONFIG_APP_SENSORS_DEADBAND
+#include "sensors_fixed.h"
+#ifdef CONFIG_APP_SENSORS_STATS
+#include "sensors_stats.h"
+#endif // CONFIG_APP_SENSORS_STATS
+#ifdef CONFIG_APP_SENSORS_STREAMING
+#include "sensors_stream.h"
+#endif // CONFIG_APP_SENSORS_STREAMING
 #include "peripherals.h"
+#include "telemetry.h"
+
+LOG_MODULE_REGISTER(sensors_config);
+
+#define KPA_TO_PA_SCALE SENSOR_FIXED_SCALE(1000, 1)
+#define GAUSS_TO_TESLA_SCALE SENSOR_FIXED_SCALE(1, 10000)
+
+/**
+ * Sensor Value: R, Single, Mandatory
+ * type: float, range: N/A, unit: N/A
+ * Last or Current Measured Value from the Sensor.
+ */
+#define RID_SENSOR_VALUE 5700
+
+/**
+ * X Value: R, Single, Mandatory
+ * type: float, range: N/A, unit: N/A
+ * The measured value along the X axis.
+ */
+#define RID_X_VALUE 5702
+
+/**
+ * Y Value: R, Single, Optional
+ * type: float, range: N/A, unit: N/A
+ * The measured value along the Y axis.
+ */
+#define RID_Y_VALUE 5703
+
+/**
+ * Z Value: R, Single, Optional
+ * type: float, range: N/A, unit: N/A
+ * The measured value along the Z axis.
+ */
+#define RID_Z_VALUE 5704
+
+struct sensor_instance {
+	// scale_factor of def is not used, see scale
+	struct anjay_zephyr_ipso_sensor_context def;
+	struct sensor_fixed_scale scale;
+	// set by sensors_prepare()
+	bool ready;
+	bool installed;
+	// last sampling (or observation check) and the period it was scheduled with
+	avs_time_monotonic_t last_update;
+	avs_time_duration_t period;
+	avs_time_monotonic_t next_update;
+	// used with CONFIG_APP_SENSORS_DEADBAND, unless the server set another one
+	float default_deadband;
+#ifdef CONFIG_APP_SENSORS_DEADBAND
+	struct sensors_filter filter;
+#endif // CONFIG_APP_SENSORS_DEADBAND
+#ifdef CONFIG_APP_SENSORS_STATS
+	struct sensors_stats_window stats;
+#endif // CONFIG_APP_SENSORS_STATS
+#ifdef CONFIG_APP_SENSORS_STREAMING
+	struct sensor_stream stream;
+#endif // CONFIG_APP_SENSORS_STREAMING
+};
+
+struct sensor_oid_set {
+	anjay_oid_t oid;
+	struct sensor_instance *instances;
+	size_t instances_count;
+};
 
-#define KPA_TO_PA_FACTOR 1e3
-#define GAUSS_TO_TESLA_FACTOR 1e-4
+#define SENSOR_OID_SET(Oid, Instances)                                                             \
+	{ .oid = (Oid), .instances = (Instances), .instances_count = AVS_ARRAY_SIZE(Instances) }
 
-static struct anjay_zephyr_ipso_sensor_context illuminance_sensor_def[] = {
+static struct sensor_instance illuminance_sensor_def[] = {
 #if ILLUMINANCE_AVAILABLE
-	{ .name = "Illuminance",
-	  .unit = "lx",
-	  .device = DEVICE_DT_GET(ILLUMINANCE_NODE),
-	  .channel = SENSOR_CHAN_LIGHT,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Illuminance",
+		   .unit = "lx",
+		   .device = DEVICE_DT_GET(ILLUMINANCE_NODE),
+		   .channel = SENSOR_CHAN_LIGHT,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN },
+	  .default_deadband = 1.0f }
 #endif // ILLUMINANCE_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_context temperature_sensor_def[] = {
+static struct sensor_instance temperature_sensor_def[] = {
 #if TEMPERATURE_AVAILABLE
-	{ .name = "Temperature",
-	  .unit = "Cel",
-	  .device = DEVICE_DT_GET(TEMPERATURE_NODE),
-	  .channel = SENSOR_CHAN_AMBIENT_TEMP,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Temperature",
+		   .unit = "Cel",
+		   .device = DEVICE_DT_GET(TEMPERATURE_NODE),
+		   .channel = SENSOR_CHAN_AMBIENT_TEMP,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN } }
 #endif // TEMPERATURE_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_context humidity_sensor_def[] = {
+static struct sensor_instance humidity_sensor_def[] = {
 #if HUMIDITY_AVAILABLE
-	{ .name = "Humidity",
-	  .unit = "%RH",
-	  .device = DEVICE_DT_GET(HUMIDITY_NODE),
-	  .channel = SENSOR_CHAN_HUMIDITY,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Humidity",
+		   .unit = "%RH",
+		   .device = DEVICE_DT_GET(HUMIDITY_NODE),
+		   .channel = SENSOR_CHAN_HUMIDITY,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN },
+	  .default_deadband = 0.5f }
 #endif // HUMIDITY_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_context acceleration_sensor_def[] = {
+static struct sensor_instance acceleration_sensor_def[] = {
 #if ACCELEROMETER_AVAILABLE
-	{ .name = "Accelerometer",
-	  .unit = "m/s2",
-	  .device = DEVICE_DT_GET(ACCELEROMETER_NODE),
-	  .channel = SENSOR_CHAN_ACCEL_XYZ,
-	  .use_y_value = true,
-	  .use_z_value = true,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Accelerometer",
+		   .unit = "m/s2",
+		   .device = DEVICE_DT_GET(ACCELEROMETER_NODE),
+		   .channel = SENSOR_CHAN_ACCEL_XYZ,
+		   .use_y_value = true,
+		   .use_z_value = true,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN } }
 #endif // ACCELEROMETER_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_context magnetic_field_sensor_def[] = {
+static struct sensor_instance magnetic_field_sensor_def[] = {
 #if MAGNETOMETER_AVAILABLE
-	{ .name = "Magnetometer",
-	  .unit = "T",
-	  .device = DEVICE_DT_GET(MAGNETOMETER_NODE),
-	  .channel = SENSOR_CHAN_MAGN_XYZ,
-	  .scale_factor = GAUSS_TO_TESLA_FACTOR,
-	  .use_y_value = true,
-	  .use_z_value = true,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Magnetometer",
+		   .unit = "T",
+		   .device = DEVICE_DT_GET(MAGNETOMETER_NODE),
+		   .channel = SENSOR_CHAN_MAGN_XYZ,
+		   .use_y_value = true,
+		   .use_z_value = true,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN },
+	  .scale = GAUSS_TO_TESLA_SCALE }
 #endif // MAGNETOMETER_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_context pressure_sensor_def[] = {
+static struct sensor_instance pressure_sensor_def[] = {
 #if BAROMETER_AVAILABLE
-	{ .name = "Barometer",
-	  .unit = "Pa",
-	  .device = DEVICE_DT_GET(BAROMETER_NODE),
-	  .channel = SENSOR_CHAN_PRESS,
-	  .scale_factor = KPA_TO_PA_FACTOR,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Barometer",
+		   .unit = "Pa",
+		   .device = DEVICE_DT_GET(BAROMETER_NODE),
+		   .channel = SENSOR_CHAN_PRESS,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN },
+	  .scale = KPA_TO_PA_SCALE,
+	  .default_deadband = 10.0f }
 #endif // BAROMETER_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_context distance_sensor_def[] = {
+static struct sensor_instance distance_sensor_def[] = {
 #if DISTANCE_AVAILABLE
-	{ .name = "Distance",
-	  .unit = "m",
-	  .device = DEVICE_DT_GET(DISTANCE_NODE),
-	  .channel = SENSOR_CHAN_DISTANCE,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Distance",
+		   .unit = "m",
+		   .device = DEVICE_DT_GET(DISTANCE_NODE),
+		   .channel = SENSOR_CHAN_DISTANCE,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN } }
 #endif // DISTANCE_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_context angular_rate_sensor_def[] = {
+static struct sensor_instance angular_rate_sensor_def[] = {
 #if GYROMETER_AVAILABLE
-	{ .name = "Gyrometer",
-	  .unit = "deg/s",
-	  .device = DEVICE_DT_GET(GYROMETER_NODE),
-	  .channel = SENSOR_CHAN_GYRO_XYZ,
-	  .use_y_value = true,
-	  .use_z_value = true,
-	  .min_range_value = NAN,
-	  .max_range_value = NAN }
+	{ .def = { .name = "Gyrometer",
+		   .unit = "deg/s",
+		   .device = DEVICE_DT_GET(GYROMETER_NODE),
+		   .channel = SENSOR_CHAN_GYRO_XYZ,
+		   .use_y_value = true,
+		   .use_z_value = true,
+		   .min_range_value = NAN,
+		   .max_range_value = NAN } }
 #endif // GYROMETER_AVAILABLE
 };
 
-static struct anjay_zephyr_ipso_sensor_oid_set sensors_basic_oid_def[] = {
-	{ .user_sensors = illuminance_sensor_def,
-	  .oid = 3301,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(illuminance_sensor_def) },
-	{ .user_sensors = temperature_sensor_def,
-	  .oid = 3303,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(temperature_sensor_def) },
-	{ .user_sensors = humidity_sensor_def,
-	  .oid = 3304,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(humidity_sensor_def) },
-	{ .user_sensors = pressure_sensor_def,
-	  .oid = 3315,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(pressure_sensor_def) },
-	{ .user_sensors = distance_sensor_def,
-	  .oid = 3330,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(distance_sensor_def) }
+static struct sensor_oid_set sensors_basic_oid_def[] = {
+	SENSOR_OID_SET(3301, illuminance_sensor_def),
+	SENSOR_OID_SET(3303, temperature_sensor_def),
+	SENSOR_OID_SET(3304, humidity_sensor_def),
+	SENSOR_OID_SET(3315, pressure_sensor_def),
+	SENSOR_OID_SET(3330, distance_sensor_def),
 };
 
-static struct anjay_zephyr_ipso_sensor_oid_set sensors_3d_oid_def[] = {
-	{ .user_sensors = acceleration_sensor_def,
-	  .oid = 3313,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(acceleration_sensor_def) },
-	{ .user_sensors = magnetic_field_sensor_def,
-	  .oid = 3314,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(magnetic_field_sensor_def) },
-	{ .user_sensors = angular_rate_sensor_def,
-	  .oid = 3334,
-	  .user_sensors_array_length = AVS_ARRAY_SIZE(angular_rate_sensor_def) }
+static struct sensor_oid_set sensors_3d_oid_def[] = {
+	SENSOR_OID_SET(3313, acceleration_sensor_def),
+	SENSOR_OID_SET(3314, magnetic_field_sensor_def),
+	SENSOR_OID_SET(3334, angular_rate_sensor_def),
 };
 
+static const anjay_rid_t basic_sensor_value_rids[] = { RID_SENSOR_VALUE };
+static const anjay_rid_t three_axis_sensor_value_rids[] = { RID_X_VALUE, RID_Y_VALUE, RID_Z_VALUE };
+
+static int fetch_values(const struct anjay_zephyr_ipso_sensor_context *def,
+			struct sensor_value *out_values)
+{
+	if (sensors_fetch_get(def->device, def->channel, out_values)) {
+		LOG_ERR("Failed to read from %s", def->device->name);
+		return -1;
+	}
+	return 0;
+}
+
+static int read_basic_sensor(void *_inst, int64_t *out_value)
+{
+	const struct sensor_instance *inst = _inst;
+	struct sensor_value value;
+
+	if (fetch_values(&inst->def, &value)) {
+		return -1;
+	}
+
+	*out_value = sensor_fixed_scale(sensor_fixed_from_value(&value), inst->scale);
+	return 0;
+}
+
+static int basic_sensor_get_fixed(struct sensor_instance *inst, int64_t *out_value)
+{
+#ifdef CONFIG_APP_SENSORS_STATS
+	// the sensor is read directly only if it could not be added to the statistics
+	if (!sensors_stats_latest(&inst->stats, out_value)) {
+		return 0;
+	}
+#endif // CONFIG_APP_SENSORS_STATS
+
+	return read_basic_sensor(inst, out_value);
+}
+
+static int read_three_axis_sensor(struct sensor_instance *inst, int64_t *out_micro)
+{
+#ifdef CONFIG_APP_SENSORS_STREAMING
+	// until the first sample is acquired, fall through to a direct read
+	if (!sensor_stream_get(&inst->stream, out_micro)) {
+		return 0;
+	}
+#endif // CONFIG_APP_SENSORS_STREAMING
+
+	struct sensor_value values[3];
+
+	if (fetch_values(&inst->def, values)) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		out_micro[i] = sensor_fixed_from_value(&values[i]);
+	}
+	return 0;
+}
+
+static int three_axis_sensor_get_fixed(struct sensor_instance *inst, int64_t *out_values)
+{
+	int64_t micro[3];
+
+	if (read_three_axis_sensor(inst, micro)) {
+		return -1;
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		out_values[i] = sensor_fixed_scale(micro[i], inst->scale);
+	}
+	return 0;
+}
+
+/* Only the values seen by the IPSO objects are filtered, telemetry gets the raw ones. */
+static int basic_sensor_get_value(anjay_iid_t iid, void *_def, double *out_value)
+{
+	(void)iid;
+
+	struct sensor_instance *inst = AVS_CONTAINER_OF(_def, struct sensor_instance, def);
+	int64_t value;
+
+	if (basic_sensor_get_fixed(inst, &value)) {
+		return -1;
+	}
+
+#ifdef CONFIG_APP_SENSORS_DEADBAND
+	sensors_filter_apply(&inst->filter, &value, 1);
+#endif // CONFIG_APP_SENSORS_DEADBAND
+	*out_value = sensor_fixed_to_double(value);
+	return 0;
+}
+
+static int three_axis_sensor_get_values(anjay_iid_t iid, void *_def, double *out_x, double *out_y,
+					double *out_z)
+{
+	(void)iid;
+
+	struct sensor_instance *inst = AVS_CONTAINER_OF(_def, struct sensor_instance, def);
+	int64_t values[3];
+
+	if (three_axis_sensor_get_fixed(inst, values)) {
+		return -1;
+	}
+
+#ifdef CONFIG_APP_SENSORS_DEADBAND
+	sensors_filter_apply(&inst->filter, values,
+			     inst->def.use_z_value ? 3 : inst->def.use_y_value ? 2 : 1);
+#endif // CONFIG_APP_SENSORS_DEADBAND
+	*out_x = sensor_fixed_to_double(values[0]);
+	*out_y = sensor_fixed_to_double(values[1]);
+	*out_z = sensor_fixed_to_double(values[2]);
+	return 0;
+}
+
+static int install_instance(anjay_t *anjay, anjay_oid_t oid, anjay_iid_t iid,
+			    struct sensor_instance *inst, bool three_axis)
+{
+	struct anjay_zephyr_ipso_sensor_context *def = &inst->def;
+
+	if (!inst->ready) {
+		return -1;
+	}
+
+#ifdef CONFIG_APP_SENSORS_DEADBAND
+	// without a filter slot, the values are reported unfiltered
+	if (sensors_filter_add(&inst->filter, oid, iid, inst->default_deadband)) {
+		inst->filter.deadband = 0.0f;
+		inst->filter.deadband_fixed = 0;
+		inst->filter.has_reported = false;
+	}
+#endif // CONFIG_APP_SENSORS_DEADBAND
+
+	if (three_axis) {
+#ifdef CONFIG_APP_SENSORS_STREAMING
+		// on failure, the sensor is still read directly from the Anjay thread
+		sensor_stream_start(&inst->stream, def->device, def->channel);
+#endif // CONFIG_APP_SENSORS_STREAMING
+		return anjay_ipso_3d_sensor_instance_add(
+			anjay, oid, iid,
+			(anjay_ipso_3d_sensor_impl_t){ .unit = def->unit,
+						       .use_y_value = def->use_y_value,
+						       .use_z_value = def->use_z_value,
+						       .user_context = def,
+						       .min_range_value = def->min_range_value,
+						       .max_range_value = def->max_range_value,
+						       .get_values = three_axis_sensor_get_values });
+	}
+
+	int result = anjay_ipso_basic_sensor_instance_add(
+		anjay, oid, iid,
+		(anjay_ipso_basic_sensor_impl_t){ .unit = def->unit,
+						  .user_context = def,
+						  .min_range_value = def->min_range_value,
+						  .max_range_value = def->max_range_value,
+						  .get_value = basic_sensor_get_value });
+
+#ifdef CONFIG_APP_SENSORS_STATS
+	if (!result) {
+		sensors_stats_add(&inst->stats, oid, iid, read_basic_sensor, inst);
+	}
+#endif // CONFIG_APP_SENSORS_STATS
+	return result;
+}
+
+#ifdef CONFIG_APP_TELEMETRY
+static int telemetry_read_basic(anjay_iid_t iid, void *_inst, double *out_values)
+{
+	(void)iid;
+
+	int64_t value;
+
+	if (basic_sensor_get_fixed(_inst, &value)) {
+		return -1;
+	}
+
+	out_values[0] = sensor_fixed_to_double(value);
+	return 0;
+}
+
+static int telemetry_read_3d(anjay_iid_t iid, void *_inst, double *out_values)
+{
+	(void)iid;
+
+	const struct sensor_instance *inst = _inst;
+	int64_t values[3];
+	size_t count = 0;
+
+	if (three_axis_sensor_get_fixed(_inst, values)) {
+		return -1;
+	}
+
+	out_values[count++] = sensor_fixed_to_double(values[0]);
+	if (inst->def.use_y_value) {
+		out_values[count++] = sensor_fixed_to_double(values[1]);
+	}
+	if (inst->def.use_z_value) {
+		out_values[count++] = sensor_fixed_to_double(values[2]);
+	}
+	return 0;
+}
+
+static void telemetry_sources_add(anjay_oid_t oid, anjay_iid_t iid, struct sensor_instance *inst,
+				  bool three_axis)
+{
+	const struct anjay_zephyr_ipso_sensor_context *def = &inst->def;
+
+	if (!three_axis) {
+		telemetry_source_add(oid, iid, basic_sensor_value_rids,
+				     AVS_ARRAY_SIZE(basic_sensor_value_rids), false,
+				     telemetry_read_basic, inst);
+		return;
+	}
+
+	anjay_rid_t rids[TELEMETRY_SOURCE_MAX_RIDS];
+	size_t rids_count = 0;
+
+	rids[rids_count++] = RID_X_VALUE;
+	if (def->use_y_value) {
+		rids[rids_count++] = RID_Y_VALUE;
+	}
+	if (def->use_z_value) {
+		rids[rids_count++] = RID_Z_VALUE;
+	}
+	telemetry_source_add(oid, iid, rids, rids_count, false, telemetry_read_3d, inst);
+}
+#endif // CONFIG_APP_TELEMETRY
+
+static void install_oid_sets(anjay_t *anjay, struct sensor_oid_set *sets, size_t sets_count,
+			     bool three_axis)
+{
+	for (size_t i = 0; i < sets_count; i++) {
+		struct sensor_oid_set *set = &sets[i];
+
+		if (set->instances_count == 0) {
+			continue;
+		}
+
+		if (three_axis ?
+			    anjay_ipso_3d_sensor_install(anjay, set->oid, set->instances_count) :
+			    anjay_ipso_basic_sensor_install(anjay, set->oid, set->instances_count)) {
+			LOG_ERR("Could not install object /%u", set->oid);
+			continue;
+		}
+
+		for (size_t j = 0; j < set->instances_count; j++) {
+			struct sensor_instance *inst = &set->instances[j];
+
+			inst->installed =
+				!install_instance(anjay, set->oid, (anjay_iid_t)j, inst, three_axis);
+			inst->last_update = AVS_TIME_MONOTONIC_INVALID;
+			inst->period = AVS_TIME_DURATION_INVALID;
+			inst->next_update = AVS_TIME_MONOTONIC_INVALID;
+#ifdef CONFIG_APP_TELEMETRY
+			if (inst->installed) {
+				telemetry_sources_add(set->oid, (anjay_iid_t)j, inst, three_axis);
+			}
+#endif // CONFIG_APP_TELEMETRY
+		}
+	}
+}
+
+/**
+ * Derives the sampling period from the attributes of all observations of the
+ * sensor's value resources: the sensor is sampled at least once per the
+ * smallest epmax, falling back to CONFIG_APP_REFRESH_SENSORS_PERIOD, but never
+ * more often than the smallest pmin requires.
+ *
+ * Returns an invalid duration if the sensor is not observed.
+ */
+static avs_time_duration_t sampling_period(anjay_t *anjay, anjay_oid_t oid, anjay_iid_t iid,
+					   bool three_axis)
+{
+	const anjay_rid_t *rids =
+		three_axis ? three_axis_sensor_value_rids : basic_sensor_value_rids;
+	size_t rids_count = three_axis ? AVS_ARRAY_SIZE(three_axis_sensor_value_rids) :
+					 AVS_ARRAY_SIZE(basic_sensor_value_rids);
+	bool observed = false;
+	int32_t min_period = 0;
+	int32_t max_eval_period = ANJAY_ATTRIB_INTEGER_NONE;
+
+	for (size_t i = 0; i < rids_count; i++) {
+		anjay_resource_observation_status_t status =
+			anjay_resource_observation_status(anjay, oid, iid, rids[i]);
+
+		if (!status.is_observed) {
+			continue;
+		}
+
+		if (!observed || status.min_period < min_period) {
+			min_period = status.min_period;
+		}
+		if (status.max_eval_period != ANJAY_ATTRIB_INTEGER_NONE &&
+		    (max_eval_period == ANJAY_ATTRIB_INTEGER_NONE ||
+		     status.max_eval_period < max_eval_period)) {
+			max_eval_period = status.max_eval_period;
+		}
+		observed = true;
+	}
+
+	if (!observed) {
+		return AVS_TIME_DURATION_INVALID;
+	}
+
+	int64_t period_ms = (max_eval_period != ANJAY_ATTRIB_INTEGER_NONE ?
+				     max_eval_period :
+				     CONFIG_APP_REFRESH_SENSORS_PERIOD) *
+			    INT64_C(1000);
+
+	period_ms = AVS_MAX(period_ms, AVS_MAX(min_period, 0) * INT64_C(1000));
+	period_ms = AVS_MAX(period_ms, CONFIG_APP_SENSORS_MIN_PERIOD_MS);
+
+	return avs_time_duration_from_scalar(period_ms, AVS_TIME_MS);
+}
+
+/*
+ * Anjay reports no changes of observations or their attributes, and the IPSO
+ * objects serve cached values, so reads from the LwM2M Server do not reach
+ * this code either. The observation status of sensors that are not due yet is
+ * therefore checked on each pass, which is cheap as no sensor is read, and
+ * their deadline is moved if the sampling period changed.
+ */
+static void update_oid_sets(anjay_t *anjay, struct sensor_oid_set *sets, size_t sets_count,
+			    bool three_axis, avs_time_monotonic_t now, avs_time_monotonic_t due,
+			    avs_time_monotonic_t *inout_next_update, bool *out_observed)
+{
+	for (size_t i = 0; i < sets_count; i++) {
+		struct sensor_oid_set *set = &sets[i];
+
+		for (size_t j = 0; j < set->instances_count; j++) {
+			struct sensor_instance *inst = &set->instances[j];
+
+			if (!inst->installed) {
+				continue;
+			}
+
+			avs_time_duration_t period =
+				sampling_period(anjay, set->oid, (anjay_iid_t)j, three_axis);
+
+			if (avs_time_duration_valid(period)) {
+				*out_observed = true;
+			}
+
+			bool due_now = !avs_time_monotonic_valid(inst->next_update) ||
+				       !avs_time_monotonic_before(due, inst->next_update);
+
+			if (due_now) {
+				if (avs_time_duration_valid(period)) {
+					if (three_axis) {
+						anjay_ipso_3d_sensor_update(anjay, set->oid,
+									    (anjay_iid_t)j);
+					} else {
+						anjay_ipso_basic_sensor_update(anjay, set->oid,
+									       (anjay_iid_t)j);
+					}
+				}
+				inst->last_update = now;
+			}
+
+			// also when observed, cancelled or given new attributes meanwhile
+			if (due_now || !avs_time_duration_equal(period, inst->period)) {
+				inst->period = period;
+				if (!avs_time_duration_valid(period)) {
+					// not observed - only check again for new observations
+					period = avs_time_duration_from_scalar(
+						CONFIG_APP_SENSORS_IDLE_CHECK_PERIOD, AVS_TIME_S);
+				}
+				inst->next_update =
+					avs_time_monotonic_add(inst->last_update, period);
+				if (avs_time_monotonic_before(inst->next_update, now)) {
+					inst->next_update = now;
+				}
+			}
+
+			if (!avs_time_monotonic_valid(*inout_next_update) ||
+			    avs_time_monotonic_before(inst->next_update, *inout_next_update)) {
+				*inout_next_update = inst->next_update;
+			}
+		}
+	}
+}
+
+static void prepare_oid_sets(struct sensor_oid_set *sets, size_t sets_count)
+{
+	for (size_t i = 0; i < sets_count; i++) {
+		for (size_t j = 0; j < sets[i].instances_count; j++) {
+			struct sensor_instance *inst = &sets[i].instances[j];
+
+			inst->ready = device_is_ready(inst->def.device);
+			if (!inst->ready) {
+				LOG_WRN("%s sensor is not ready", inst->def.name);
+			}
+		}
+	}
+}
+
+void sensors_prepare(void)
+{
+	prepare_oid_sets(sensors_basic_oid_def, AVS_ARRAY_SIZE(sensors_basic_oid_def));
+	prepare_oid_sets(sensors_3d_oid_def, AVS_ARRAY_SIZE(sensors_3d_oid_def));
+}
+
 void sensors_install(anjay_t *anjay)
 {
-	anjay_zephyr_ipso_basic_sensors_install(anjay, sensors_basic_oid_def,
-						AVS_ARRAY_SIZE(sensors_basic_oid_def));
-	anjay_zephyr_ipso_three_axis_sensors_install(anjay, sensors_3d_oid_def,
-						     AVS_ARRAY_SIZE(sensors_3d_oid_def));
+#ifdef CONFIG_APP_SENSORS_DEADBAND
+	sensors_filter_reset();
+#endif // CONFIG_APP_SENSORS_DEADBAND
+#ifdef CONFIG_APP_SENSORS_STATS
+	sensors_stats_reset();
+#endif // CONFIG_APP_SENSORS_STATS
+	install_oid_sets(anjay, sensors_basic_oid_def, AVS_ARRAY_SIZE(sensors_basic_oid_def), false);
+	install_oid_sets(anjay, sensors_3d_oid_def, AVS_ARRAY_SIZE(sensors_3d_oid_def), true);
+#ifdef CONFIG_APP_SENSORS_STATS
+	sensors_stats_object_install(anjay);
+#endif // CONFIG_APP_SENSORS_STATS
+#ifdef CONFIG_APP_SENSORS_DEADBAND
+	sensors_filter_object_install(anjay);
+#endif // CONFIG_APP_SENSORS_DEADBAND
+}
+
+avs_time_monotonic_t sensors_update(anjay_t *anjay)
+{
+	avs_time_monotonic_t now = avs_time_monotonic_now();
+	/*
+	 * Sensors due within the age of a shared sample are sampled now as well,
+	 * so that those on one device share a fetch even if their deadlines
+	 * differ slightly, rather than each waking up the thread and the bus.
+	 */
+	avs_time_monotonic_t due = avs_time_monotonic_add(
+		now,
+		avs_time_duration_from_scalar(CONFIG_APP_SENSORS_FETCH_MAX_AGE_MS, AVS_TIME_MS));
+	avs_time_monotonic_t next_update = AVS_TIME_MONOTONIC_INVALID;
+	bool observed = false;
+
+	update_oid_sets(anjay, sensors_basic_oid_def, AVS_ARRAY_SIZE(sensors_basic_oid_def), false,
+			now, due, &next_update, &observed);
+	update_oid_sets(anjay, sensors_3d_oid_def, AVS_ARRAY_SIZE(sensors_3d_oid_def), true, now,
+			due, &next_update, &observed);
+
+	if (observed) {
+		/*
+		 * The LwM2M Server is active, so changes of observations are more
+		 * likely: check for them more often than for an idle client.
+		 */
+		avs_time_duration_t check_period = avs_time_duration_from_scalar(
+			CONFIG_APP_SENSORS_OBSERVATION_CHECK_PERIOD, AVS_TIME_S);
+		avs_time_monotonic_t check = avs_time_monotonic_add(now, check_period);
+
+		if (avs_time_monotonic_before(check, next_update)) {
+			next_update = check;
+		}
+	}
+
+	return next_update;
 }
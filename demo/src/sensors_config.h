@@ -18,4 +18,16 @@
 
 #include <anjay_zephyr/ipso_objects.h>
 
+/**
+ * Checks which sensor devices are ready. Must be called once before the first
+ * @ref sensors_install, and may be called from another thread.
+ */
+void sensors_prepare(void);
+
 void sensors_install(anjay_t *anjay);
+
+/**
+ * Samples the sensors that are due and returns the instant at which the next
+ * one will be.
+ */
+avs_time_monotonic_t sensors_update(anjay_t *anjay);
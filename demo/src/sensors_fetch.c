@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "sensors_fetch.h"
+
+LOG_MODULE_REGISTER(sensors_fetch);
+
+/* one device per IPSO sensor of the demo at most */
+#define SENSORS_FETCH_MAX_DEVICES 8
+
+struct fetched_device {
+	const struct device *device;
+	// serializes the fetch and the reads of the driver's sample buffer
+	struct k_mutex mutex;
+	bool fetched;
+	int64_t fetched_at_ms;
+};
+
+static K_MUTEX_DEFINE(devices_mutex);
+static struct fetched_device devices[SENSORS_FETCH_MAX_DEVICES];
+static size_t devices_count;
+
+static struct fetched_device *device_find_or_add(const struct device *device)
+{
+	struct fetched_device *result = NULL;
+
+	k_mutex_lock(&devices_mutex, K_FOREVER);
+	for (size_t i = 0; i < devices_count; i++) {
+		if (devices[i].device == device) {
+			result = &devices[i];
+			break;
+		}
+	}
+	if (!result && devices_count < SENSORS_FETCH_MAX_DEVICES) {
+		result = &devices[devices_count++];
+		result->device = device;
+		result->fetched = false;
+		k_mutex_init(&result->mutex);
+	}
+	k_mutex_unlock(&devices_mutex);
+
+	return result;
+}
+
+static int fetch_get(const struct device *device, enum sensor_channel channel,
+		     struct sensor_value *out_values, bool force)
+{
+	struct fetched_device *fetched = device_find_or_add(device);
+
+	if (!fetched) {
+		LOG_WRN("Too many sensor devices, %s is fetched separately", device->name);
+		if (sensor_sample_fetch(device)) {
+			return -EIO;
+		}
+		return sensor_channel_get(device, channel, out_values) ? -EIO : 0;
+	}
+
+	int result = 0;
+
+	k_mutex_lock(&fetched->mutex, K_FOREVER);
+	if (force || !fetched->fetched ||
+	    k_uptime_get() - fetched->fetched_at_ms >= CONFIG_APP_SENSORS_FETCH_MAX_AGE_MS) {
+		fetched->fetched = !sensor_sample_fetch(device);
+		// the age counts from when the sample is complete
+		fetched->fetched_at_ms = k_uptime_get();
+	}
+	if (!fetched->fetched || sensor_channel_get(device, channel, out_values)) {
+		result = -EIO;
+	}
+	k_mutex_unlock(&fetched->mutex);
+
+	return result;
+}
+
+int sensors_fetch_get(const struct device *device, enum sensor_channel channel,
+		      struct sensor_value *out_values)
+{
+	return fetch_get(device, channel, out_values, false);
+}
+
+int sensors_fetch_new(const struct device *device, enum sensor_channel channel,
+		      struct sensor_value *out_values)
+{
+	return fetch_get(device, channel, out_values, true);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/sensor.h>
+
+/**
+ * Reads @p channel of @p device from a sample shared by all channels of the
+ * device: a new sample is only fetched if the previous one is older than
+ * CONFIG_APP_SENSORS_FETCH_MAX_AGE_MS. A single pass over the sensors thus
+ * fetches each device once, however many IPSO objects it backs, and reads
+ * all of them from the same moment.
+ *
+ * Safe to call from multiple threads, but not from interrupt context.
+ */
+int sensors_fetch_get(const struct device *device, enum sensor_channel channel,
+		      struct sensor_value *out_values);
+
+/**
+ * Same as sensors_fetch_get(), but always fetches a new sample, e.g. when the
+ * data ready trigger of @p device announces one. The other channels of the
+ * device are then read from that sample, as with any other fetch.
+ *
+ * Safe to call from sensor trigger handlers, which run in a thread, but not
+ * from interrupt context.
+ */
+int sensors_fetch_new(const struct device *device, enum sensor_channel channel,
+		      struct sensor_value *out_values);
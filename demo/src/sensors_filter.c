@@ -0,0 +1,259 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <zephyr/logging/log.h>
+#include <zephyr/settings/settings.h>
+
+#include <anjay/anjay.h>
+
+#include "sensors_filter.h"
+#include "sensors_fixed.h"
+
+LOG_MODULE_REGISTER(sensors_filter);
+
+/* one filter per IPSO sensor of the demo */
+#define SENSORS_FILTER_MAX_FILTERS 8
+
+#define SETTINGS_KEY_FORMAT "app/deadband/%u/%u"
+#define SETTINGS_KEY_MAX_LEN sizeof("app/deadband/65535/65535")
+
+/**
+ * Sensor Deadband: custom object in the private range, one instance per
+ * filtered sensor
+ */
+#define OID_SENSOR_DEADBAND 26244
+
+/**
+ * Sensor: R, Single, Mandatory
+ * type: objlnk, range: N/A, unit: N/A
+ * IPSO sensor object instance whose values are filtered.
+ */
+#define RID_SENSOR 0
+
+/**
+ * Deadband: RW, Single, Mandatory
+ * type: float, range: 0.., unit: unit of the sensor
+ * Smallest change of the sensor value that is reported. Smaller changes
+ * are neither visible in reads nor notified. 0 disables the filter. Kept
+ * across reboots.
+ */
+#define RID_DEADBAND 1
+
+static struct sensors_filter *filters[SENSORS_FILTER_MAX_FILTERS];
+static size_t filters_count;
+
+static void set_deadband(struct sensors_filter *filter, float deadband)
+{
+	filter->deadband = deadband;
+	filter->deadband_fixed = sensor_fixed_from_float(deadband);
+}
+
+static void settings_key(char *out_key, const struct sensors_filter *filter)
+{
+	snprintf(out_key, SETTINGS_KEY_MAX_LEN, SETTINGS_KEY_FORMAT, filter->oid, filter->iid);
+}
+
+static int load_deadband(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+			 void *param)
+{
+	struct sensors_filter *filter = param;
+	float deadband;
+
+	if (key && *key) {
+		// a longer key that merely starts with the one of the filter
+		return 0;
+	}
+	if (len != sizeof(deadband) || read_cb(cb_arg, &deadband, sizeof(deadband)) < 0 ||
+	    !(deadband >= 0.0f)) {
+		LOG_WRN("Ignoring invalid deadband of /%u/%u", filter->oid, filter->iid);
+		return 0;
+	}
+	set_deadband(filter, deadband);
+	return 0;
+}
+
+int sensors_filter_add(struct sensors_filter *filter, anjay_oid_t oid, anjay_iid_t iid,
+		       float default_deadband)
+{
+	if (filters_count >= SENSORS_FILTER_MAX_FILTERS) {
+		LOG_ERR("Too many sensor filters");
+		return -ENOMEM;
+	}
+
+	filter->oid = oid;
+	filter->iid = iid;
+	set_deadband(filter, default_deadband);
+	filter->has_reported = false;
+
+	char key[SETTINGS_KEY_MAX_LEN];
+
+	settings_key(key, filter);
+	if (settings_subsys_init() || settings_load_subtree_direct(key, load_deadband, filter)) {
+		LOG_WRN("Could not load the deadband of /%u/%u", oid, iid);
+	}
+
+	filters[filters_count++] = filter;
+	return 0;
+}
+
+void sensors_filter_apply(struct sensors_filter *filter, int64_t *values, size_t count)
+{
+	assert(count <= SENSORS_FILTER_MAX_VALUES);
+
+	if (filter->has_reported) {
+		bool changed = false;
+
+		for (size_t i = 0; i < count; i++) {
+			if (llabs(values[i] - filter->reported[i]) > filter->deadband_fixed) {
+				changed = true;
+				break;
+			}
+		}
+		if (!changed) {
+			for (size_t i = 0; i < count; i++) {
+				values[i] = filter->reported[i];
+			}
+			return;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		filter->reported[i] = values[i];
+	}
+	filter->has_reported = true;
+}
+
+void sensors_filter_reset(void)
+{
+	filters_count = 0;
+}
+
+static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	for (anjay_iid_t iid = 0; iid < filters_count; iid++) {
+		anjay_dm_emit(ctx, iid);
+	}
+	return 0;
+}
+
+static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+
+	anjay_dm_emit_res(ctx, RID_SENSOR, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_DEADBAND, ANJAY_DM_RES_RW, ANJAY_DM_RES_PRESENT);
+	return 0;
+}
+
+static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			 anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)riid;
+
+	assert(iid < filters_count);
+	assert(riid == ANJAY_ID_INVALID);
+	const struct sensors_filter *filter = filters[iid];
+
+	switch (rid) {
+	case RID_SENSOR:
+		return anjay_ret_objlnk(ctx, filter->oid, filter->iid);
+
+	case RID_DEADBAND:
+		return anjay_ret_float(ctx, filter->deadband);
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static int resource_write(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			  anjay_input_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)riid;
+
+	assert(iid < filters_count);
+	assert(riid == ANJAY_ID_INVALID);
+	struct sensors_filter *filter = filters[iid];
+
+	switch (rid) {
+	case RID_DEADBAND: {
+		float deadband;
+		int result = anjay_get_float(ctx, &deadband);
+
+		if (result) {
+			return result;
+		}
+		if (!(deadband >= 0.0f)) {
+			return ANJAY_ERR_BAD_REQUEST;
+		}
+
+		set_deadband(filter, deadband);
+		// the next value is compared against a fresh reference
+		filter->has_reported = false;
+
+		char key[SETTINGS_KEY_MAX_LEN];
+
+		settings_key(key, filter);
+		if (settings_save_one(key, &deadband, sizeof(deadband))) {
+			LOG_ERR("Could not persist the deadband of /%u/%u", filter->oid,
+				filter->iid);
+		}
+		return 0;
+	}
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = OID_SENSOR_DEADBAND,
+	.handlers = { .list_instances = list_instances,
+
+		      .list_resources = list_resources,
+		      .resource_read = resource_read,
+		      .resource_write = resource_write,
+
+		      .transaction_begin = anjay_dm_transaction_NOOP,
+		      .transaction_validate = anjay_dm_transaction_NOOP,
+		      .transaction_commit = anjay_dm_transaction_NOOP,
+		      .transaction_rollback = anjay_dm_transaction_NOOP }
+};
+
+static const anjay_dm_object_def_t *const OBJ_DEF_PTR = &OBJ_DEF;
+
+int sensors_filter_object_install(anjay_t *anjay)
+{
+	return anjay_register_object(anjay, &OBJ_DEF_PTR);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <anjay/anjay.h>
+
+#define SENSORS_FILTER_MAX_VALUES 3
+
+/**
+ * Deadband filter of the values reported by an IPSO sensor object instance.
+ * Accessed only from the Anjay thread.
+ */
+struct sensors_filter {
+	anjay_oid_t oid;
+	anjay_iid_t iid;
+	// 0 disables the filter
+	float deadband;
+	// deadband and values in billionths of the unit of the sensor, see sensors_fixed.h
+	int64_t deadband_fixed;
+	bool has_reported;
+	int64_t reported[SENSORS_FILTER_MAX_VALUES];
+};
+
+/**
+ * Sets up @p filter for an IPSO sensor object instance, with the deadband
+ * persisted for it, or @p default_deadband if none was.
+ */
+int sensors_filter_add(struct sensors_filter *filter, anjay_oid_t oid, anjay_iid_t iid,
+		       float default_deadband);
+
+/**
+ * Replaces @p values with the previously reported ones unless any of them
+ * moved away from its reported value by more than the deadband. In that
+ * case, @p values become the reported ones instead.
+ */
+void sensors_filter_apply(struct sensors_filter *filter, int64_t *values, size_t count);
+
+/**
+ * Forgets the filters added with @ref sensors_filter_add. Must be called before
+ * the filters are added again.
+ */
+void sensors_filter_reset(void);
+
+/**
+ * Registers the Sensor Deadband object, with one instance per filter.
+ */
+int sensors_filter_object_install(anjay_t *anjay);
@@ -0,0 +1,125 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zephyr/drivers/sensor.h>
+
+/**
+ * Sensor values are passed around as 64-bit integers: millionths of the unit
+ * of the driver, as in struct sensor_value, until they are scaled to the unit
+ * of the IPSO object, and billionths of that unit afterwards. The extra
+ * precision keeps scaling to a smaller unit (e.g. gauss to tesla) lossless.
+ * They are only converted to floating point when handed to Anjay, as the
+ * targets without a double precision FPU emulate double math in software.
+ */
+#define SENSOR_FIXED_MICRO INT64_C(1000000)
+#define SENSOR_FIXED_NANO INT64_C(1000000000)
+
+/**
+ * Ratio between the unit of the IPSO object and the unit of the driver, or
+ * another constant factor. An integer ratio is mul with a zero shift, and a
+ * ratio below 1 is mul / 2^shift, with mul of 31 bits rounded up. Either takes
+ * a few 32x32-bit multiplications to apply, unlike a 64-bit division, which is
+ * a slow library call on 32-bit targets. A zero initialized scale is the
+ * identity.
+ */
+struct sensor_fixed_scale {
+	uint32_t mul;
+	uint8_t shift;
+};
+
+/* 31 + floor(log2(Div / Mul)), for Div > Mul */
+#define _SENSOR_FIXED_SCALE_SHIFT(Mul, Div) (62 - __builtin_clz((Div) / (Mul) | 1))
+
+/* Mul / Div * 2^_SENSOR_FIXED_SCALE_SHIFT() rounded up, in (2^30, 2^31] */
+#define _SENSOR_FIXED_SCALE_MUL(Mul, Div)                                                          \
+	((uint32_t)((((uint64_t)(Mul) << _SENSOR_FIXED_SCALE_SHIFT(Mul, Div)) + (Div) - 1) / (Div)))
+
+/**
+ * Scale of Mul / Div, which must be either an integer or below 1. Constant if
+ * both arguments are, so that it can initialize a static variable.
+ */
+#define SENSOR_FIXED_SCALE(Mul, Div)                                                               \
+	{ .mul = (Mul) >= (Div) ? (Mul) / (Div) : _SENSOR_FIXED_SCALE_MUL(Mul, Div),               \
+	  .shift = (Mul) >= (Div) ? 0 : _SENSOR_FIXED_SCALE_SHIFT(Mul, Div) }
+
+/**
+ * Same as SENSOR_FIXED_SCALE() for values known at runtime. Divides, so it is
+ * meant to be called once and its result kept.
+ */
+static inline struct sensor_fixed_scale sensor_fixed_scale_make(uint32_t mul, uint32_t div)
+{
+	return (struct sensor_fixed_scale)SENSOR_FIXED_SCALE(mul, div);
+}
+
+static inline int64_t sensor_fixed_from_value(const struct sensor_value *value)
+{
+	return value->val1 * SENSOR_FIXED_MICRO + value->val2;
+}
+
+/**
+ * Multiplies @p value by @p scale, rounding toward zero. Integer ratios are
+ * exact, ratios below 1 are off by at most one part per billion of @p value,
+ * plus one unit.
+ */
+static inline int64_t sensor_fixed_mul(int64_t value, struct sensor_fixed_scale scale)
+{
+	if (!scale.shift) {
+		return scale.mul ? value * scale.mul : value;
+	}
+
+	uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+	// the 96-bit product is high * 2^32 + low, and the shift is at least 31
+	uint64_t low = (uint64_t)(uint32_t)magnitude * scale.mul;
+	uint64_t high = (magnitude >> 32) * scale.mul;
+	uint64_t result = ((high << 1) + (low >> 31)) >> (scale.shift - 31);
+
+	return value < 0 ? -(int64_t)result : (int64_t)result;
+}
+
+/**
+ * Converts a value in millionths of the unit of the driver to billionths of the
+ * unit of the IPSO object.
+ */
+static inline int64_t sensor_fixed_scale(int64_t micro, struct sensor_fixed_scale scale)
+{
+	return sensor_fixed_mul(micro * (SENSOR_FIXED_NANO / SENSOR_FIXED_MICRO), scale);
+}
+
+static inline double sensor_fixed_to_double(int64_t nano)
+{
+	return (double)nano * 1e-9;
+}
+
+static inline float sensor_fixed_to_float(int64_t nano)
+{
+	return (float)nano * 1e-9f;
+}
+
+/**
+ * Converts a non-negative value in units of the IPSO object, saturating at the
+ * range of the fixed-point representation.
+ */
+static inline int64_t sensor_fixed_from_float(float value)
+{
+	if (value >= (float)(INT64_MAX / SENSOR_FIXED_NANO)) {
+		return INT64_MAX;
+	}
+	return (int64_t)(value * (float)SENSOR_FIXED_NANO);
+}
@@ -0,0 +1,366 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <anjay/anjay.h>
+
+#include "sensors_fixed.h"
+#include "sensors_stats.h"
+
+LOG_MODULE_REGISTER(sensors_stats);
+
+/* one window per basic IPSO sensor of the demo */
+#define SENSORS_STATS_MAX_WINDOWS 8
+
+/**
+ * Sensor Statistics: custom object in the private range, one instance per
+ * aggregated sensor
+ */
+#define OID_SENSOR_STATS 26243
+
+/**
+ * Sensor: R, Single, Mandatory
+ * type: objlnk, range: N/A, unit: N/A
+ * IPSO sensor object instance whose values are aggregated.
+ */
+#define RID_SENSOR 0
+
+/**
+ * Sample Count: R, Single, Mandatory
+ * type: integer, range: N/A, unit: N/A
+ * Number of samples in the window.
+ */
+#define RID_SAMPLE_COUNT 1
+
+/**
+ * Min Value: R, Single, Mandatory
+ * type: float, range: N/A, unit: unit of the sensor
+ * Smallest sample in the window.
+ */
+#define RID_MIN_VALUE 2
+
+/**
+ * Max Value: R, Single, Mandatory
+ * type: float, range: N/A, unit: unit of the sensor
+ * Largest sample in the window.
+ */
+#define RID_MAX_VALUE 3
+
+/**
+ * Mean Value: R, Single, Mandatory
+ * type: float, range: N/A, unit: unit of the sensor
+ * Arithmetic mean of the samples in the window.
+ */
+#define RID_MEAN_VALUE 4
+
+/**
+ * Standard Deviation: R, Single, Mandatory
+ * type: float, range: N/A, unit: unit of the sensor
+ * Population standard deviation of the samples in the window.
+ */
+#define RID_STANDARD_DEVIATION 5
+
+/**
+ * Window Length: R, Single, Mandatory
+ * type: integer, range: N/A, unit: ms
+ * Time covered by a full window.
+ */
+#define RID_WINDOW_LENGTH 6
+
+/**
+ * Reset Window: E, Single, Mandatory
+ * type: N/A, range: N/A, unit: N/A
+ * Drops the samples collected so far.
+ */
+#define RID_RESET_WINDOW 7
+
+#define SENSORS_STATS_SAMPLE_PERIOD K_MSEC(CONFIG_APP_SENSORS_STATS_SAMPLE_PERIOD_MS)
+
+struct window_stats {
+	uint16_t count;
+	double min;
+	double max;
+	double mean;
+	double stddev;
+};
+
+static struct k_thread sampling_thread;
+static K_THREAD_STACK_DEFINE(sampling_stack, 1024);
+static bool sampling_thread_started;
+
+// guards the set of windows against the sampling thread; changed only from the Anjay thread
+static K_MUTEX_DEFINE(windows_mutex);
+static struct sensors_stats_window *windows[SENSORS_STATS_MAX_WINDOWS];
+static size_t windows_count;
+
+static void sample(struct sensors_stats_window *window)
+{
+	int64_t value;
+
+	if (window->reader(window->arg, &value)) {
+		return;
+	}
+
+	k_mutex_lock(&window->mutex, K_FOREVER);
+	window->latest = value;
+	window->samples[window->next] = sensor_fixed_to_float(value);
+	window->next = (window->next + 1) % CONFIG_APP_SENSORS_STATS_WINDOW;
+	if (window->count < CONFIG_APP_SENSORS_STATS_WINDOW) {
+		window->count++;
+	}
+	k_mutex_unlock(&window->mutex);
+}
+
+static void sample_windows(void *arg1, void *arg2, void *arg3)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+
+	while (1) {
+		k_mutex_lock(&windows_mutex, K_FOREVER);
+		for (size_t i = 0; i < windows_count; i++) {
+			sample(windows[i]);
+		}
+		k_mutex_unlock(&windows_mutex);
+		k_sleep(SENSORS_STATS_SAMPLE_PERIOD);
+	}
+}
+
+int sensors_stats_add(struct sensors_stats_window *window, anjay_oid_t oid, anjay_iid_t iid,
+		      sensors_stats_reader_t *reader, void *arg)
+{
+	if (windows_count >= SENSORS_STATS_MAX_WINDOWS) {
+		LOG_ERR("Too many sensor statistics windows");
+		return -ENOMEM;
+	}
+
+	if (!sampling_thread_started) {
+		if (!k_thread_create(&sampling_thread, sampling_stack,
+				     K_THREAD_STACK_SIZEOF(sampling_stack), sample_windows, NULL,
+				     NULL, NULL, K_LOWEST_APPLICATION_THREAD_PRIO, 0, K_NO_WAIT)) {
+			LOG_ERR("Failed to create sensor sampling thread");
+			return -1;
+		}
+		k_thread_name_set(&sampling_thread, "sensors_stats");
+		sampling_thread_started = true;
+	}
+
+	window->oid = oid;
+	window->iid = iid;
+	window->reader = reader;
+	window->arg = arg;
+	window->next = 0;
+	window->count = 0;
+	k_mutex_init(&window->mutex);
+
+	// the sampling thread does not know the window yet, so the sensor is not shared
+	sample(window);
+
+	k_mutex_lock(&windows_mutex, K_FOREVER);
+	windows[windows_count++] = window;
+	k_mutex_unlock(&windows_mutex);
+	return 0;
+}
+
+int sensors_stats_latest(struct sensors_stats_window *window, int64_t *out_value)
+{
+	int result = -EAGAIN;
+
+	if (!window->reader) {
+		return result;
+	}
+
+	k_mutex_lock(&window->mutex, K_FOREVER);
+	if (window->count) {
+		*out_value = window->latest;
+		result = 0;
+	}
+	k_mutex_unlock(&window->mutex);
+	return result;
+}
+
+void sensors_stats_reset(void)
+{
+	k_mutex_lock(&windows_mutex, K_FOREVER);
+	for (size_t i = 0; i < windows_count; i++) {
+		windows[i]->reader = NULL;
+	}
+	windows_count = 0;
+	k_mutex_unlock(&windows_mutex);
+}
+
+static struct window_stats window_stats_get(struct sensors_stats_window *window)
+{
+	struct window_stats stats = { 0 };
+
+	k_mutex_lock(&window->mutex, K_FOREVER);
+	stats.count = window->count;
+	if (stats.count) {
+		double sum = 0.0;
+
+		stats.min = window->samples[0];
+		stats.max = window->samples[0];
+		for (size_t i = 0; i < stats.count; i++) {
+			stats.min = fmin(stats.min, window->samples[i]);
+			stats.max = fmax(stats.max, window->samples[i]);
+			sum += window->samples[i];
+		}
+		stats.mean = sum / stats.count;
+
+		double squares = 0.0;
+
+		for (size_t i = 0; i < stats.count; i++) {
+			double deviation = window->samples[i] - stats.mean;
+
+			squares += deviation * deviation;
+		}
+		stats.stddev = sqrt(squares / stats.count);
+	} else {
+		stats.min = NAN;
+		stats.max = NAN;
+		stats.mean = NAN;
+		stats.stddev = NAN;
+	}
+	k_mutex_unlock(&window->mutex);
+	return stats;
+}
+
+static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_dm_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+
+	for (anjay_iid_t iid = 0; iid < windows_count; iid++) {
+		anjay_dm_emit(ctx, iid);
+	}
+	return 0;
+}
+
+static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)iid;
+
+	anjay_dm_emit_res(ctx, RID_SENSOR, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_SAMPLE_COUNT, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_MIN_VALUE, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_MAX_VALUE, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_MEAN_VALUE, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_STANDARD_DEVIATION, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_WINDOW_LENGTH, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
+	anjay_dm_emit_res(ctx, RID_RESET_WINDOW, ANJAY_DM_RES_E, ANJAY_DM_RES_PRESENT);
+	return 0;
+}
+
+static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+			 anjay_output_ctx_t *ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)riid;
+
+	assert(iid < windows_count);
+	assert(riid == ANJAY_ID_INVALID);
+	struct sensors_stats_window *window = windows[iid];
+
+	switch (rid) {
+	case RID_SENSOR:
+		return anjay_ret_objlnk(ctx, window->oid, window->iid);
+
+	case RID_SAMPLE_COUNT:
+		return anjay_ret_i32(ctx, window_stats_get(window).count);
+
+	case RID_MIN_VALUE:
+		return anjay_ret_double(ctx, window_stats_get(window).min);
+
+	case RID_MAX_VALUE:
+		return anjay_ret_double(ctx, window_stats_get(window).max);
+
+	case RID_MEAN_VALUE:
+		return anjay_ret_double(ctx, window_stats_get(window).mean);
+
+	case RID_STANDARD_DEVIATION:
+		return anjay_ret_double(ctx, window_stats_get(window).stddev);
+
+	case RID_WINDOW_LENGTH:
+		return anjay_ret_i32(ctx, CONFIG_APP_SENSORS_STATS_WINDOW *
+						  CONFIG_APP_SENSORS_STATS_SAMPLE_PERIOD_MS);
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static int resource_execute(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
+			    anjay_iid_t iid, anjay_rid_t rid, anjay_execute_ctx_t *arg_ctx)
+{
+	(void)anjay;
+	(void)obj_ptr;
+	(void)arg_ctx;
+
+	assert(iid < windows_count);
+
+	switch (rid) {
+	case RID_RESET_WINDOW: {
+		struct sensors_stats_window *window = windows[iid];
+
+		k_mutex_lock(&window->mutex, K_FOREVER);
+		window->next = 0;
+		window->count = 0;
+		k_mutex_unlock(&window->mutex);
+		return 0;
+	}
+
+	default:
+		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	}
+}
+
+static const anjay_dm_object_def_t OBJ_DEF = {
+	.oid = OID_SENSOR_STATS,
+	.handlers = { .list_instances = list_instances,
+
+		      .list_resources = list_resources,
+		      .resource_read = resource_read,
+		      .resource_execute = resource_execute }
+};
+
+static const anjay_dm_object_def_t *const OBJ_DEF_PTR = &OBJ_DEF;
+
+int sensors_stats_object_install(anjay_t *anjay)
+{
+	return anjay_register_object(anjay, &OBJ_DEF_PTR);
+}
+
+void sensors_stats_notify(anjay_t *anjay)
+{
+	for (anjay_iid_t iid = 0; iid < windows_count; iid++) {
+		for (anjay_rid_t rid = RID_SAMPLE_COUNT; rid <= RID_STANDARD_DEVIATION; rid++) {
+			anjay_notify_changed(anjay, OID_SENSOR_STATS, iid, rid);
+		}
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include <anjay/anjay.h>
+
+/**
+ * Reads the current value of a sensor, in billionths of the unit of its IPSO
+ * object (see sensors_fixed.h). Called from the sampling thread.
+ */
+typedef int sensors_stats_reader_t(void *arg, int64_t *out_value);
+
+struct sensors_stats_window {
+	// IPSO object instance the window describes
+	anjay_oid_t oid;
+	anjay_iid_t iid;
+	sensors_stats_reader_t *reader;
+	void *arg;
+
+	struct k_mutex mutex;
+	int64_t latest;
+	float samples[CONFIG_APP_SENSORS_STATS_WINDOW];
+	uint16_t next;
+	uint16_t count;
+};
+
+/**
+ * Starts sampling a sensor into @p window every
+ * CONFIG_APP_SENSORS_STATS_SAMPLE_PERIOD_MS. The first sample is taken before
+ * this function returns.
+ */
+int sensors_stats_add(struct sensors_stats_window *window, anjay_oid_t oid, anjay_iid_t iid,
+		      sensors_stats_reader_t *reader, void *arg);
+
+/**
+ * Returns the most recent sample in @p window, at the full precision of the
+ * reader, without accessing the sensor.
+ *
+ * @returns 0 on success, -EAGAIN if @p window is not sampled or empty
+ */
+int sensors_stats_latest(struct sensors_stats_window *window, int64_t *out_value);
+
+/**
+ * Stops sampling all windows added with @ref sensors_stats_add. Must be called
+ * before the windows are added again.
+ */
+void sensors_stats_reset(void);
+
+/**
+ * Registers the Sensor Statistics object, with one instance per window.
+ */
+int sensors_stats_object_install(anjay_t *anjay);
+
+/**
+ * Notifies the LwM2M Server about changes of the aggregated values, which are
+ * updated with every sample.
+ */
+void sensors_stats_notify(anjay_t *anjay);
@@ -0,0 +1,185 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+
+#include <zephyr/logging/log.h>
+
+#include "sensors_fetch.h"
+#include "sensors_fixed.h"
+#include "sensors_stream.h"
+
+LOG_MODULE_REGISTER(sensors_stream);
+
+/* the demo has at most three three-axis sensors */
+#define SENSOR_STREAM_MAX_POLLED 3
+
+#define SENSOR_STREAM_POLL_PERIOD K_MSEC(CONFIG_APP_SENSORS_STREAMING_POLL_PERIOD_MS)
+
+static struct k_thread poll_thread;
+static K_THREAD_STACK_DEFINE(poll_stack, 1024);
+static bool poll_thread_started;
+
+static struct sensor_stream *polled_streams[SENSOR_STREAM_MAX_POLLED];
+static atomic_t polled_streams_count = ATOMIC_INIT(0);
+
+// 1 / count for each number of buffered samples, so that the mean is not a 64-bit division
+static struct sensor_fixed_scale mean_scales[CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE + 1];
+
+static void acquire(struct sensor_stream *stream, bool triggered)
+{
+	struct sensor_value values[SENSOR_STREAM_AXES];
+	int err;
+
+	if (triggered) {
+		// the trigger announces a new sample, so it is fetched regardless of its age
+		err = sensors_fetch_new(stream->device, stream->channel, values);
+	} else {
+		// e.g. an accelerometer and a gyrometer of one IMU share a single fetch
+		err = sensors_fetch_get(stream->device, stream->channel, values);
+	}
+	if (err) {
+		LOG_WRN("Failed to read from %s", stream->device->name);
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stream->lock);
+	int64_t *sample = stream->samples[stream->next];
+
+	for (size_t axis = 0; axis < SENSOR_STREAM_AXES; axis++) {
+		if (stream->count == CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE) {
+			stream->sums[axis] -= sample[axis];
+		}
+		sample[axis] = sensor_fixed_from_value(&values[axis]);
+		stream->sums[axis] += sample[axis];
+	}
+	stream->next = (stream->next + 1) % CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE;
+	if (stream->count < CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE) {
+		stream->count++;
+	}
+	k_spin_unlock(&stream->lock, key);
+}
+
+static void trigger_handler(const struct device *device, const struct sensor_trigger *trigger)
+{
+	(void)device;
+
+	acquire(CONTAINER_OF(trigger, struct sensor_stream, trigger), true);
+}
+
+static void poll_streams(void *arg1, void *arg2, void *arg3)
+{
+	(void)arg1;
+	(void)arg2;
+	(void)arg3;
+
+	while (1) {
+		atomic_val_t count = atomic_get(&polled_streams_count);
+
+		for (atomic_val_t i = 0; i < count; i++) {
+			acquire(polled_streams[i], false);
+		}
+		k_sleep(SENSOR_STREAM_POLL_PERIOD);
+	}
+}
+
+static int start_polling(struct sensor_stream *stream)
+{
+	atomic_val_t idx = atomic_get(&polled_streams_count);
+
+	if (idx >= SENSOR_STREAM_MAX_POLLED) {
+		return -ENOMEM;
+	}
+
+	polled_streams[idx] = stream;
+	atomic_set(&polled_streams_count, idx + 1);
+
+	if (!poll_thread_started) {
+		if (!k_thread_create(&poll_thread, poll_stack, K_THREAD_STACK_SIZEOF(poll_stack),
+				     poll_streams, NULL, NULL, NULL,
+				     K_LOWEST_APPLICATION_THREAD_PRIO, 0, K_NO_WAIT)) {
+			LOG_ERR("Failed to create sensor polling thread");
+			return -1;
+		}
+		k_thread_name_set(&poll_thread, "sensors_stream");
+		poll_thread_started = true;
+	}
+	return 0;
+}
+
+int sensor_stream_start(struct sensor_stream *stream, const struct device *device,
+			enum sensor_channel channel)
+{
+	if (stream->device) {
+		return 0;
+	}
+
+	// filled in before the first stream starts, and never changed afterwards
+	if (IS_ENABLED(CONFIG_APP_SENSORS_STREAMING_VALUE_MEAN) && !mean_scales[1].mul) {
+		for (uint32_t count = 1; count <= CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE;
+		     count++) {
+			mean_scales[count] = sensor_fixed_scale_make(1, count);
+		}
+	}
+
+	stream->device = device;
+	stream->channel = channel;
+	stream->trigger = (struct sensor_trigger){ .type = SENSOR_TRIG_DATA_READY,
+						   .chan = channel };
+
+	int err = sensor_trigger_set(device, &stream->trigger, trigger_handler);
+
+	if (!err) {
+		LOG_INF("%s: acquiring on data ready trigger", device->name);
+		return 0;
+	}
+
+	err = start_polling(stream);
+	if (err) {
+		LOG_ERR("%s: could not start acquisition", device->name);
+		stream->device = NULL;
+		return err;
+	}
+
+	LOG_INF("%s: acquiring every %d ms", device->name,
+		CONFIG_APP_SENSORS_STREAMING_POLL_PERIOD_MS);
+	return 0;
+}
+
+int sensor_stream_get(struct sensor_stream *stream, int64_t out_values[SENSOR_STREAM_AXES])
+{
+	int result = 0;
+	k_spinlock_key_t key = k_spin_lock(&stream->lock);
+
+	if (!stream->count) {
+		result = -EAGAIN;
+	} else if (IS_ENABLED(CONFIG_APP_SENSORS_STREAMING_VALUE_MEAN)) {
+		for (size_t axis = 0; axis < SENSOR_STREAM_AXES; axis++) {
+			out_values[axis] =
+				sensor_fixed_mul(stream->sums[axis], mean_scales[stream->count]);
+		}
+	} else {
+		size_t latest = (stream->next + CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE - 1) %
+				CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE;
+
+		for (size_t axis = 0; axis < SENSOR_STREAM_AXES; axis++) {
+			out_values[axis] = stream->samples[latest][axis];
+		}
+	}
+	k_spin_unlock(&stream->lock, key);
+
+	return result;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <zephyr/drivers/sensor.h>
+#include <zephyr/kernel.h>
+
+#define SENSOR_STREAM_AXES 3
+
+struct sensor_stream {
+	const struct device *device;
+	enum sensor_channel channel;
+	struct sensor_trigger trigger;
+
+	struct k_spinlock lock;
+	/* values in millionths, so that the running sums are exact */
+	int64_t samples[CONFIG_APP_SENSORS_STREAMING_BUFFER_SIZE][SENSOR_STREAM_AXES];
+	int64_t sums[SENSOR_STREAM_AXES];
+	uint8_t next;
+	uint8_t count;
+};
+
+/**
+ * Starts acquiring a three-axis @p channel of @p device into the ring buffer
+ * of @p stream, on the sensor's data ready trigger if the driver supports it,
+ * or from a polling thread otherwise. Does nothing if @p stream is already
+ * running.
+ */
+int sensor_stream_start(struct sensor_stream *stream, const struct device *device,
+			enum sensor_channel channel);
+
+/**
+ * Returns the latest sample, or the mean of the buffered samples, depending
+ * on CONFIG_APP_SENSORS_STREAMING_VALUE_*, in millionths of the unit of the
+ * driver. Does not access the sensor itself.
+ *
+ * @returns 0 on success, -EAGAIN if no sample has been acquired yet
+ */
+int sensor_stream_get(struct sensor_stream *stream, int64_t out_values[SENSOR_STREAM_AXES]);
@@ -0,0 +1,518 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include <anjay/lwm2m_send.h>
+
+#include "object_refresh.h"
+#include "synchronized.h"
+#include "telemetry.h"
+#include "telemetry_store.h"
+
+LOG_MODULE_REGISTER(telemetry);
+
+/*
+ * Readings of all telemetry sources are taken once per sample period into a
+ * RAM buffer, each with its own timestamp, and sent as a single LwM2M Send
+ * message when batch_size readings are pending, flush_interval after the
+ * previous flush or when the oldest pending reading is max_latency old,
+ * whichever comes first. Anjay encodes the message as SenML CBOR if CBOR
+ * support is enabled.
+ *
+ * With CONFIG_APP_TELEMETRY_STORE, readings that could not be delivered, or
+ * that do not fit in the RAM buffer, are written to flash and sent from there
+ * one block at a time whenever a Send succeeds.
+ */
+
+struct telemetry_source {
+	anjay_oid_t oid;
+	anjay_iid_t iid;
+	anjay_rid_t rids[TELEMETRY_SOURCE_MAX_RIDS];
+	size_t rids_count;
+	bool is_bool;
+	telemetry_reader_t *reader;
+	void *arg;
+};
+
+struct telemetry_params {
+	uint32_t sample_period_s;
+	uint32_t batch_size;
+	uint32_t flush_interval_s;
+	uint32_t max_latency_s;
+};
+
+enum delivery { DELIVERY_LIVE, DELIVERY_STORED };
+
+static struct telemetry_source sources[CONFIG_APP_TELEMETRY_MAX_SOURCES];
+static size_t sources_count;
+
+static K_MUTEX_DEFINE(params_mutex);
+static struct telemetry_params params = {
+	.sample_period_s = CONFIG_APP_TELEMETRY_SAMPLE_PERIOD,
+	.batch_size = CONFIG_APP_TELEMETRY_BATCH_SIZE,
+	.flush_interval_s = CONFIG_APP_TELEMETRY_FLUSH_INTERVAL,
+	.max_latency_s = CONFIG_APP_TELEMETRY_MAX_LATENCY
+};
+
+static struct telemetry_reading readings[CONFIG_APP_TELEMETRY_BUFFER_SIZE];
+static size_t readings_count;
+// readings at the start of the buffer that are part of an unfinished Send
+static size_t readings_in_flight;
+
+#ifdef CONFIG_APP_TELEMETRY_STORE
+static bool store_available;
+static bool store_in_flight;
+#endif // CONFIG_APP_TELEMETRY_STORE
+
+static avs_time_monotonic_t oldest_reading;
+static avs_time_monotonic_t last_sample;
+static avs_time_monotonic_t last_flush;
+
+int telemetry_source_add(anjay_oid_t oid, anjay_iid_t iid, const anjay_rid_t *rids,
+			 size_t rids_count, bool is_bool, telemetry_reader_t *reader, void *arg)
+{
+	assert(rids_count > 0 && rids_count <= TELEMETRY_SOURCE_MAX_RIDS);
+
+	if (sources_count >= AVS_ARRAY_SIZE(sources)) {
+		LOG_ERR("No space for /%u/%u, increase CONFIG_APP_TELEMETRY_MAX_SOURCES", oid, iid);
+		return -1;
+	}
+
+	struct telemetry_source *source = &sources[sources_count++];
+
+	*source = (struct telemetry_source){ .oid = oid,
+					     .iid = iid,
+					     .rids_count = rids_count,
+					     .is_bool = is_bool,
+					     .reader = reader,
+					     .arg = arg };
+	memcpy(source->rids, rids, rids_count * sizeof(*rids));
+	return 0;
+}
+
+static avs_time_monotonic_t after(avs_time_monotonic_t instant, uint32_t seconds)
+{
+	return avs_time_monotonic_add(instant, avs_time_duration_from_scalar(seconds, AVS_TIME_S));
+}
+
+static avs_time_monotonic_t earliest(avs_time_monotonic_t a, avs_time_monotonic_t b)
+{
+	if (!avs_time_monotonic_valid(a)) {
+		return b;
+	}
+	if (!avs_time_monotonic_valid(b)) {
+		return a;
+	}
+	return avs_time_monotonic_before(a, b) ? a : b;
+}
+
+static void remove_readings(size_t start, size_t count)
+{
+	memmove(&readings[start], &readings[start + count],
+		(readings_count - start - count) * sizeof(*readings));
+	readings_count -= count;
+}
+
+/**
+ * Writes readings to flash if possible, and removes them from the buffer
+ * either way.
+ */
+static void store_readings(size_t start, size_t count)
+{
+#ifdef CONFIG_APP_TELEMETRY_STORE
+	if (!store_available || telemetry_store_append(&readings[start], count))
+#endif // CONFIG_APP_TELEMETRY_STORE
+	{
+		LOG_WRN("Dropping %zu telemetry readings", count);
+	}
+
+	remove_readings(start, count);
+}
+
+static bool buffer_make_room(void)
+{
+	if (readings_count < AVS_ARRAY_SIZE(readings)) {
+		return true;
+	}
+
+#ifdef CONFIG_APP_TELEMETRY_STORE
+	if (store_available && readings_count > readings_in_flight) {
+		store_readings(readings_in_flight, readings_count - readings_in_flight);
+		oldest_reading = AVS_TIME_MONOTONIC_INVALID;
+		return true;
+	}
+#endif // CONFIG_APP_TELEMETRY_STORE
+
+	return false;
+}
+
+static void flush(anjay_t *anjay, avs_time_monotonic_t now, uint32_t batch_size);
+
+static void sample(anjay_t *anjay, avs_time_monotonic_t now, uint32_t batch_size)
+{
+	int64_t timestamp_ms;
+
+	if (avs_time_real_to_scalar(&timestamp_ms, AVS_TIME_MS, avs_time_real_now())) {
+		LOG_ERR("Could not get the current time");
+		return;
+	}
+
+	for (size_t i = 0; i < sources_count; i++) {
+		const struct telemetry_source *source = &sources[i];
+		double values[TELEMETRY_SOURCE_MAX_RIDS];
+
+		int result = source->reader(source->iid, source->arg, values);
+
+		if (result) {
+			if (result != -ENODATA) {
+				LOG_WRN("Could not read /%u/%u", source->oid, source->iid);
+			}
+			continue;
+		}
+
+		for (size_t j = 0; j < source->rids_count; j++) {
+			// a full batch is sent before it can grow past batch_size
+			if (readings_in_flight == 0 && readings_count >= batch_size) {
+				flush(anjay, now, batch_size);
+			}
+			if (!buffer_make_room()) {
+				LOG_WRN("Telemetry buffer full, dropping /%u/%u/%u", source->oid,
+					source->iid, source->rids[j]);
+				continue;
+			}
+
+			if (readings_count == readings_in_flight) {
+				oldest_reading = now;
+			}
+
+			readings[readings_count++] =
+				(struct telemetry_reading){ .timestamp_ms = timestamp_ms,
+							    .value = values[j],
+							    .oid = source->oid,
+							    .iid = source->iid,
+							    .rid = source->rids[j],
+							    .is_bool = source->is_bool };
+		}
+	}
+}
+
+static int batch_add_reading(const struct telemetry_reading *reading, void *builder)
+{
+	avs_time_real_t timestamp = avs_time_real_from_scalar(reading->timestamp_ms, AVS_TIME_MS);
+
+	if (reading->is_bool) {
+		return anjay_send_batch_add_bool(builder, reading->oid, reading->iid, reading->rid,
+						 ANJAY_ID_INVALID, timestamp, reading->value != 0.0);
+	}
+	return anjay_send_batch_add_double(builder, reading->oid, reading->iid, reading->rid,
+					   ANJAY_ID_INVALID, timestamp, reading->value);
+}
+
+static bool is_undeliverable(anjay_send_result_t result)
+{
+	// the server will not accept these readings later on either
+	return result == ANJAY_SEND_ERR_UNSUPPORTED || result == ANJAY_SEND_ERR_MUTED;
+}
+
+static void send_finished_handler(anjay_t *anjay, anjay_ssid_t ssid,
+				  const anjay_send_batch_t *batch, int result, void *delivery)
+{
+	(void)anjay;
+	(void)ssid;
+	(void)batch;
+
+	if (result != ANJAY_SEND_SUCCESS) {
+		LOG_WRN("Telemetry batch not delivered: %d", result);
+	}
+
+#ifdef CONFIG_APP_TELEMETRY_STORE
+	if ((intptr_t)delivery == DELIVERY_STORED) {
+		store_in_flight = false;
+		if (result == ANJAY_SEND_SUCCESS) {
+			telemetry_store_pop();
+			// keep draining the store while the server is reachable
+			object_refresh_request(OBJECT_REFRESH_TELEMETRY);
+		}
+		return;
+	}
+#endif // CONFIG_APP_TELEMETRY_STORE
+
+	size_t count = readings_in_flight;
+
+	readings_in_flight = 0;
+	if (result == ANJAY_SEND_SUCCESS) {
+		remove_readings(0, count);
+	} else {
+		store_readings(0, count);
+	}
+	object_refresh_request(OBJECT_REFRESH_TELEMETRY);
+}
+
+static anjay_send_result_t send_batch(anjay_t *anjay, anjay_send_batch_builder_t **builder,
+				      enum delivery delivery)
+{
+	anjay_send_batch_t *batch = anjay_send_batch_builder_compile(builder);
+
+	anjay_send_batch_builder_cleanup(builder);
+	if (!batch) {
+		LOG_ERR("Could not compile telemetry batch");
+		return ANJAY_SEND_ERR_INTERNAL;
+	}
+
+#ifdef CONFIG_APP_TELEMETRY_STORE
+	// fails immediately if offline, so that the readings can be stored
+	anjay_send_result_t result = anjay_send(anjay, ANJAY_SSID_ANY, batch,
+						send_finished_handler, (void *)(intptr_t)delivery);
+#else  // CONFIG_APP_TELEMETRY_STORE
+	anjay_send_result_t result = anjay_send_deferrable(
+		anjay, ANJAY_SSID_ANY, batch, send_finished_handler, (void *)(intptr_t)delivery);
+#endif // CONFIG_APP_TELEMETRY_STORE
+
+	anjay_send_batch_release(&batch);
+	return result;
+}
+
+/**
+ * Sends up to @p batch_size of the oldest readings. If some are left, the
+ * oldest_reading instant is kept for them, which is earlier than their actual
+ * age, so they are not held back beyond max_latency.
+ */
+static void flush(anjay_t *anjay, avs_time_monotonic_t now, uint32_t batch_size)
+{
+	anjay_send_batch_builder_t *builder = anjay_send_batch_builder_new();
+	size_t count = AVS_MIN(readings_count, (size_t)batch_size);
+
+	last_flush = now;
+	if (count == readings_count) {
+		oldest_reading = AVS_TIME_MONOTONIC_INVALID;
+	}
+
+	if (!builder) {
+		LOG_ERR("Could not create telemetry batch");
+		store_readings(0, count);
+		return;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		if (batch_add_reading(&readings[i], builder)) {
+			LOG_ERR("Could not add reading to telemetry batch");
+			anjay_send_batch_builder_cleanup(&builder);
+			store_readings(0, count);
+			return;
+		}
+	}
+
+	anjay_send_result_t result = send_batch(anjay, &builder, DELIVERY_LIVE);
+
+	if (result == ANJAY_SEND_OK) {
+		readings_in_flight = count;
+		LOG_DBG("Sending telemetry batch of %zu readings", count);
+	} else if (is_undeliverable(result)) {
+		LOG_WRN("Telemetry rejected: %d", (int)result);
+		remove_readings(0, count);
+	} else {
+		store_readings(0, count);
+	}
+}
+
+#ifdef CONFIG_APP_TELEMETRY_STORE
+static void drain_store(anjay_t *anjay)
+{
+	if (!store_available || store_in_flight || telemetry_store_empty()) {
+		return;
+	}
+
+	anjay_send_batch_builder_t *builder = anjay_send_batch_builder_new();
+
+	if (!builder) {
+		return;
+	}
+
+	int result = telemetry_store_peek(batch_add_reading, builder);
+
+	if (result) {
+		anjay_send_batch_builder_cleanup(&builder);
+		if (result == -EBADMSG) {
+			LOG_ERR("Skipping corrupted telemetry block");
+			telemetry_store_pop();
+		}
+		return;
+	}
+
+	if (send_batch(anjay, &builder, DELIVERY_STORED) == ANJAY_SEND_OK) {
+		store_in_flight = true;
+	}
+}
+#endif // CONFIG_APP_TELEMETRY_STORE
+
+avs_time_monotonic_t telemetry_update(anjay_t *anjay)
+{
+	struct telemetry_params current;
+
+	SYNCHRONIZED(params_mutex)
+	{
+		current = params;
+	}
+
+	avs_time_monotonic_t now = avs_time_monotonic_now();
+
+	if (!avs_time_monotonic_valid(last_flush)) {
+		last_flush = now;
+	}
+
+	if (!avs_time_monotonic_valid(last_sample) ||
+	    !avs_time_monotonic_before(now, after(last_sample, current.sample_period_s))) {
+		sample(anjay, now, current.batch_size);
+		last_sample = now;
+	}
+
+	avs_time_monotonic_t flush_deadline = AVS_TIME_MONOTONIC_INVALID;
+
+	// only one live batch is sent at a time, the next one waits for its result
+	if (readings_count > 0 && readings_in_flight == 0) {
+		flush_deadline = earliest(after(last_flush, current.flush_interval_s),
+					  after(oldest_reading, current.max_latency_s));
+
+		if (readings_count >= current.batch_size ||
+		    !avs_time_monotonic_before(now, flush_deadline)) {
+			flush(anjay, now, current.batch_size);
+			flush_deadline = AVS_TIME_MONOTONIC_INVALID;
+		}
+	}
+
+#ifdef CONFIG_APP_TELEMETRY_STORE
+	drain_store(anjay);
+#endif // CONFIG_APP_TELEMETRY_STORE
+
+	return earliest(after(last_sample, current.sample_period_s), flush_deadline);
+}
+
+void telemetry_init(void)
+{
+#ifdef CONFIG_APP_TELEMETRY_STORE
+	store_available = !telemetry_store_init();
+#endif // CONFIG_APP_TELEMETRY_STORE
+}
+
+void telemetry_reset(void)
+{
+#ifdef CONFIG_APP_TELEMETRY_STORE
+	if (!store_available) {
+		store_available = !telemetry_store_init();
+	}
+	store_in_flight = false;
+#endif // CONFIG_APP_TELEMETRY_STORE
+
+	sources_count = 0;
+	readings_count = 0;
+	readings_in_flight = 0;
+	oldest_reading = AVS_TIME_MONOTONIC_INVALID;
+	last_sample = AVS_TIME_MONOTONIC_INVALID;
+	last_flush = AVS_TIME_MONOTONIC_INVALID;
+}
+
+#ifdef CONFIG_SHELL
+static int cmd_telemetry_show(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+	(void)argv;
+
+	struct telemetry_params current;
+
+	SYNCHRONIZED(params_mutex)
+	{
+		current = params;
+	}
+
+	shell_print(shell, "sample_period:  %u s", current.sample_period_s);
+	shell_print(shell, "batch_size:     %u readings", current.batch_size);
+	shell_print(shell, "flush_interval: %u s", current.flush_interval_s);
+	shell_print(shell, "max_latency:    %u s", current.max_latency_s);
+	return 0;
+}
+
+static int set_param(const struct shell *shell, const char *arg, unsigned long max,
+		     uint32_t *param)
+{
+	char *endptr;
+	unsigned long value = strtoul(arg, &endptr, 10);
+
+	if (*arg == '\0' || *endptr != '\0' || value == 0 || value > max) {
+		shell_error(shell, "Invalid value: %s", arg);
+		return -EINVAL;
+	}
+
+	SYNCHRONIZED(params_mutex)
+	{
+		*param = (uint32_t)value;
+	}
+
+	// takes effect immediately rather than at the previously computed deadline
+	object_refresh_request(OBJECT_REFRESH_TELEMETRY);
+	return 0;
+}
+
+static int cmd_telemetry_sample_period(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+
+	return set_param(shell, argv[1], UINT32_MAX, &params.sample_period_s);
+}
+
+static int cmd_telemetry_batch_size(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+
+	return set_param(shell, argv[1], CONFIG_APP_TELEMETRY_BUFFER_SIZE, &params.batch_size);
+}
+
+static int cmd_telemetry_flush_interval(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+
+	return set_param(shell, argv[1], UINT32_MAX, &params.flush_interval_s);
+}
+
+static int cmd_telemetry_max_latency(const struct shell *shell, size_t argc, char **argv)
+{
+	(void)argc;
+
+	return set_param(shell, argv[1], UINT32_MAX, &params.max_latency_s);
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+	sub_telemetry,
+	SHELL_CMD(show, NULL, "Show telemetry batching parameters", cmd_telemetry_show),
+	SHELL_CMD_ARG(sample_period, NULL, "<seconds> Set the sampling period",
+		      cmd_telemetry_sample_period, 2, 0),
+	SHELL_CMD_ARG(batch_size, NULL, "<readings> Set the number of readings per batch",
+		      cmd_telemetry_batch_size, 2, 0),
+	SHELL_CMD_ARG(flush_interval, NULL, "<seconds> Set the interval between batches",
+		      cmd_telemetry_flush_interval, 2, 0),
+	SHELL_CMD_ARG(max_latency, NULL, "<seconds> Set the maximum age of a pending reading",
+		      cmd_telemetry_max_latency, 2, 0),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(telemetry, &sub_telemetry, "LwM2M Send telemetry commands", NULL);
+#endif // CONFIG_SHELL
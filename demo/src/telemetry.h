@@ -0,0 +1,68 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <anjay/anjay.h>
+
+#define TELEMETRY_SOURCE_MAX_RIDS 3
+
+struct telemetry_reading {
+	/** Real time at which the value was read, in milliseconds since epoch. */
+	int64_t timestamp_ms;
+	double value;
+	anjay_oid_t oid;
+	anjay_iid_t iid;
+	anjay_rid_t rid;
+	bool is_bool;
+};
+
+/**
+ * Reads the current values of all resources of a telemetry source, in the
+ * order in which they were passed to @ref telemetry_source_add. Returns
+ * -ENODATA if the source has no values yet, which skips it silently.
+ */
+typedef int telemetry_reader_t(anjay_iid_t iid, void *arg, double *out_values);
+
+/**
+ * Adds an object instance to the set sampled into telemetry batches. Intended
+ * to be called while registering objects.
+ *
+ * @p rids_count must not exceed TELEMETRY_SOURCE_MAX_RIDS. If @p is_bool is
+ * true, values are sent as booleans, otherwise as floats.
+ */
+int telemetry_source_add(anjay_oid_t oid, anjay_iid_t iid, const anjay_rid_t *rids,
+			 size_t rids_count, bool is_bool, telemetry_reader_t *reader, void *arg);
+
+/**
+ * Samples the telemetry sources and sends pending readings through LwM2M Send
+ * if due. Returns the instant at which it should be called again.
+ */
+avs_time_monotonic_t telemetry_update(anjay_t *anjay);
+
+/**
+ * Opens the persistent store of readings if CONFIG_APP_TELEMETRY_STORE is
+ * enabled. Scanning the flash partition may take a while, so this is meant to
+ * be called early, from another thread than Anjay's. If it fails or is not
+ * called, @ref telemetry_reset tries again.
+ */
+void telemetry_init(void);
+
+/**
+ * Drops the pending readings and all sources added with
+ * @ref telemetry_source_add. Must be called before the sources are added.
+ */
+void telemetry_reset(void);
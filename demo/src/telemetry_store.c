@@ -0,0 +1,430 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/fs/fcb.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+
+#include "telemetry_store.h"
+
+LOG_MODULE_REGISTER(telemetry_store);
+
+/*
+ * Readings are kept in a Flash Circular Buffer on the telemetry_storage
+ * partition. Every append writes a single FCB entry (a block), so the number of
+ * flash writes depends on how often the RAM buffer is flushed, not on the
+ * number of readings.
+ *
+ * Block layout, all integers are LEB128 varints:
+ *
+ *   paths_count
+ *   paths_count * { oid, iid, rid, is_bool }
+ *   readings_count
+ *   timestamp of the first reading [ms since epoch]
+ *   readings_count * {
+ *       index in the path table,
+ *       timestamp delta from the previous reading [ms],
+ *       zigzag delta of the double value bits from the previous value of the
+ *       same path
+ *   }
+ *
+ * Values are kept as doubles, so that e.g. coordinates keep their precision.
+ * The bit patterns of IEEE 754 doubles of the same sign are ordered like their
+ * values, so a slowly changing value produces small deltas.
+ *
+ * Delivered blocks are only tracked in RAM. FCB can only erase whole sectors,
+ * so they are erased when the backlog is fully drained or when drain position
+ * moves past a sector. After a reboot, delivered blocks from a partially
+ * drained sector may be sent again.
+ */
+
+#define TELEMETRY_STORE_AREA_ID FIXED_PARTITION_ID(telemetry_storage)
+#define TELEMETRY_STORE_MAGIC 0x544c4d32 // "TLM2"
+
+// maximum encoded sizes of uint64_t, uint32_t and uint16_t varints
+#define VARINT64_MAX_SIZE 10
+#define VARINT32_MAX_SIZE 5
+#define VARINT16_MAX_SIZE 3
+
+#define BLOCK_PATH_MAX_SIZE (3 * VARINT16_MAX_SIZE + 1)
+#define BLOCK_READING_MAX_SIZE (VARINT16_MAX_SIZE + 2 * VARINT64_MAX_SIZE)
+#define BLOCK_MAX_SIZE                                                                             \
+	(VARINT16_MAX_SIZE * 2 + VARINT64_MAX_SIZE +                                               \
+	 CONFIG_APP_TELEMETRY_BUFFER_SIZE * (BLOCK_PATH_MAX_SIZE + BLOCK_READING_MAX_SIZE))
+
+// sector header, entry length and CRC, with alignment padding
+#define FCB_OVERHEAD_MAX 16
+
+/*
+ * An FCB entry cannot span sectors, so a block of a full RAM buffer must fit in
+ * a single one. The partition is expected on the main flash; other sectors are
+ * checked in telemetry_store_init().
+ */
+#if DT_NODE_HAS_PROP(DT_CHOSEN(zephyr_flash), erase_block_size)
+BUILD_ASSERT(BLOCK_MAX_SIZE + FCB_OVERHEAD_MAX <=
+		     DT_PROP(DT_CHOSEN(zephyr_flash), erase_block_size),
+	     "CONFIG_APP_TELEMETRY_BUFFER_SIZE is too large for the flash sector size");
+#endif // DT_NODE_HAS_PROP(DT_CHOSEN(zephyr_flash), erase_block_size)
+
+struct block_path {
+	anjay_oid_t oid;
+	anjay_iid_t iid;
+	anjay_rid_t rid;
+	bool is_bool;
+	uint64_t prev_bits;
+};
+
+static struct flash_sector sectors[CONFIG_APP_TELEMETRY_STORE_MAX_SECTORS];
+static struct fcb fcb;
+static bool initialized;
+
+// last delivered entry, fe_sector is NULL if none in the current sectors
+static struct fcb_entry drain_loc;
+static struct fcb_entry peek_loc;
+
+static uint8_t block[BLOCK_MAX_SIZE];
+static struct block_path block_paths[CONFIG_APP_TELEMETRY_BUFFER_SIZE];
+
+static size_t varint_put(uint8_t *buf, uint64_t value)
+{
+	size_t size = 0;
+
+	do {
+		buf[size] = (uint8_t)(value & 0x7f);
+		value >>= 7;
+		if (value) {
+			buf[size] |= 0x80;
+		}
+		size++;
+	} while (value);
+
+	return size;
+}
+
+static int varint_get(const uint8_t **ptr, const uint8_t *end, uint64_t *out_value)
+{
+	*out_value = 0;
+	for (unsigned int shift = 0; shift < 64 && *ptr < end; shift += 7) {
+		uint8_t byte = *(*ptr)++;
+
+		*out_value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return 0;
+		}
+	}
+	return -EBADMSG;
+}
+
+static uint64_t zigzag_encode(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t value)
+{
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static uint64_t double_bits(double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double bits_double(uint64_t bits)
+{
+	double value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static size_t path_index(size_t *inout_paths_count, const struct telemetry_reading *reading)
+{
+	size_t i;
+
+	for (i = 0; i < *inout_paths_count; i++) {
+		if (block_paths[i].oid == reading->oid && block_paths[i].iid == reading->iid &&
+		    block_paths[i].rid == reading->rid) {
+			return i;
+		}
+	}
+
+	block_paths[i] = (struct block_path){ .oid = reading->oid,
+					      .iid = reading->iid,
+					      .rid = reading->rid,
+					      .is_bool = reading->is_bool };
+	++*inout_paths_count;
+	return i;
+}
+
+static size_t block_encode(const struct telemetry_reading *readings, size_t count)
+{
+	size_t paths_count = 0;
+	uint8_t indexes[CONFIG_APP_TELEMETRY_BUFFER_SIZE];
+
+	for (size_t i = 0; i < count; i++) {
+		indexes[i] = (uint8_t)path_index(&paths_count, &readings[i]);
+	}
+
+	size_t size = varint_put(block, paths_count);
+
+	for (size_t i = 0; i < paths_count; i++) {
+		size += varint_put(&block[size], block_paths[i].oid);
+		size += varint_put(&block[size], block_paths[i].iid);
+		size += varint_put(&block[size], block_paths[i].rid);
+		size += varint_put(&block[size], block_paths[i].is_bool);
+	}
+
+	size += varint_put(&block[size], count);
+	size += varint_put(&block[size], (uint64_t)readings[0].timestamp_ms);
+
+	int64_t prev_timestamp_ms = readings[0].timestamp_ms;
+
+	for (size_t i = 0; i < count; i++) {
+		struct block_path *path = &block_paths[indexes[i]];
+		uint64_t bits = double_bits(readings[i].value);
+
+		size += varint_put(&block[size], indexes[i]);
+		// wraps around if the clock steps back, which decoding reverts
+		size += varint_put(&block[size],
+				   (uint64_t)(readings[i].timestamp_ms - prev_timestamp_ms));
+		size += varint_put(&block[size], zigzag_encode((int64_t)(bits - path->prev_bits)));
+
+		prev_timestamp_ms = readings[i].timestamp_ms;
+		path->prev_bits = bits;
+	}
+
+	return size;
+}
+
+static int block_decode(size_t size, telemetry_store_reading_cb_t *cb, void *arg)
+{
+	const uint8_t *ptr = block;
+	const uint8_t *end = block + size;
+	uint64_t paths_count;
+
+	if (varint_get(&ptr, end, &paths_count) || paths_count > AVS_ARRAY_SIZE(block_paths)) {
+		return -EBADMSG;
+	}
+
+	for (size_t i = 0; i < paths_count; i++) {
+		uint64_t oid, iid, rid, is_bool;
+
+		if (varint_get(&ptr, end, &oid) || varint_get(&ptr, end, &iid) ||
+		    varint_get(&ptr, end, &rid) || varint_get(&ptr, end, &is_bool) ||
+		    oid > UINT16_MAX || iid > UINT16_MAX || rid > UINT16_MAX) {
+			return -EBADMSG;
+		}
+		block_paths[i] = (struct block_path){ .oid = (anjay_oid_t)oid,
+						      .iid = (anjay_iid_t)iid,
+						      .rid = (anjay_rid_t)rid,
+						      .is_bool = is_bool };
+	}
+
+	uint64_t count, timestamp_ms;
+
+	if (varint_get(&ptr, end, &count) || varint_get(&ptr, end, &timestamp_ms)) {
+		return -EBADMSG;
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		uint64_t index, timestamp_delta, value_delta;
+
+		if (varint_get(&ptr, end, &index) || varint_get(&ptr, end, &timestamp_delta) ||
+		    varint_get(&ptr, end, &value_delta) || index >= paths_count) {
+			return -EBADMSG;
+		}
+
+		struct block_path *path = &block_paths[index];
+
+		path->prev_bits += (uint64_t)zigzag_decode(value_delta);
+		timestamp_ms += timestamp_delta;
+
+		struct telemetry_reading reading = { .timestamp_ms = (int64_t)timestamp_ms,
+						     .value = bits_double(path->prev_bits),
+						     .oid = path->oid,
+						     .iid = path->iid,
+						     .rid = path->rid,
+						     .is_bool = path->is_bool };
+		int result = cb(&reading, arg);
+
+		if (result) {
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static int store_format(void)
+{
+	const struct flash_area *fa;
+	int result = flash_area_open(TELEMETRY_STORE_AREA_ID, &fa);
+
+	if (result) {
+		return result;
+	}
+
+	result = flash_area_erase(fa, 0, fa->fa_size);
+	flash_area_close(fa);
+	if (result) {
+		return result;
+	}
+
+	return fcb_init(TELEMETRY_STORE_AREA_ID, &fcb);
+}
+
+int telemetry_store_init(void)
+{
+	if (initialized) {
+		return 0;
+	}
+
+	uint32_t sectors_count = AVS_ARRAY_SIZE(sectors);
+	int result = flash_area_get_sectors(TELEMETRY_STORE_AREA_ID, &sectors_count, sectors);
+
+	if (result) {
+		LOG_ERR("Could not get telemetry_storage sectors: %d", result);
+		return result;
+	}
+
+	for (uint32_t i = 0; i < sectors_count; i++) {
+		if (sectors[i].fs_size < BLOCK_MAX_SIZE + FCB_OVERHEAD_MAX) {
+			LOG_ERR("telemetry_storage sectors of %u bytes cannot hold a block of %u "
+				"bytes",
+				(unsigned int)sectors[i].fs_size, (unsigned int)BLOCK_MAX_SIZE);
+			return -EINVAL;
+		}
+	}
+
+	fcb = (struct fcb){ .f_magic = TELEMETRY_STORE_MAGIC,
+			    .f_sector_cnt = (uint8_t)sectors_count,
+			    .f_sectors = sectors };
+
+	result = fcb_init(TELEMETRY_STORE_AREA_ID, &fcb);
+	if (result) {
+		LOG_WRN("Telemetry store unreadable (%d), formatting", result);
+		result = store_format();
+	}
+	if (result) {
+		LOG_ERR("Could not initialize telemetry store: %d", result);
+		return result;
+	}
+
+	drain_loc = (struct fcb_entry){ 0 };
+	initialized = true;
+	return 0;
+}
+
+int telemetry_store_append(const struct telemetry_reading *readings, size_t count)
+{
+	if (!count) {
+		return 0;
+	}
+
+	size_t size = block_encode(readings, count);
+	struct fcb_entry loc;
+	int result;
+	size_t rotations = 0;
+
+	while ((result = fcb_append(&fcb, (uint16_t)size, &loc)) == -ENOSPC) {
+#ifdef CONFIG_APP_TELEMETRY_STORE_EVICT_OLDEST
+		// erasing every sector did not help, so the block can never fit
+		if (rotations++ >= fcb.f_sector_cnt) {
+			break;
+		}
+		LOG_WRN("Telemetry store full, evicting oldest readings");
+		if (drain_loc.fe_sector == fcb.f_oldest) {
+			drain_loc = (struct fcb_entry){ 0 };
+		}
+		result = fcb_rotate(&fcb);
+		if (result) {
+			break;
+		}
+#else  // CONFIG_APP_TELEMETRY_STORE_EVICT_OLDEST
+		LOG_WRN("Telemetry store full");
+		return result;
+#endif // CONFIG_APP_TELEMETRY_STORE_EVICT_OLDEST
+	}
+
+	if (!result) {
+		result = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), block, size);
+	}
+	if (!result) {
+		result = fcb_append_finish(&fcb, &loc);
+	}
+	if (result) {
+		LOG_ERR("Could not store telemetry readings: %d", result);
+		return result;
+	}
+
+	LOG_DBG("Stored %zu readings in %zu bytes", count, size);
+	return 0;
+}
+
+bool telemetry_store_empty(void)
+{
+	struct fcb_entry loc = drain_loc;
+
+	return fcb_getnext(&fcb, &loc) != 0;
+}
+
+int telemetry_store_peek(telemetry_store_reading_cb_t *cb, void *arg)
+{
+	peek_loc = drain_loc;
+
+	int result = fcb_getnext(&fcb, &peek_loc);
+
+	if (result) {
+		return -ENOENT;
+	}
+
+	if (peek_loc.fe_data_len > sizeof(block) ||
+	    flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(peek_loc), block,
+			    peek_loc.fe_data_len)) {
+		return -EBADMSG;
+	}
+
+	return block_decode(peek_loc.fe_data_len, cb, arg);
+}
+
+void telemetry_store_pop(void)
+{
+	drain_loc = peek_loc;
+
+	if (telemetry_store_empty()) {
+		// everything delivered, erase up to and including the active sector
+		for (size_t i = 0; i < fcb.f_sector_cnt && !fcb_is_empty(&fcb); i++) {
+			if (fcb_rotate(&fcb)) {
+				break;
+			}
+		}
+		drain_loc = (struct fcb_entry){ 0 };
+		return;
+	}
+
+	for (size_t i = 0; i < fcb.f_sector_cnt && fcb.f_oldest != drain_loc.fe_sector; i++) {
+		if (fcb_rotate(&fcb)) {
+			break;
+		}
+	}
+}
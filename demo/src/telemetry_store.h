@@ -0,0 +1,47 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "telemetry.h"
+
+typedef int telemetry_store_reading_cb_t(const struct telemetry_reading *reading, void *arg);
+
+int telemetry_store_init(void);
+
+/**
+ * Writes @p count readings to flash as a single block. If the store is full,
+ * either the oldest blocks are evicted or the readings are dropped, depending
+ * on CONFIG_APP_TELEMETRY_STORE_EVICTION.
+ */
+int telemetry_store_append(const struct telemetry_reading *readings, size_t count);
+
+bool telemetry_store_empty(void);
+
+/**
+ * Calls @p cb for each reading of the oldest block that has not been popped
+ * yet. Calling it again without @ref telemetry_store_pop yields the same block.
+ */
+int telemetry_store_peek(telemetry_store_reading_cb_t *cb, void *arg);
+
+/**
+ * Marks the block returned by the last @ref telemetry_store_peek as delivered
+ * and erases the flash sectors that hold delivered blocks only.
+ */
+void telemetry_store_pop(void);
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "cbor_tracker.h"
+
+/*
+ * The CBOR stream written to /factory/provision.cbor arrives in chunks of
+ * arbitrary size, so every item has to be tracked across the chunk
+ * boundaries, including in the middle of an argument or of a string.
+ */
+
+// [{-2: "/0/1/", 0: "0", 3: "coap://127.0.0.1:5683"}, {0: "1", 4: false}, {0: "10", 2: 86400}]
+static const uint8_t senml[] = { 0x83, 0xa3, 0x21, 0x65, 0x2f, 0x30, 0x2f, 0x31, 0x2f, 0x00, 0x61,
+				 0x30, 0x03, 0x75, 0x63, 0x6f, 0x61, 0x70, 0x3a, 0x2f, 0x2f, 0x31,
+				 0x32, 0x37, 0x2e, 0x30, 0x2e, 0x30, 0x2e, 0x31, 0x3a, 0x35, 0x36,
+				 0x38, 0x33, 0xa2, 0x00, 0x61, 0x31, 0x04, 0xf4, 0xa2, 0x00, 0x62,
+				 0x31, 0x30, 0x02, 0x1a, 0x00, 0x01, 0x51, 0x80 };
+
+// [_ (_ "ab", "c"), {_ 1: 2}]
+static const uint8_t indefinite[] = { 0x9f, 0x7f, 0x62, 0x61, 0x62, 0x61, 0x63,
+				      0xff, 0xbf, 0x01, 0x02, 0xff, 0xff };
+
+#define LONG_STRING_LENGTH 300
+
+static uint8_t buffer[LONG_STRING_LENGTH + 16];
+
+/*
+ * Feeds @p length bytes in chunks of @p chunk bytes, the way provision_fs
+ * does, until the tracker stops consuming them.
+ */
+static size_t feed_in_chunks(struct cbor_tracker *tracker, const uint8_t *data, size_t length,
+			     size_t chunk)
+{
+	size_t consumed = 0;
+
+	while (consumed < length) {
+		size_t fed = MIN(chunk, length - consumed);
+		size_t result = cbor_tracker_feed(tracker, data + consumed, fed);
+
+		consumed += result;
+		if (result < fed) {
+			break;
+		}
+	}
+	return consumed;
+}
+
+static void assert_complete_in_every_split(const uint8_t *data, size_t length)
+{
+	struct cbor_tracker tracker;
+
+	for (size_t split = 1; split < length; split++) {
+		cbor_tracker_init(&tracker);
+		zassert_equal(cbor_tracker_feed(&tracker, data, split), split);
+		zassert_equal(tracker.state, CBOR_TRACKER_IN_PROGRESS, "split at %zu", split);
+		zassert_equal(cbor_tracker_feed(&tracker, data + split, length - split),
+			      length - split);
+		zassert_equal(tracker.state, CBOR_TRACKER_COMPLETE, "split at %zu", split);
+	}
+}
+
+ZTEST(cbor_tracker, test_item_in_one_chunk)
+{
+	struct cbor_tracker tracker;
+
+	memcpy(buffer, senml, sizeof(senml));
+	// the bytes after the item are not consumed
+	memset(buffer + sizeof(senml), 0, 2);
+
+	cbor_tracker_init(&tracker);
+	zassert_equal(cbor_tracker_feed(&tracker, buffer, sizeof(senml) + 2), sizeof(senml));
+	zassert_equal(tracker.state, CBOR_TRACKER_COMPLETE);
+}
+
+ZTEST(cbor_tracker, test_item_split_in_two_chunks)
+{
+	assert_complete_in_every_split(senml, sizeof(senml));
+}
+
+ZTEST(cbor_tracker, test_item_fed_byte_by_byte)
+{
+	struct cbor_tracker tracker;
+
+	cbor_tracker_init(&tracker);
+	for (size_t i = 0; i < sizeof(senml) - 1; i++) {
+		zassert_equal(cbor_tracker_feed(&tracker, &senml[i], 1), 1);
+		zassert_equal(tracker.state, CBOR_TRACKER_IN_PROGRESS, "byte %zu", i);
+	}
+	zassert_equal(cbor_tracker_feed(&tracker, &senml[sizeof(senml) - 1], 1), 1);
+	zassert_equal(tracker.state, CBOR_TRACKER_COMPLETE);
+}
+
+ZTEST(cbor_tracker, test_truncated_item)
+{
+	struct cbor_tracker tracker;
+
+	for (size_t chunk = 1; chunk <= sizeof(senml); chunk++) {
+		cbor_tracker_init(&tracker);
+		zassert_equal(feed_in_chunks(&tracker, senml, sizeof(senml) - 1, chunk),
+			      sizeof(senml) - 1);
+		zassert_equal(tracker.state, CBOR_TRACKER_IN_PROGRESS, "chunks of %zu", chunk);
+	}
+}
+
+ZTEST(cbor_tracker, test_long_arguments)
+{
+	struct cbor_tracker tracker;
+	size_t length = 0;
+
+	// [18446744073709551615, h'00...' of 300 bytes]
+	buffer[length++] = 0x82;
+	buffer[length++] = 0x1b;
+	memset(buffer + length, 0xff, 8);
+	length += 8;
+	buffer[length++] = 0x59;
+	buffer[length++] = LONG_STRING_LENGTH >> 8;
+	buffer[length++] = LONG_STRING_LENGTH & 0xff;
+	memset(buffer + length, 0, LONG_STRING_LENGTH);
+	length += LONG_STRING_LENGTH;
+	buffer[length] = 0;
+
+	for (size_t chunk = 1; chunk <= 16; chunk++) {
+		cbor_tracker_init(&tracker);
+		zassert_equal(feed_in_chunks(&tracker, buffer, length + 1, chunk), length,
+			      "chunks of %zu", chunk);
+		zassert_equal(tracker.state, CBOR_TRACKER_COMPLETE, "chunks of %zu", chunk);
+	}
+}
+
+ZTEST(cbor_tracker, test_indefinite_lengths)
+{
+	assert_complete_in_every_split(indefinite, sizeof(indefinite));
+}
+
+ZTEST(cbor_tracker, test_tagged_item)
+{
+	// 1(1700000000)
+	static const uint8_t tagged[] = { 0xc1, 0x1a, 0x65, 0x53, 0xf1, 0x00 };
+
+	assert_complete_in_every_split(tagged, sizeof(tagged));
+}
+
+ZTEST(cbor_tracker, test_invalid_items)
+{
+	static const uint8_t stray_break[] = { 0x81, 0xff };
+	static const uint8_t reserved_additional_info[] = { 0x1c };
+	static const uint8_t indefinite_integer[] = { 0x1f };
+	struct cbor_tracker tracker;
+
+	cbor_tracker_init(&tracker);
+	zassert_equal(cbor_tracker_feed(&tracker, stray_break, sizeof(stray_break)), 2);
+	zassert_equal(tracker.state, CBOR_TRACKER_ERROR);
+
+	cbor_tracker_init(&tracker);
+	zassert_equal(cbor_tracker_feed(&tracker, reserved_additional_info, 1), 1);
+	zassert_equal(tracker.state, CBOR_TRACKER_ERROR);
+
+	cbor_tracker_init(&tracker);
+	zassert_equal(cbor_tracker_feed(&tracker, indefinite_integer, 1), 1);
+	zassert_equal(tracker.state, CBOR_TRACKER_ERROR);
+
+	// one array more than the tracker can follow, the rest is not consumed
+	memset(buffer, 0x81, CBOR_TRACKER_MAX_DEPTH + 2);
+	cbor_tracker_init(&tracker);
+	zassert_equal(feed_in_chunks(&tracker, buffer, CBOR_TRACKER_MAX_DEPTH + 2, 3),
+		      CBOR_TRACKER_MAX_DEPTH + 1);
+	zassert_equal(tracker.state, CBOR_TRACKER_ERROR);
+}
+
+ZTEST_SUITE(cbor_tracker, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <zephyr/fs/fs.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <avsystem/commons/avs_stream.h>
+
+#include <anjay_zephyr/config.h>
+
+#include "factory_flash.h"
+
+/*
+ * factory_flash.c is driven through the file system API the way mcumgr does
+ * it: the provisioning file is uploaded in chunks, each one written with its
+ * own open, seek, write and close, and the result file is downloaded once
+ * the upload is done. The test thread plays the part of
+ * anjay_factory_provision() and reads the stream in chunks of another size.
+ */
+
+#define UPLOAD_PATH "/factory/provision.cbor"
+#define RESULT_PATH "/factory/result.txt"
+#define ENDPOINT_PATH "/factory/endpoint.txt"
+
+#define UPLOAD_CHUNK_SIZE 10
+#define READ_CHUNK_SIZE 7
+
+// [{-2: "/0/1/", 0: "0", 3: "coap://127.0.0.1:5683"}, {0: "1", 4: false}, {0: "10", 2: 86400}]
+#define SENML_LENGTH 52
+
+/*
+ * Followed by two bytes that the stream drops. Both are in the last chunk
+ * along with the end of the item, so that every write is accepted.
+ */
+static const uint8_t upload_data[] = {
+	0x83, 0xa3, 0x21, 0x65, 0x2f, 0x30, 0x2f, 0x31, 0x2f, 0x00, 0x61, 0x30, 0x03, 0x75,
+	0x63, 0x6f, 0x61, 0x70, 0x3a, 0x2f, 0x2f, 0x31, 0x32, 0x37, 0x2e, 0x30, 0x2e, 0x30,
+	0x2e, 0x31, 0x3a, 0x35, 0x36, 0x38, 0x33, 0xa2, 0x00, 0x61, 0x31, 0x04, 0xf4, 0xa2,
+	0x00, 0x62, 0x31, 0x30, 0x02, 0x1a, 0x00, 0x01, 0x51, 0x80, 0x00, 0x00
+};
+
+BUILD_ASSERT((sizeof(upload_data) - 1) / UPLOAD_CHUNK_SIZE ==
+	     (SENML_LENGTH - 1) / UPLOAD_CHUNK_SIZE);
+
+static avs_stream_t *stream;
+
+static K_THREAD_STACK_DEFINE(upload_stack, 2048);
+static struct k_thread upload_thread;
+static int upload_result;
+static char download_buffer[16];
+
+static int read_file(const char *path, char *buffer, size_t size)
+{
+	struct fs_dirent entry;
+	struct fs_file_t file;
+	int result = fs_stat(path, &entry);
+
+	if (result) {
+		return result;
+	}
+	if (entry.size >= size) {
+		return -ENOSPC;
+	}
+
+	fs_file_t_init(&file);
+	result = fs_open(&file, path, FS_O_READ);
+	if (result) {
+		return result;
+	}
+
+	ssize_t bytes_read = fs_read(&file, buffer, size - 1);
+
+	// close is not implemented by provision_fs, and mcumgr ignores it too
+	(void)fs_close(&file);
+	if (bytes_read < 0) {
+		return bytes_read;
+	}
+	buffer[bytes_read] = '\0';
+	return bytes_read == entry.size ? 0 : -EIO;
+}
+
+static int upload(void)
+{
+	for (size_t offset = 0; offset < sizeof(upload_data); offset += UPLOAD_CHUNK_SIZE) {
+		size_t length = MIN(UPLOAD_CHUNK_SIZE, sizeof(upload_data) - offset);
+		struct fs_file_t file;
+		int result;
+
+		fs_file_t_init(&file);
+		result = fs_open(&file, UPLOAD_PATH, FS_O_CREATE | FS_O_WRITE);
+		if (!result) {
+			result = fs_seek(&file, offset, FS_SEEK_SET);
+		}
+		if (!result) {
+			ssize_t written = fs_write(&file, upload_data + offset, length);
+
+			result = written == length ? 0 : written < 0 ? written : -EIO;
+		}
+		(void)fs_close(&file);
+		if (result) {
+			return result;
+		}
+	}
+	return 0;
+}
+
+static void upload_and_download_result(void *p1, void *p2, void *p3)
+{
+	(void)p1;
+	(void)p2;
+	(void)p3;
+
+	upload_result = upload();
+	if (!upload_result) {
+		// blocks until factory_flash_finished() is called
+		upload_result = read_file(RESULT_PATH, download_buffer, sizeof(download_buffer));
+	}
+}
+
+ZTEST(provision_fs, test_endpoint_file)
+{
+	char endpoint[64];
+
+	zassert_ok(read_file(ENDPOINT_PATH, endpoint, sizeof(endpoint)));
+	zassert_equal(strcmp(endpoint, anjay_zephyr_config_default_ep_name()), 0, "%s", endpoint);
+}
+
+ZTEST(provision_fs, test_open_modes)
+{
+	struct fs_file_t file;
+
+	fs_file_t_init(&file);
+	zassert_equal(fs_open(&file, UPLOAD_PATH, FS_O_READ), -ENOENT);
+	zassert_equal(fs_open(&file, RESULT_PATH, FS_O_WRITE), -ENOENT);
+	zassert_equal(fs_open(&file, "/factory/other.txt", FS_O_READ), -ENOENT);
+}
+
+ZTEST(provision_fs, test_upload)
+{
+	uint8_t received[sizeof(upload_data)];
+	size_t received_length = 0;
+	bool finished = false;
+
+	k_thread_create(&upload_thread, upload_stack, K_THREAD_STACK_SIZEOF(upload_stack),
+			upload_and_download_result, NULL, NULL, NULL, K_PRIO_PREEMPT(1), 0,
+			K_NO_WAIT);
+
+	while (!finished) {
+		size_t bytes_read;
+
+		zassert_true(avs_is_ok(avs_stream_read(
+			stream, &bytes_read, &finished, received + received_length,
+			MIN(READ_CHUNK_SIZE, sizeof(received) - received_length))));
+		received_length += bytes_read;
+	}
+	// the stream ends right after the CBOR item, before the trailing bytes
+	zassert_equal(received_length, SENML_LENGTH);
+	zassert_mem_equal(received, upload_data, SENML_LENGTH);
+
+	factory_flash_finished(0);
+	zassert_ok(k_thread_join(&upload_thread, K_SECONDS(5)));
+	zassert_ok(upload_result);
+	zassert_equal(strcmp(download_buffer, "0"), 0, "%s", download_buffer);
+}
+
+static void *provision_fs_setup(void)
+{
+	stream = factory_flash_input_stream_init();
+	zassert_not_null(stream);
+	return NULL;
+}
+
+ZTEST_SUITE(provision_fs, NULL, provision_fs_setup, NULL, NULL, NULL);
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/emul_sensor.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include "sensors_fixed.h"
+#include "sensors_stream.h"
+
+/*
+ * sensors_stream.c and sensors_fetch.c acquire from the emulated BMI160, whose
+ * readings are set through the sensor emulator backend. Each test checks that
+ * the values set come back from sensor_stream_get(), as the Accelerometer and
+ * Gyrometer objects of the demo would read them.
+ */
+
+// a few LSB of the default ranges of the BMI160: 2 g and 2000 deg/s
+#define ACCEL_TOLERANCE_MICRO 10000
+#define GYRO_TOLERANCE_MICRO 10000
+
+// long enough for the polling thread to acquire a few samples
+#define ACQUISITION_TIME_MS (3 * CONFIG_APP_SENSORS_STREAMING_POLL_PERIOD_MS)
+
+static const struct device *const bmi160 = DEVICE_DT_GET(DT_NODELABEL(bmi160));
+static const struct emul *const bmi160_emul = EMUL_DT_GET(DT_NODELABEL(bmi160));
+
+static struct sensor_stream accel_stream;
+static struct sensor_stream gyro_stream;
+
+/**
+ * Sets the three axes, in millionths of m/s^2 or rad/s, starting with the X
+ * axis channel @p x_channel.
+ */
+static void emul_set_axes(enum sensor_channel x_channel, const int64_t micro[SENSOR_STREAM_AXES])
+{
+	for (size_t axis = 0; axis < SENSOR_STREAM_AXES; axis++) {
+		// with a shift of 5, a q31 value covers +/-32 units
+		q31_t value = (q31_t)(micro[axis] * (INT64_C(1) << 26) / SENSOR_FIXED_MICRO);
+
+		zassert_ok(emul_sensor_backend_set_channel(bmi160_emul, x_channel + axis, &value,
+							   5));
+	}
+}
+
+static void assert_stream_values(struct sensor_stream *stream,
+				 const int64_t expected[SENSOR_STREAM_AXES], int64_t tolerance)
+{
+	int64_t values[SENSOR_STREAM_AXES];
+
+	zassert_ok(sensor_stream_get(stream, values));
+	for (size_t axis = 0; axis < SENSOR_STREAM_AXES; axis++) {
+		zassert_true(llabs(values[axis] - expected[axis]) <= tolerance,
+			     "axis %zu: read %lld, expected %lld", axis, values[axis],
+			     expected[axis]);
+	}
+}
+
+static void *sensors_stream_suite_setup(void)
+{
+	zassert_true(device_is_ready(bmi160));
+	zassert_true(emul_sensor_backend_is_supported(bmi160_emul));
+	return NULL;
+}
+
+ZTEST_SUITE(sensors_stream, NULL, sensors_stream_suite_setup, NULL, NULL, NULL);
+
+ZTEST(sensors_stream, test_no_sample_before_start)
+{
+	struct sensor_stream stream = { 0 };
+	int64_t values[SENSOR_STREAM_AXES];
+
+	zassert_equal(sensor_stream_get(&stream, values), -EAGAIN);
+}
+
+ZTEST(sensors_stream, test_accelerometer_follows_the_sensor)
+{
+	const int64_t first[SENSOR_STREAM_AXES] = { 1500000, -750000, 9806650 };
+	const int64_t second[SENSOR_STREAM_AXES] = { -3250000, 125000, -9806650 };
+
+	emul_set_axes(SENSOR_CHAN_ACCEL_X, first);
+	zassert_ok(sensor_stream_start(&accel_stream, bmi160, SENSOR_CHAN_ACCEL_XYZ));
+	k_msleep(ACQUISITION_TIME_MS);
+	assert_stream_values(&accel_stream, first, ACCEL_TOLERANCE_MICRO);
+
+	// acquisition goes on in the background
+	emul_set_axes(SENSOR_CHAN_ACCEL_X, second);
+	k_msleep(ACQUISITION_TIME_MS);
+	assert_stream_values(&accel_stream, second, ACCEL_TOLERANCE_MICRO);
+}
+
+ZTEST(sensors_stream, test_gyrometer_shares_the_device)
+{
+	const int64_t accel[SENSOR_STREAM_AXES] = { 250000, 500000, -1000000 };
+	const int64_t gyro[SENSOR_STREAM_AXES] = { 500000, -1250000, 2000000 };
+
+	emul_set_axes(SENSOR_CHAN_ACCEL_X, accel);
+	emul_set_axes(SENSOR_CHAN_GYRO_X, gyro);
+	zassert_ok(sensor_stream_start(&accel_stream, bmi160, SENSOR_CHAN_ACCEL_XYZ));
+	zassert_ok(sensor_stream_start(&gyro_stream, bmi160, SENSOR_CHAN_GYRO_XYZ));
+	k_msleep(ACQUISITION_TIME_MS);
+
+	// both channels are read from the samples fetched for the two streams
+	assert_stream_values(&gyro_stream, gyro, GYRO_TOLERANCE_MICRO);
+	assert_stream_values(&accel_stream, accel, ACCEL_TOLERANCE_MICRO);
+}
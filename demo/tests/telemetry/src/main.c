@@ -0,0 +1,403 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <anjay/lwm2m_send.h>
+
+#include "object_refresh.h"
+#include "telemetry.h"
+#include "telemetry_store.h"
+
+/*
+ * telemetry.c and telemetry_store.c run against the simulated flash, with
+ * LwM2M Send replaced by the fakes below (see CMakeLists.txt). A fake Send
+ * either fails as if the client were offline, or records the readings of the
+ * batch and leaves it in flight until the test completes it.
+ */
+
+#define OID_TEMPERATURE 3303
+#define RID_SENSOR_VALUE 5700
+#define OID_LOCATION 6
+#define RID_LATITUDE 0
+#define RID_LONGITUDE 1
+#define RID_ALTITUDE 2
+
+#define OFFLINE_HOURS 4
+#define ONLINE_MINUTES 30
+#define MAX_PENDING_SAMPLES                                                                        \
+	(CONFIG_APP_TELEMETRY_MAX_LATENCY / CONFIG_APP_TELEMETRY_SAMPLE_PERIOD + 1)
+
+#define FAKE_MAX_READINGS 16384
+
+// coordinates that a float cannot hold
+#define LATITUDE 50.06145012345
+#define LONGITUDE 19.93657054321
+#define ALTITUDE 219.125
+
+struct fake_reading {
+	anjay_oid_t oid;
+	anjay_rid_t rid;
+	int64_t timestamp_ms;
+	double value;
+};
+
+struct fake_batch {
+	size_t count;
+	struct fake_reading readings[CONFIG_APP_TELEMETRY_BUFFER_SIZE];
+};
+
+static int fake_anjay_instance;
+#define FAKE_ANJAY ((anjay_t *)&fake_anjay_instance)
+
+static struct fake_batch fake_builder;
+static struct fake_batch fake_compiled;
+static struct fake_batch fake_in_flight;
+static bool fake_offline;
+static anjay_send_finished_handler_t *fake_handler;
+static void *fake_handler_data;
+
+static struct fake_reading delivered[FAKE_MAX_READINGS];
+static size_t delivered_count;
+
+// the temperature reading with the value n + 0.1 is the n-th one sampled
+static size_t samples_count;
+
+void object_refresh_request(enum object_refresh_source source)
+{
+	(void)source;
+}
+
+anjay_send_batch_builder_t *__wrap_anjay_send_batch_builder_new(void)
+{
+	fake_builder.count = 0;
+	return (anjay_send_batch_builder_t *)&fake_builder;
+}
+
+void __wrap_anjay_send_batch_builder_cleanup(anjay_send_batch_builder_t **builder)
+{
+	*builder = NULL;
+}
+
+static int fake_add(anjay_send_batch_builder_t *builder, anjay_oid_t oid, anjay_rid_t rid,
+		    avs_time_real_t timestamp, double value)
+{
+	struct fake_batch *batch = (struct fake_batch *)builder;
+
+	zassert_equal_ptr(batch, &fake_builder);
+	zassert_true(batch->count < ARRAY_SIZE(batch->readings), "batch overflow");
+
+	struct fake_reading *reading = &batch->readings[batch->count++];
+
+	reading->oid = oid;
+	reading->rid = rid;
+	reading->value = value;
+	zassert_ok(avs_time_real_to_scalar(&reading->timestamp_ms, AVS_TIME_MS, timestamp));
+	return 0;
+}
+
+int __wrap_anjay_send_batch_add_bool(anjay_send_batch_builder_t *builder, anjay_oid_t oid,
+				     anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+				     avs_time_real_t timestamp, bool value)
+{
+	(void)iid;
+	(void)riid;
+
+	return fake_add(builder, oid, rid, timestamp, value ? 1.0 : 0.0);
+}
+
+int __wrap_anjay_send_batch_add_double(anjay_send_batch_builder_t *builder, anjay_oid_t oid,
+				       anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
+				       avs_time_real_t timestamp, double value)
+{
+	(void)iid;
+	(void)riid;
+
+	return fake_add(builder, oid, rid, timestamp, value);
+}
+
+anjay_send_batch_t *__wrap_anjay_send_batch_builder_compile(anjay_send_batch_builder_t **builder)
+{
+	fake_compiled = *(struct fake_batch *)*builder;
+	*builder = NULL;
+	return (anjay_send_batch_t *)&fake_compiled;
+}
+
+void __wrap_anjay_send_batch_release(anjay_send_batch_t **batch)
+{
+	*batch = NULL;
+}
+
+anjay_send_result_t __wrap_anjay_send(anjay_t *anjay, anjay_ssid_t ssid,
+				      const anjay_send_batch_t *batch,
+				      anjay_send_finished_handler_t *finished_handler,
+				      void *finished_handler_data)
+{
+	(void)ssid;
+
+	zassert_equal_ptr(anjay, FAKE_ANJAY);
+	zassert_is_null(fake_handler, "only one Send may be in flight");
+	if (fake_offline) {
+		return ANJAY_SEND_ERR_OFFLINE;
+	}
+
+	fake_in_flight = *(const struct fake_batch *)batch;
+	fake_handler = finished_handler;
+	fake_handler_data = finished_handler_data;
+	return ANJAY_SEND_OK;
+}
+
+anjay_send_result_t __wrap_anjay_send_deferrable(anjay_t *anjay, anjay_ssid_t ssid,
+						 const anjay_send_batch_t *batch,
+						 anjay_send_finished_handler_t *finished_handler,
+						 void *finished_handler_data)
+{
+	return __wrap_anjay_send(anjay, ssid, batch, finished_handler, finished_handler_data);
+}
+
+static bool fake_complete_send(void)
+{
+	anjay_send_finished_handler_t *handler = fake_handler;
+
+	if (!handler) {
+		return false;
+	}
+
+	zassert_true(delivered_count + fake_in_flight.count <= ARRAY_SIZE(delivered));
+	memcpy(&delivered[delivered_count], fake_in_flight.readings,
+	       fake_in_flight.count * sizeof(*fake_in_flight.readings));
+	delivered_count += fake_in_flight.count;
+
+	fake_handler = NULL;
+	handler(FAKE_ANJAY, 1, (const anjay_send_batch_t *)&fake_in_flight, ANJAY_SEND_SUCCESS,
+		fake_handler_data);
+	return true;
+}
+
+static int read_temperature(anjay_iid_t iid, void *arg, double *out_values)
+{
+	(void)iid;
+	(void)arg;
+
+	out_values[0] = (double)samples_count++ + 0.1;
+	return 0;
+}
+
+static double location_value(anjay_rid_t rid)
+{
+	switch (rid) {
+	case RID_LATITUDE:
+		return LATITUDE;
+	case RID_LONGITUDE:
+		return LONGITUDE;
+	default:
+		return ALTITUDE;
+	}
+}
+
+static int read_location(anjay_iid_t iid, void *arg, double *out_values)
+{
+	(void)iid;
+	(void)arg;
+
+	out_values[0] = location_value(RID_LATITUDE);
+	out_values[1] = location_value(RID_LONGITUDE);
+	out_values[2] = location_value(RID_ALTITUDE);
+	return 0;
+}
+
+/**
+ * Runs the telemetry refresh for @p seconds of simulated time, completing
+ * every Send right away unless offline.
+ */
+static void run_for(int64_t seconds)
+{
+	int64_t end_ms = k_uptime_get() + seconds * MSEC_PER_SEC;
+
+	while (k_uptime_get() < end_ms) {
+		avs_time_monotonic_t next = telemetry_update(FAKE_ANJAY);
+
+		if (fake_complete_send()) {
+			continue;
+		}
+
+		int64_t next_ms = end_ms;
+
+		if (avs_time_monotonic_valid(next)) {
+			int64_t deadline_ms;
+
+			avs_time_monotonic_to_scalar(&deadline_ms, AVS_TIME_MS, next);
+			next_ms = MIN(MAX(deadline_ms, k_uptime_get() + 1), end_ms);
+		}
+		k_sleep(K_TIMEOUT_ABS_MS(next_ms));
+	}
+}
+
+static int compare_readings(const void *a, const void *b)
+{
+	double va = ((const struct fake_reading *)a)->value;
+	double vb = ((const struct fake_reading *)b)->value;
+
+	return (va > vb) - (va < vb);
+}
+
+struct collected {
+	size_t count;
+	struct telemetry_reading readings[8];
+};
+
+static int collect_reading(const struct telemetry_reading *reading, void *arg)
+{
+	struct collected *collected = arg;
+
+	zassert_true(collected->count < ARRAY_SIZE(collected->readings));
+	collected->readings[collected->count++] = *reading;
+	return 0;
+}
+
+static int discard_reading(const struct telemetry_reading *reading, void *arg)
+{
+	(void)reading;
+	(void)arg;
+
+	return 0;
+}
+
+static void *telemetry_suite_setup(void)
+{
+	telemetry_init();
+	return NULL;
+}
+
+static void telemetry_before(void *fixture)
+{
+	(void)fixture;
+
+	telemetry_reset();
+	while (!telemetry_store_empty()) {
+		telemetry_store_peek(discard_reading, NULL);
+		telemetry_store_pop();
+	}
+
+	fake_offline = false;
+	fake_handler = NULL;
+	delivered_count = 0;
+	samples_count = 0;
+}
+
+ZTEST_SUITE(telemetry, NULL, telemetry_suite_setup, telemetry_before, NULL, NULL);
+
+ZTEST(telemetry, test_store_round_trip)
+{
+	const struct telemetry_reading readings[] = {
+		{ 1700000000000, LATITUDE, OID_LOCATION, 0, 0, false },
+		{ 1700000000000, LONGITUDE, OID_LOCATION, 0, 1, false },
+		{ 1700000000010, -273.15, OID_TEMPERATURE, 0, RID_SENSOR_VALUE, false },
+		// the clock may step back
+		{ 1699999999990, 1.0, 3342, 0, 5500, true },
+		{ 1700000010000, LATITUDE + 1e-9, OID_LOCATION, 0, 0, false },
+	};
+	struct collected collected = { 0 };
+
+	zassert_ok(telemetry_store_append(readings, ARRAY_SIZE(readings)));
+	zassert_false(telemetry_store_empty());
+
+	// until popped, the same block is returned
+	for (int pass = 0; pass < 2; pass++) {
+		collected.count = 0;
+		zassert_ok(telemetry_store_peek(collect_reading, &collected));
+		zassert_equal(collected.count, ARRAY_SIZE(readings));
+
+		for (size_t i = 0; i < ARRAY_SIZE(readings); i++) {
+			const struct telemetry_reading *out = &collected.readings[i];
+
+			zassert_equal(out->timestamp_ms, readings[i].timestamp_ms);
+			zassert_true(out->value == readings[i].value, "value %zu changed", i);
+			zassert_equal(out->oid, readings[i].oid);
+			zassert_equal(out->iid, readings[i].iid);
+			zassert_equal(out->rid, readings[i].rid);
+			zassert_equal(out->is_bool, readings[i].is_bool);
+		}
+	}
+
+	telemetry_store_pop();
+	zassert_true(telemetry_store_empty());
+}
+
+ZTEST(telemetry, test_offline_for_hours)
+{
+	static const anjay_rid_t temperature_rids[] = { RID_SENSOR_VALUE };
+	static const anjay_rid_t location_rids[] = { RID_LATITUDE, RID_LONGITUDE, RID_ALTITUDE };
+	static struct fake_reading temperatures[FAKE_MAX_READINGS];
+	size_t temperatures_count = 0;
+
+	zassert_ok(telemetry_source_add(OID_TEMPERATURE, 0, temperature_rids,
+					ARRAY_SIZE(temperature_rids), false, read_temperature,
+					NULL));
+	zassert_ok(telemetry_source_add(OID_LOCATION, 0, location_rids, ARRAY_SIZE(location_rids),
+					false, read_location, NULL));
+
+	fake_offline = true;
+	run_for(OFFLINE_HOURS * 3600);
+	zassert_equal(delivered_count, 0);
+	zassert_false(telemetry_store_empty());
+
+	size_t offline_samples = samples_count;
+
+	fake_offline = false;
+	run_for(ONLINE_MINUTES * 60);
+	zassert_true(telemetry_store_empty(), "backlog not drained");
+
+	for (size_t i = 0; i < delivered_count; i++) {
+		const struct fake_reading *reading = &delivered[i];
+
+		if (reading->oid == OID_TEMPERATURE) {
+			temperatures[temperatures_count++] = *reading;
+		} else {
+			zassert_equal(reading->oid, OID_LOCATION);
+			zassert_true(reading->value == location_value(reading->rid),
+				     "location /6/0/%u changed", reading->rid);
+		}
+	}
+	zassert_equal(delivered_count, 4 * temperatures_count);
+
+	qsort(temperatures, temperatures_count, sizeof(*temperatures), compare_readings);
+
+	size_t first = (size_t)temperatures[0].value;
+
+	// the partition cannot hold hours of readings, so the oldest were evicted
+	zassert_true(first > 0, "nothing evicted");
+	// but the rest of the backlog was delivered
+	zassert_true(first < offline_samples, "no offline readings delivered");
+
+	for (size_t i = 0; i < temperatures_count; i++) {
+		zassert_true(temperatures[i].value == (double)(first + i) + 0.1,
+			     "reading %zu missing, duplicated or changed", first + i);
+		if (i > 0) {
+			zassert_true(temperatures[i].timestamp_ms >
+					     temperatures[i - 1].timestamp_ms,
+				     "reading %zu out of order", first + i);
+		}
+	}
+
+	// only the readings sampled within max_latency may still be pending
+	zassert_true(first + temperatures_count + MAX_PENDING_SAMPLES >= samples_count,
+		     "%zu of %zu readings delivered", first + temperatures_count, samples_count);
+}
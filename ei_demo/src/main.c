@@ -20,6 +20,8 @@
 #include <anjay_zephyr/lwm2m.h>
 #include <anjay_zephyr/objects.h>
 
+#include "heap_stats.h"
+#include "latency_stats.h"
 #include "objects/objects.h"
 #include "led.h"
 
@@ -29,11 +31,21 @@ static avs_sched_handle_t update_objects_handle;
 
 static int register_objects(anjay_t *anjay)
 {
-	pattern_detector_obj = pattern_detector_object_create();
+	HEAP_STATS_TAG(HEAP_TAG_PATTERN_DETECTOR)
+	{
+		pattern_detector_obj = pattern_detector_object_create();
+	}
 	if (pattern_detector_obj) {
 		anjay_register_object(anjay, pattern_detector_obj);
 	}
 
+#ifdef CONFIG_APP_LATENCY_STATS
+	latency_stats_object_install(anjay);
+#endif // CONFIG_APP_LATENCY_STATS
+#ifdef CONFIG_APP_HEAP_STATS
+	heap_stats_object_install(anjay);
+#endif // CONFIG_APP_HEAP_STATS
+
 	return 0;
 }
 
@@ -41,7 +53,10 @@ static void update_objects(avs_sched_t *sched, const void *anjay_ptr)
 {
 	anjay_t *anjay = *(anjay_t *const *)anjay_ptr;
 
-	pattern_detector_object_update(anjay, pattern_detector_obj);
+	LATENCY_MEASURE(LATENCY_PROBE_UPDATE_OBJECTS)
+	{
+		pattern_detector_object_update(anjay, pattern_detector_obj);
+	}
 
 	AVS_SCHED_DELAYED(sched, &update_objects_handle,
 			  avs_time_duration_from_scalar(1, AVS_TIME_S), update_objects, &anjay,
@@ -71,7 +86,8 @@ static int clean_before_anjay_destroy(anjay_t *anjay)
 	return 0;
 }
 
-int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reason)
+static int handle_lwm2m_callback(anjay_t *anjay,
+				 enum anjay_zephyr_lwm2m_callback_reasons reason)
 {
 	switch (reason) {
 	case ANJAY_ZEPHYR_LWM2M_CALLBACK_REASON_INIT:
@@ -87,6 +103,17 @@ int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reas
 	}
 }
 
+int lwm2m_callback(anjay_t *anjay, enum anjay_zephyr_lwm2m_callback_reasons reason)
+{
+	int result;
+
+	LATENCY_MEASURE(LATENCY_PROBE_LWM2M_CALLBACK)
+	{
+		result = handle_lwm2m_callback(anjay, reason);
+	}
+	return result;
+}
+
 int main(void)
 {
 	led_init();
@@ -36,7 +36,9 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/kernel.h>
 
+#include "latency_stats.h"
 #include "../led.h"
+#include "dm_table.h"
 #include "objects.h"
 #include <ei_wrapper.h>
 
@@ -85,8 +87,17 @@ struct pattern_detector_instance {
 	const char *pattern_name;
 };
 
+static const struct dm_table_resource pattern_detector_resources[] = {
+	DM_TABLE_RESOURCE(RID_DETECTOR_STATE, ANJAY_DM_RES_R, DM_TABLE_BOOL,
+			  struct pattern_detector_instance, cached_state.detector_state),
+	DM_TABLE_RESOURCE(RID_DETECTOR_COUNTER, ANJAY_DM_RES_R, DM_TABLE_I32,
+			  struct pattern_detector_instance, cached_state.detector_counter),
+	DM_TABLE_RESOURCE(RID_PATTERN_NAME, ANJAY_DM_RES_R, DM_TABLE_STRING_PTR,
+			  struct pattern_detector_instance, pattern_name)
+};
+
 struct pattern_detector_object {
-	const anjay_dm_object_def_t *def;
+	struct dm_table_object table;
 	const struct device *dev;
 
 	struct pattern_detector_instance *instances;
@@ -99,10 +110,6 @@ struct pattern_detector_object {
 
 static const struct pattern_detector_instance_state initial_state;
 
-#define SYNCHRONIZED(Mtx)                                                                          \
-	for (int _synchronized_exit = k_mutex_lock(&(Mtx), K_FOREVER); !_synchronized_exit;        \
-	     _synchronized_exit = -1, k_mutex_unlock(&(Mtx)))
-
 static struct pattern_detector_object *installed_obj;
 static bool wrapper_initialized;
 
@@ -126,12 +133,6 @@ static void schedule_next_measure(struct pattern_detector_object *obj)
 	k_work_schedule(&obj->measure_accel_dwork, next_run_delay);
 }
 
-static struct pattern_detector_instance *find_instance(const struct pattern_detector_object *obj,
-						       anjay_iid_t iid)
-{
-	return iid < ei_wrapper_get_classifier_label_count() ? &obj->instances[iid] : NULL;
-}
-
 static void result_ready_cb(int err)
 {
 	assert(installed_obj);
@@ -197,8 +198,9 @@ static void measure_accel_handler(struct k_work *work)
 
 	float fvalues[CH_COUNT];
 
+	// the classifier takes floats, so there is no need to go through software double math
 	for (size_t i = 0; i < CH_COUNT; i++) {
-		fvalues[i] = (float)sensor_value_to_double(&values[i]);
+		fvalues[i] = sensor_value_to_float(&values[i]);
 	}
 
 	int err = ei_wrapper_add_data(fvalues, CH_COUNT);
@@ -214,20 +216,7 @@ static void measure_accel_handler(struct k_work *work)
 
 static inline struct pattern_detector_object *get_obj(const anjay_dm_object_def_t *const *obj_ptr)
 {
-	assert(obj_ptr);
-	return AVS_CONTAINER_OF(obj_ptr, struct pattern_detector_object, def);
-}
-
-static int list_instances(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
-			  anjay_dm_list_ctx_t *ctx)
-{
-	(void)anjay;
-
-	for (size_t i = 0; i < ei_wrapper_get_classifier_label_count(); i++) {
-		anjay_dm_emit(ctx, i);
-	}
-
-	return 0;
+	return AVS_CONTAINER_OF(dm_table_get_obj(obj_ptr), struct pattern_detector_object, table);
 }
 
 static int init_instance(struct pattern_detector_instance *inst, anjay_iid_t iid)
@@ -251,56 +240,24 @@ static struct pattern_detector_instance *add_instance(struct pattern_detector_ob
 	return init_instance(created, iid) ? NULL : created;
 }
 
-static int list_resources(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
-			  anjay_iid_t iid, anjay_dm_resource_list_ctx_t *ctx)
-{
-	(void)anjay;
-	(void)obj_ptr;
-	(void)iid;
-
-	anjay_dm_emit_res(ctx, RID_DETECTOR_STATE, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
-	anjay_dm_emit_res(ctx, RID_DETECTOR_COUNTER, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
-	anjay_dm_emit_res(ctx, RID_PATTERN_NAME, ANJAY_DM_RES_R, ANJAY_DM_RES_PRESENT);
-	return 0;
-}
-
 static int resource_read(anjay_t *anjay, const anjay_dm_object_def_t *const *obj_ptr,
 			 anjay_iid_t iid, anjay_rid_t rid, anjay_riid_t riid,
 			 anjay_output_ctx_t *ctx)
 {
-	(void)anjay;
-
-	struct pattern_detector_object *obj = get_obj(obj_ptr);
-
-	assert(obj);
+	int result;
 
-	struct pattern_detector_instance *inst = find_instance(obj, iid);
-
-	assert(inst);
-
-	switch (rid) {
-	case RID_DETECTOR_STATE:
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_ret_bool(ctx, inst->cached_state.detector_state);
-
-	case RID_DETECTOR_COUNTER:
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_ret_i32(ctx, inst->cached_state.detector_counter);
-
-	case RID_PATTERN_NAME:
-		assert(riid == ANJAY_ID_INVALID);
-		return anjay_ret_string(ctx, inst->pattern_name);
-
-	default:
-		return ANJAY_ERR_METHOD_NOT_ALLOWED;
+	LATENCY_MEASURE(LATENCY_PROBE_PATTERN_DETECTOR_READ)
+	{
+		result = dm_table_resource_read(anjay, obj_ptr, iid, rid, riid, ctx);
 	}
+	return result;
 }
 
 static const anjay_dm_object_def_t obj_def = { .oid = 33650,
 					       .handlers = {
-						       .list_instances = list_instances,
+						       .list_instances = dm_table_list_instances,
 
-						       .list_resources = list_resources,
+						       .list_resources = dm_table_list_resources,
 						       .resource_read = resource_read,
 					       } };
 
@@ -343,7 +300,6 @@ const anjay_dm_object_def_t **pattern_detector_object_create(void)
 	if (!obj) {
 		return NULL;
 	}
-	obj->def = &obj_def;
 	obj->dev = dev;
 
 	obj->instances = (struct pattern_detector_instance *)avs_calloc(
@@ -366,11 +322,22 @@ const anjay_dm_object_def_t **pattern_detector_object_create(void)
 
 	k_mutex_init(&obj->instance_state_mtx);
 
+	obj->table = (struct dm_table_object){
+		.def = &obj_def,
+		.resources = pattern_detector_resources,
+		.resource_count = ARRAY_SIZE(pattern_detector_resources),
+		.instances = obj->instances,
+		.instance_size = sizeof(struct pattern_detector_instance),
+		.instance_count = ei_wrapper_get_classifier_label_count(),
+		.present_offset = DM_TABLE_ALWAYS_PRESENT,
+		.mutex = &obj->instance_state_mtx
+	};
+
 	k_work_init_delayable(&obj->measure_accel_dwork, measure_accel_handler);
 	obj->last_run_timestamp = k_uptime_get();
 	schedule_next_measure(obj);
 
-	return &obj->def;
+	return &obj->table.def;
 }
 
 void pattern_detector_object_update(anjay_t *anjay, const anjay_dm_object_def_t *const *def)
@@ -388,12 +355,14 @@ void pattern_detector_object_update(anjay_t *anjay, const anjay_dm_object_def_t
 
 			if (it->cached_state.detector_state != it->curr_state.detector_state) {
 				it->cached_state.detector_state = it->curr_state.detector_state;
-				anjay_notify_changed(anjay, obj->def->oid, i, RID_DETECTOR_STATE);
+				anjay_notify_changed(anjay, obj->table.def->oid, i,
+						     RID_DETECTOR_STATE);
 			}
 
 			if (it->cached_state.detector_counter != it->curr_state.detector_counter) {
 				it->cached_state.detector_counter = it->curr_state.detector_counter;
-				anjay_notify_changed(anjay, obj->def->oid, i, RID_DETECTOR_COUNTER);
+				anjay_notify_changed(anjay, obj->table.def->oid, i,
+						     RID_DETECTOR_COUNTER);
 			}
 		}
 	}
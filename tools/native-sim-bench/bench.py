@@ -0,0 +1,365 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+# Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import argparse
+import asyncio
+import json
+import os
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+from lwm2m_server import LwM2MServer
+
+SCRIPT_DIR = os.path.dirname(os.path.realpath(__file__))
+REPO_DIR = os.path.dirname(os.path.dirname(SCRIPT_DIR))
+
+HEAP_RE = re.compile(r'bench: heap (\S+) used=(\d+) peak=(\d+) size=(\d+)')
+STACK_RE = re.compile(r'bench: stack (.+) used=(\d+) size=(\d+)')
+WAKEUPS_RE = re.compile(r'bench: wakeups count=(\d+) uptime_ms=(\d+) interval_ms=(\d+)')
+
+
+def build(app_dir, build_dir, board, port):
+    subprocess.run(['west', 'build', '-b', board, '-d', build_dir, app_dir, '-p', 'auto', '--',
+                    f'-DEXTRA_ZEPHYR_MODULES={os.path.join(SCRIPT_DIR, "module")}',
+                    f'-DEXTRA_CONF_FILE={os.path.join(SCRIPT_DIR, "bench.conf")}',
+                    f'-DCONFIG_ANJAY_ZEPHYR_SERVER_URI="coap://127.0.0.1:{port}"'],
+                   check=True)
+
+
+class DeviceReport:
+    """
+    Keeps the last complete usage report printed by the bench_report module.
+    """
+
+    def __init__(self):
+        self.heaps = {}
+        self.stacks = {}
+        self.wakeups = None
+        self._heaps = {}
+        self._stacks = {}
+        self._wakeups = None
+        self.lines = 0
+
+    def feed(self, line):
+        self.lines += 1
+        match = HEAP_RE.search(line)
+        if match:
+            self._heaps[match[1]] = {'used': int(match[2]), 'peak': int(match[3]),
+                                     'size': int(match[4])}
+            return
+        match = STACK_RE.search(line)
+        if match:
+            self._stacks[match[1]] = {'used': int(match[2]), 'size': int(match[3])}
+            return
+        match = WAKEUPS_RE.search(line)
+        if match:
+            self._wakeups = {'count': int(match[1]), 'uptime_ms': int(match[2]),
+                             'interval_ms': int(match[3])}
+            return
+        if 'bench: end' in line:
+            self.heaps, self._heaps = self._heaps, {}
+            self.stacks, self._stacks = self._stacks, {}
+            self.wakeups, self._wakeups = self._wakeups, None
+
+
+async def read_console(stream, report, log_file):
+    while True:
+        line = await stream.readline()
+        if not line:
+            return
+        line = line.decode(errors='replace').rstrip()
+        if log_file:
+            print(line, file=log_file)
+        report.feed(line)
+
+
+def summarize(values):
+    if not values:
+        return None
+    return {'count': len(values), 'min': min(values), 'mean': statistics.mean(values),
+            'max': max(values)}
+
+
+async def measure_idle(report, duration):
+    first = report.wakeups
+    await asyncio.sleep(duration)
+    last = report.wakeups
+    if not first or not last or last['uptime_ms'] <= first['uptime_ms']:
+        return None
+    seconds = (last['uptime_ms'] - first['uptime_ms']) / 1000
+    count = last['count'] - first['count']
+    # the usage report itself wakes the CPU once per interval
+    own = seconds * 1000 / last['interval_ms']
+    per_second = max(0.0, (count - own) / seconds)
+    return {'seconds': seconds, 'count': count, 'per_second': per_second,
+            'per_hour': per_second * 3600}
+
+
+async def run_scenario(server, report, args, results):
+    await server.registered.wait()
+
+    if not server.server_iids:
+        print('warning: no Server object instance in the Register payload', file=sys.stderr)
+    else:
+        rtts = []
+        for _ in range(args.updates):
+            await asyncio.sleep(args.update_interval)
+            rtts.append(await server.trigger_update(server.server_iids[0]) * 1000)
+        results['update_rtt_ms'] = summarize(rtts)
+
+    if args.idle_time > 0:
+        idle = await measure_idle(report, args.idle_time)
+        if idle:
+            results['idle_wakeups'] = idle
+        else:
+            print('warning: no wakeup counts reported; was it built with bench.conf?',
+                  file=sys.stderr)
+
+    if args.observe:
+        await server.write_attributes(args.observe, pmin=args.pmin, pmax=args.pmax)
+        if await server.observe(args.observe):
+            start = time.monotonic()
+            first = len(server.notifications)
+            await asyncio.sleep(args.observe_time)
+            count = len(server.notifications) - first
+            results['notify'] = {'path': args.observe, 'count': count,
+                                 'per_second': count / (time.monotonic() - start)}
+        else:
+            print(f'warning: could not observe {args.observe}', file=sys.stderr)
+
+
+async def bench(args, executable):
+    loop = asyncio.get_running_loop()
+    transport, server = await loop.create_datagram_endpoint(
+        LwM2MServer, local_addr=('127.0.0.1', args.port))
+
+    report = DeviceReport()
+    results = {}
+    log_file = open(args.log, 'w') if args.log else None
+    workdir = tempfile.TemporaryDirectory()
+    try:
+        start = time.monotonic()
+        # the flash simulator file lives in a fresh directory, so settings
+        # persisted by a previous run cannot override the build configuration
+        process = await asyncio.create_subprocess_exec(
+            executable, cwd=workdir.name, stdin=asyncio.subprocess.DEVNULL,
+            stdout=asyncio.subprocess.PIPE, stderr=asyncio.subprocess.STDOUT)
+        console = asyncio.create_task(read_console(process.stdout, report, log_file))
+
+        try:
+            await asyncio.wait_for(server.registered.wait(), args.register_timeout)
+            results['register_latency_ms'] = (server.registrations[0] - start) * 1000
+            await asyncio.wait_for(run_scenario(server, report, args, results), args.timeout)
+            # wait for one more usage report that covers the whole scenario
+            await asyncio.sleep(args.report_wait)
+        except asyncio.TimeoutError:
+            print('error: the client did not finish the scenario in time', file=sys.stderr)
+            results['error'] = 'timeout'
+        finally:
+            if process.returncode is None:
+                process.terminate()
+            await process.wait()
+            await console
+
+        results['registrations'] = len(server.registrations)
+        results['updates'] = len(server.updates)
+        results['sends'] = len(server.sends)
+        results['heap'] = report.heaps
+        results['stacks'] = report.stacks
+    finally:
+        transport.close()
+        workdir.cleanup()
+        if log_file:
+            log_file.close()
+    return results
+
+
+def print_results(results):
+    def fmt(value):
+        return f'{value:.1f}' if isinstance(value, float) else str(value)
+
+    if 'register_latency_ms' in results:
+        print(f'Registration latency:   {fmt(results["register_latency_ms"])} ms '
+              '(from process start)')
+    rtt = results.get('update_rtt_ms')
+    if rtt:
+        print(f'Update round trip:      min {fmt(rtt["min"])} / mean {fmt(rtt["mean"])} / '
+              f'max {fmt(rtt["max"])} ms over {rtt["count"]} triggers')
+    idle = results.get('idle_wakeups')
+    if idle:
+        print(f'Idle wakeups:           {fmt(idle["per_second"])}/s, '
+              f'{fmt(idle["per_hour"])}/h ({idle["count"]} over {fmt(idle["seconds"])} s, '
+              'excluding the usage report)')
+    notify = results.get('notify')
+    if notify:
+        print(f'Notify throughput:      {fmt(notify["per_second"])}/s '
+              f'({notify["count"]} notifications of {notify["path"]})')
+    print(f'Messages:               {results["registrations"]} Register, '
+          f'{results["updates"]} Update, {results["sends"]} Send')
+
+    for name, heap in sorted(results['heap'].items()):
+        print(f'Heap ({name}):{" " * max(1, 16 - len(name))}peak {heap["peak"]} B, '
+              f'used {heap["used"]} B of {heap["size"]} B')
+    if results['stacks']:
+        print('Stack watermarks:')
+        for name, stack in sorted(results['stacks'].items()):
+            print(f'  {name:<24} {stack["used"]:>6} / {stack["size"]:<6} B '
+                  f'({100 * stack["used"] // max(stack["size"], 1)}%)')
+    if not results['heap'] and not results['stacks']:
+        print('No usage report received from the device; was it built with bench.conf?')
+
+
+def run(args, app_dir, build_dir):
+    if not args.no_build:
+        build(app_dir, build_dir, args.board, args.port)
+
+    executable = os.path.join(build_dir, 'zephyr', 'zephyr.exe')
+    if not os.path.exists(executable):
+        sys.exit(f'{executable} does not exist')
+
+    results = asyncio.run(bench(args, executable))
+    results['app'] = os.path.basename(os.path.normpath(app_dir))
+    results['board'] = args.board
+    return results
+
+
+def run_revision(args, app_dir, build_dir, revision):
+    """
+    Benchmarks the application as of another revision of this repository,
+    checked out into a temporary git worktree. Board files for the benchmarked
+    board are copied from the current tree if that revision has none, as
+    native_sim support was added to the applications later than some of the
+    changes worth comparing against.
+    """
+    worktree = tempfile.mkdtemp(prefix='bench-worktree-')
+    subprocess.run(['git', '-C', REPO_DIR, 'worktree', 'add', '--detach', worktree, revision],
+                   check=True)
+    try:
+        relative_app_dir = os.path.relpath(app_dir, REPO_DIR)
+        old_app_dir = os.path.join(worktree, relative_app_dir)
+        if relative_app_dir.startswith(os.pardir) or not os.path.isdir(old_app_dir):
+            sys.exit(f'{relative_app_dir} does not exist in {revision}')
+
+        boards_dir = os.path.join(app_dir, 'boards')
+        old_boards_dir = os.path.join(old_app_dir, 'boards')
+        os.makedirs(old_boards_dir, exist_ok=True)
+        for name in os.listdir(boards_dir) if os.path.isdir(boards_dir) else []:
+            if (os.path.splitext(name)[0] == args.board
+                    and not os.path.exists(os.path.join(old_boards_dir, name))):
+                shutil.copy(os.path.join(boards_dir, name), old_boards_dir)
+
+        results = run(args, old_app_dir, build_dir)
+        results['revision'] = revision
+        return results
+    finally:
+        subprocess.run(['git', '-C', REPO_DIR, 'worktree', 'remove', '--force', worktree],
+                       check=False)
+
+
+def print_comparison(before, after):
+    idle_before = before.get('idle_wakeups')
+    idle_after = after.get('idle_wakeups')
+    if not idle_before or not idle_after:
+        print('No idle wakeup counts to compare')
+        return
+    print(f'Idle wakeups per hour:  {idle_before["per_hour"]:.0f} at {before["revision"]}, '
+          f'{idle_after["per_hour"]:.0f} in the current tree')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Build an application for native_sim and benchmark it against a local '
+                    'LwM2M Server stand-in.')
+    parser.add_argument('app', type=str,
+                        help='Application to benchmark: "minimal", "demo" or a path to an '
+                             'application directory')
+    parser.add_argument('-b', '--board', type=str, default='native_sim',
+                        help='Board to build for (default: native_sim)')
+    parser.add_argument('-d', '--build_dir', type=str,
+                        help='Build directory (default: build-bench-<app> in the current '
+                             'directory)')
+    parser.add_argument('-n', '--no_build', action='store_true',
+                        help='Use an existing build instead of running west build')
+    parser.add_argument('-p', '--port', type=int, default=5683,
+                        help='UDP port of the server stand-in on 127.0.0.1 (default: 5683)')
+    parser.add_argument('-u', '--updates', type=int, default=10,
+                        help='Number of triggered Updates to measure (default: 10)')
+    parser.add_argument('--update_interval', type=float, default=0.5,
+                        help='Delay between triggered Updates [s] (default: 0.5)')
+    parser.add_argument('-i', '--idle_time', type=float, default=30.0,
+                        help='Time during which CPU wakeups are counted with no LwM2M traffic '
+                             '[s], or 0 to skip it (default: 30)')
+    parser.add_argument('-o', '--observe', type=str, default='/3/0/13',
+                        help='Path to observe for the notify throughput, or an empty string '
+                             'to skip it (default: /3/0/13)')
+    parser.add_argument('--pmin', type=int, default=0,
+                        help='pmin attribute set on the observed path (default: 0)')
+    parser.add_argument('--pmax', type=int, default=1,
+                        help='pmax attribute set on the observed path (default: 1)')
+    parser.add_argument('--observe_time', type=float, default=20.0,
+                        help='Time during which notifications are counted [s] (default: 20)')
+    parser.add_argument('--register_timeout', type=float, default=60.0,
+                        help='Maximum time from start to registration [s] (default: 60)')
+    parser.add_argument('--timeout', type=float, default=120.0,
+                        help='Maximum duration of the scenario after registration [s] '
+                             '(default: 120)')
+    parser.add_argument('--report_wait', type=float, default=2.0,
+                        help='Time to wait for the final usage report [s] (default: 2)')
+    parser.add_argument('-l', '--log', type=str,
+                        help='File to save the console output of the client to')
+    parser.add_argument('-j', '--json', type=str,
+                        help='File to save the results to, in JSON format')
+    parser.add_argument('-c', '--compare', type=str,
+                        help='Git revision to benchmark the same application at first, e.g. '
+                             'the one before a change, for a before/after comparison')
+    args = parser.parse_args()
+
+    app_dir = args.app
+    if not os.path.isdir(app_dir):
+        app_dir = os.path.join(REPO_DIR, args.app)
+    build_dir = args.build_dir or os.path.join(
+        os.getcwd(), f'build-bench-{os.path.basename(os.path.normpath(app_dir))}')
+
+    before = None
+    if args.compare:
+        before = run_revision(args, os.path.realpath(app_dir), f'{build_dir}-compare',
+                              args.compare)
+        print(f'== {args.compare}')
+        print_results(before)
+        print('== current tree')
+
+    results = run(args, app_dir, build_dir)
+    print_results(results)
+    failed = 'error' in results or (before is not None and 'error' in before)
+
+    if before:
+        print()
+        print_comparison(before, results)
+        results = {'before': before, 'after': results}
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump(results, f, indent=2)
+
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,312 @@
+# -*- coding: utf-8 -*-
+# Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""
+Minimal LwM2M Server stand-in over plain CoAP/UDP, sufficient to benchmark a
+single client: it accepts Register, Update, De-register and Send, and can
+issue Execute, Write-Attributes and Observe requests. Everything else is left
+out on purpose.
+"""
+
+import asyncio
+import itertools
+import os
+import re
+import struct
+import time
+
+TYPE_CON = 0
+TYPE_NON = 1
+TYPE_ACK = 2
+TYPE_RST = 3
+
+CODE_EMPTY = 0x00
+CODE_GET = 0x01
+CODE_POST = 0x02
+CODE_PUT = 0x03
+CODE_DELETE = 0x04
+CODE_CREATED = 0x41
+CODE_DELETED = 0x42
+CODE_CHANGED = 0x44
+CODE_CONTENT = 0x45
+CODE_CONTINUE = 0x5f
+CODE_NOT_FOUND = 0x84
+
+OPT_OBSERVE = 6
+OPT_LOCATION_PATH = 8
+OPT_URI_PATH = 11
+OPT_URI_QUERY = 15
+OPT_BLOCK1 = 27
+
+
+def code_str(code):
+    return f'{code >> 5}.{code & 0x1f:02d}'
+
+
+def encode_uint(value):
+    if value == 0:
+        return b''
+    return value.to_bytes((value.bit_length() + 7) // 8, 'big')
+
+
+def decode_uint(data):
+    return int.from_bytes(data, 'big') if data else 0
+
+
+class Message:
+    def __init__(self, type, code, mid, token=b'', options=None, payload=b''):
+        self.type = type
+        self.code = code
+        self.mid = mid
+        self.token = token
+        # list of (number, bytes), kept sorted on encoding
+        self.options = options or []
+        self.payload = payload
+
+    def option(self, number):
+        return [value for opt, value in self.options if opt == number]
+
+    def path(self):
+        return [value.decode() for value in self.option(OPT_URI_PATH)]
+
+    def encode(self):
+        data = bytearray(struct.pack('!BBH', 0x40 | (self.type << 4) | len(self.token),
+                                     self.code, self.mid))
+        data += self.token
+        last = 0
+        for number, value in sorted(self.options, key=lambda opt: opt[0]):
+            delta = number - last
+            last = number
+            header = bytearray(1)
+            ext = bytearray()
+            for shift, field in ((4, delta), (0, len(value))):
+                if field < 13:
+                    header[0] |= field << shift
+                elif field < 269:
+                    header[0] |= 13 << shift
+                    ext.append(field - 13)
+                else:
+                    header[0] |= 14 << shift
+                    ext += struct.pack('!H', field - 269)
+            data += header + ext + value
+        if self.payload:
+            data += b'\xff' + self.payload
+        return bytes(data)
+
+    @staticmethod
+    def decode(data):
+        if len(data) < 4 or data[0] >> 6 != 1:
+            raise ValueError('not a CoAP message')
+        type = (data[0] >> 4) & 0x3
+        tkl = data[0] & 0xf
+        code = data[1]
+        mid = struct.unpack('!H', data[2:4])[0]
+        token = data[4:4 + tkl]
+        pos = 4 + tkl
+        options = []
+        number = 0
+        while pos < len(data) and data[pos] != 0xff:
+            delta = data[pos] >> 4
+            length = data[pos] & 0xf
+            pos += 1
+            fields = []
+            for field in (delta, length):
+                if field == 13:
+                    field = data[pos] + 13
+                    pos += 1
+                elif field == 14:
+                    field = struct.unpack('!H', data[pos:pos + 2])[0] + 269
+                    pos += 2
+                elif field == 15:
+                    raise ValueError('invalid option')
+                fields.append(field)
+            number += fields[0]
+            options.append((number, bytes(data[pos:pos + fields[1]])))
+            pos += fields[1]
+        payload = bytes(data[pos + 1:]) if pos < len(data) else b''
+        return Message(type, code, mid, token, options, payload)
+
+
+def path_options(path):
+    return [(OPT_URI_PATH, segment.encode()) for segment in path.strip('/').split('/') if segment]
+
+
+class LwM2MServer(asyncio.DatagramProtocol):
+    """
+    Events are timestamped with time.monotonic() so that they can be compared
+    with the instant at which the client process was started.
+    """
+
+    def __init__(self):
+        self.transport = None
+        self.client_addr = None
+        self.location = None
+        self.registrations = []
+        self.updates = []
+        self.sends = []
+        self.notifications = []
+        self.server_iids = []
+        self.registered = asyncio.Event()
+        self._update_waiters = []
+        self._pending = {}
+        self._observations = set()
+        self._responses = {}
+        self._block1 = {}
+        self._mid = itertools.count(int.from_bytes(os.urandom(2), 'big'))
+        self._location_id = itertools.count(1)
+
+    def connection_made(self, transport):
+        self.transport = transport
+
+    def datagram_received(self, data, addr):
+        now = time.monotonic()
+        try:
+            msg = Message.decode(data)
+        except (ValueError, IndexError, struct.error):
+            return
+
+        if msg.type == TYPE_CON and (addr, msg.mid) in self._responses:
+            # retransmission of a request that has already been answered
+            self.transport.sendto(self._responses[(addr, msg.mid)], addr)
+            return
+
+        if msg.token in self._observations and msg.code == CODE_CONTENT \
+                and msg.token not in self._pending:
+            self.notifications.append(now)
+            if msg.type == TYPE_CON:
+                self._send(Message(TYPE_ACK, CODE_EMPTY, msg.mid), addr)
+            return
+
+        if msg.code >= CODE_CREATED or msg.code == CODE_EMPTY:
+            future = self._pending.pop(msg.token, None)
+            if future and not future.done() and msg.code != CODE_EMPTY:
+                future.set_result(msg)
+            if msg.type == TYPE_CON:
+                self._send(Message(TYPE_ACK, CODE_EMPTY, msg.mid), addr)
+            return
+
+        response = self._handle_request(msg, addr, now)
+        if msg.type == TYPE_CON:
+            response.type = TYPE_ACK
+            response.mid = msg.mid
+        else:
+            response.type = TYPE_NON
+            response.mid = next(self._mid) & 0xffff
+        response.token = msg.token
+        encoded = self._send(response, addr)
+        if msg.type == TYPE_CON:
+            self._responses[(addr, msg.mid)] = encoded
+
+    def _handle_request(self, msg, addr, now):
+        path = msg.path()
+
+        block1 = msg.option(OPT_BLOCK1)
+        if block1:
+            value = decode_uint(block1[0])
+            key = (addr, msg.token)
+            self._block1[key] = self._block1.get(key, b'') + msg.payload
+            if value & 0x8:
+                return Message(None, CODE_CONTINUE, None, options=[(OPT_BLOCK1, block1[0])])
+            msg.payload = self._block1.pop(key)
+
+        if msg.code == CODE_POST and path == ['rd']:
+            self.client_addr = addr
+            self.location = ['rd', str(next(self._location_id))]
+            self.registrations.append(now)
+            self.server_iids = [int(iid) for iid in
+                                re.findall(r'</1/(\d+)>', msg.payload.decode(errors='replace'))]
+            self.registered.set()
+            return Message(None, CODE_CREATED, None,
+                           options=[(OPT_LOCATION_PATH, segment.encode())
+                                    for segment in self.location])
+
+        if path == self.location:
+            if msg.code == CODE_POST:
+                self.updates.append(now)
+                for waiter in self._update_waiters:
+                    if not waiter.done():
+                        waiter.set_result(now)
+                self._update_waiters.clear()
+                return Message(None, CODE_CHANGED, None)
+            if msg.code == CODE_DELETE:
+                self.location = None
+                self.registered.clear()
+                return Message(None, CODE_DELETED, None)
+
+        if msg.code == CODE_POST and path == ['dp']:
+            self.sends.append((now, len(msg.payload)))
+            return Message(None, CODE_CHANGED, None)
+
+        return Message(None, CODE_NOT_FOUND, None)
+
+    def _send(self, msg, addr):
+        encoded = msg.encode()
+        self.transport.sendto(encoded, addr)
+        return encoded
+
+    async def request(self, code, path, options=(), timeout=5.0):
+        """
+        Sends a confirmable request to the registered client and returns the
+        response.
+        """
+        token = os.urandom(4)
+        future = asyncio.get_running_loop().create_future()
+        self._pending[token] = future
+        msg = Message(TYPE_CON, code, next(self._mid) & 0xffff, token,
+                      path_options(path) + list(options))
+        try:
+            # plain exponential back-off, as in RFC 7252
+            for attempt in range(4):
+                self._send(msg, self.client_addr)
+                try:
+                    return await asyncio.wait_for(asyncio.shield(future),
+                                                  timeout * (2 ** attempt) / 15)
+                except asyncio.TimeoutError:
+                    pass
+            raise asyncio.TimeoutError(f'no response to {code_str(code)} {path}')
+        finally:
+            self._pending.pop(token, None)
+
+    async def write_attributes(self, path, **attributes):
+        response = await self.request(
+            CODE_PUT, path,
+            [(OPT_URI_QUERY, f'{name}={value}'.encode()) for name, value in attributes.items()])
+        return response.code == CODE_CHANGED
+
+    async def observe(self, path):
+        token = os.urandom(4)
+        future = asyncio.get_running_loop().create_future()
+        self._pending[token] = future
+        self._observations.add(token)
+        self._send(Message(TYPE_CON, CODE_GET, next(self._mid) & 0xffff, token,
+                           path_options(path) + [(OPT_OBSERVE, b'')]), self.client_addr)
+        try:
+            response = await asyncio.wait_for(future, 5.0)
+        finally:
+            self._pending.pop(token, None)
+        if response.code != CODE_CONTENT or not response.option(OPT_OBSERVE):
+            self._observations.discard(token)
+            return False
+        return True
+
+    async def trigger_update(self, iid, timeout=10.0):
+        """
+        Executes Registration Update Trigger and returns the time elapsed until
+        the resulting Update arrives.
+        """
+        waiter = asyncio.get_running_loop().create_future()
+        self._update_waiters.append(waiter)
+        start = time.monotonic()
+        await self.request(CODE_POST, f'/1/{iid}/8')
+        return await asyncio.wait_for(waiter, timeout) - start
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/sys_heap.h>
+
+/*
+ * Every line starts with "bench:" so that bench.py can pick them out of the
+ * rest of the console output. Only the last report before the process exits
+ * is used, so peak values are what matters.
+ */
+
+#if defined(CONFIG_HEAP_MEM_POOL_SIZE) && CONFIG_HEAP_MEM_POOL_SIZE > 0
+extern struct k_heap _system_heap;
+#endif // defined(CONFIG_HEAP_MEM_POOL_SIZE) && CONFIG_HEAP_MEM_POOL_SIZE > 0
+
+#ifdef CONFIG_COMMON_LIBC_MALLOC
+int malloc_runtime_stats_get(struct sys_memory_stats *stats);
+#endif // CONFIG_COMMON_LIBC_MALLOC
+
+#ifdef CONFIG_BENCH_REPORT_WAKEUPS
+static atomic_t idle_entries;
+
+/*
+ * Called by the tracing subsystem every time the idle thread is about to put
+ * the CPU to sleep, so the count is the number of wakeups that followed.
+ */
+void sys_trace_idle_user(void)
+{
+	atomic_inc(&idle_entries);
+}
+#endif // CONFIG_BENCH_REPORT_WAKEUPS
+
+static void print_heap(const char *name, const struct sys_memory_stats *stats)
+{
+	printk("bench: heap %s used=%zu peak=%zu size=%zu\n", name, stats->allocated_bytes,
+	       stats->max_allocated_bytes, stats->allocated_bytes + stats->free_bytes);
+}
+
+static void print_thread_stack(const struct k_thread *thread, void *user_data)
+{
+	(void)user_data;
+
+	size_t unused;
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	if (k_thread_stack_space_get(thread, &unused)) {
+		return;
+	}
+
+	printk("bench: stack %s used=%zu size=%zu\n", name && *name ? name : "?",
+	       thread->stack_info.size - unused, thread->stack_info.size);
+}
+
+static void report_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(report_work, report_work_handler);
+
+static void report_work_handler(struct k_work *work)
+{
+	(void)work;
+
+	struct sys_memory_stats stats;
+
+#if defined(CONFIG_HEAP_MEM_POOL_SIZE) && CONFIG_HEAP_MEM_POOL_SIZE > 0
+	if (!sys_heap_runtime_stats_get(&_system_heap.heap, &stats)) {
+		print_heap("kernel", &stats);
+	}
+#endif // defined(CONFIG_HEAP_MEM_POOL_SIZE) && CONFIG_HEAP_MEM_POOL_SIZE > 0
+#ifdef CONFIG_COMMON_LIBC_MALLOC
+	if (!malloc_runtime_stats_get(&stats)) {
+		print_heap("libc", &stats);
+	}
+#endif // CONFIG_COMMON_LIBC_MALLOC
+
+	k_thread_foreach_unlocked(print_thread_stack, NULL);
+#ifdef CONFIG_BENCH_REPORT_WAKEUPS
+	printk("bench: wakeups count=%ld uptime_ms=%lld interval_ms=%d\n",
+	       (long)atomic_get(&idle_entries), (long long)k_uptime_get(),
+	       CONFIG_BENCH_REPORT_INTERVAL_MS);
+#endif // CONFIG_BENCH_REPORT_WAKEUPS
+	printk("bench: end\n");
+
+	k_work_schedule(&report_work, K_MSEC(CONFIG_BENCH_REPORT_INTERVAL_MS));
+}
+
+static int bench_report_init(void)
+{
+	k_work_schedule(&report_work, K_MSEC(CONFIG_BENCH_REPORT_INTERVAL_MS));
+	return 0;
+}
+
+SYS_INIT(bench_report_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -15,13 +15,18 @@
 # limitations under the License.
 
 import argparse
+import concurrent.futures
+import hashlib
 import importlib
 import importlib.util
+import json
 import subprocess
 import sys
 import os
 import shutil
 import tempfile
+import threading
+import time
 import yaml
 import west.util
 
@@ -29,34 +34,140 @@ from requests import HTTPError
 from subprocess import CalledProcessError
 
 
+def hash_untracked_files(digest, project_dir, excluded_dirs):
+    """
+    Hashes the untracked, not ignored files of a git repository, skipping build
+    directories, recognized by their CMakeCache.txt, and EXCLUDED_DIRS.
+    """
+    def is_excluded(path):
+        return os.path.exists(os.path.join(path, 'CMakeCache.txt')) or any(
+            os.path.commonpath([path, excluded]) == excluded for excluded in excluded_dirs)
+
+    def hash_file(path):
+        digest.update(os.path.relpath(path, project_dir).encode())
+        with open(path, 'rb') as file:
+            digest.update(hashlib.sha256(file.read()).digest())
+
+    entries = subprocess.run(['git', '-C', project_dir, 'ls-files', '--others', '--exclude-standard',
+                              '--directory', '-z'], capture_output=True, check=True).stdout
+    for entry in sorted(filter(None, entries.split(b'\0'))):
+        path = os.path.join(project_dir, os.fsdecode(entry))
+        if os.path.isfile(path):
+            hash_file(path)
+            continue
+        if is_excluded(os.path.normpath(path)):
+            continue
+        for root, dirs, files in os.walk(path):
+            dirs[:] = sorted(d for d in dirs if not is_excluded(os.path.join(root, d)))
+            for name in sorted(files):
+                hash_file(os.path.join(root, name))
+
+
+def source_tree_hash(excluded_dirs):
+    """
+    Hashes the checked out revision, the uncommitted changes and the untracked
+    files of every project of the west workspace, including the manifest
+    repository.
+    """
+    digest = hashlib.sha256()
+    projects = subprocess.run(['west', 'list', '-f', '{abspath}'], capture_output=True,
+                              check=True, universal_newlines=True).stdout.splitlines()
+
+    for project_dir in sorted(projects):
+        if not os.path.isdir(os.path.join(project_dir, '.git')):
+            continue
+        git = ['git', '-C', project_dir]
+        digest.update(project_dir.encode())
+        digest.update(subprocess.run(git + ['rev-parse', 'HEAD'], capture_output=True,
+                                     check=True).stdout)
+        digest.update(subprocess.run(git + ['diff', 'HEAD', '--binary'], capture_output=True,
+                                     check=True).stdout)
+        hash_untracked_files(digest, project_dir, excluded_dirs)
+
+    return digest.hexdigest()
+
+
 class ZephyrImageBuilder:
+    """
+    Builds the provisioning images into a cache in IMAGE_DIR/cache, keyed on
+    the board, the contents of the configuration files and the source tree.
+    An image is only built if there is none for the current key. The build
+    directories are kept in IMAGE_DIR/build, one per board, image kind and set
+    of configuration files, so that the builds that do happen are incremental.
+    """
+
     def __init__(self, board, image_dir, conf_file):
         script_directory = os.path.dirname(os.path.realpath(__file__))
 
         self.board = board
-        self.image_dir = image_dir if image_dir else os.path.join(
-            os.getcwd(), 'provisioning_builds')
+        self.image_dir = os.path.abspath(image_dir if image_dir else os.path.join(
+            os.getcwd(), 'provisioning_builds'))
         self.conf_file = conf_file
-        self.image_path = {}
         self.overlay = {}
+        self.tree_hash = None
 
         for kind in ['initial', 'final']:
-            self.image_path[kind] = os.path.join(self.image_dir, f'{kind}.hex')
             self.overlay[kind] = os.path.join(
                 script_directory, f'{kind}_overlay_nrf9160dk.conf' if board == "nrf9160dk/nrf9160/ns" and kind == 'final' else f'{kind}_overlay.conf')
 
+    def __conf_files(self, kind):
+        # passed as CONF_FILE; if there are none, prj.conf and the board files
+        # of the application are used, which are part of the source tree
+        if self.conf_file and kind == 'final':
+            return self.conf_file.replace(';', ' ').split()
+        return []
+
+    def __cache_key(self, kind):
+        files = [self.overlay[kind]] + self.__conf_files(kind)
+        for path in files:
+            if not os.path.isfile(path):
+                raise FileNotFoundError(f'Configuration file {path} does not exist')
+
+        if self.tree_hash is None:
+            print('Hashing the source tree')
+            self.tree_hash = source_tree_hash([self.image_dir])
+
+        digest = hashlib.sha256()
+        digest.update(f'{self.board}\0{kind}\0{self.tree_hash}\0'.encode())
+        for path in files:
+            digest.update(f'{path}\0'.encode())
+            with open(path, 'rb') as file:
+                digest.update(hashlib.sha256(file.read()).digest())
+        return digest.hexdigest()[:16]
+
+    def __build_directory(self, kind):
+        # CMake keeps CONF_FILE in its cache when it is not passed, so the
+        # builds with different CONF_FILE settings must not share a directory
+        conf_files = self.__conf_files(kind)
+        config = hashlib.sha256('\0'.join(conf_files).encode()).hexdigest()[:16] \
+            if conf_files else 'default'
+        return os.path.join(self.image_dir, 'build', self.board.replace('/', '_'),
+                            f'{kind}-{config}')
+
     def __build(self, kind):
-        current_build_directory = os.path.join(self.image_dir, kind)
+        cached_image = os.path.join(self.image_dir, 'cache',
+                                    f'{kind}-{self.__cache_key(kind)}.hex')
+        if os.path.exists(cached_image):
+            print(f'Using cached {kind} image {cached_image}')
+            return cached_image
+
+        current_build_directory = self.__build_directory(kind)
         os.makedirs(current_build_directory, exist_ok=True)
 
-        subprocess.run(['west', 'build', '-b', self.board, '-d', current_build_directory,
-                        '-p', '--', f'-DOVERLAY_CONFIG={self.overlay[kind]}', f'-DCONF_FILE={self.conf_file}' if self.conf_file and kind == 'final' else ''], check=True)
+        command = ['west', 'build', '-b', self.board, '-d', current_build_directory,
+                   '-p', 'auto', '--', f'-DOVERLAY_CONFIG={self.overlay[kind]}']
+        conf_files = self.__conf_files(kind)
+        if conf_files:
+            command.append(f'-DCONF_FILE={";".join(conf_files)}')
+        subprocess.run(command, check=True)
 
-        shutil.move(os.path.join(current_build_directory,
-                    'zephyr/merged.hex'), self.image_path[kind])
-        shutil.rmtree(current_build_directory)
+        # an interrupted copy must not leave a truncated image under the final name
+        os.makedirs(os.path.dirname(cached_image), exist_ok=True)
+        shutil.copyfile(os.path.join(current_build_directory,
+                        'zephyr/merged.hex'), cached_image + '.tmp')
+        os.replace(cached_image + '.tmp', cached_image)
 
-        return self.image_path[kind]
+        return cached_image
 
     def build_initial_image(self):
         return self.__build('initial')
@@ -132,7 +243,7 @@ def mcumgr_download(port, src, baud=115200):
         command = ['mcumgr', '--conntype', 'serial', '--connstring', connstring,
                    'fs', 'download', src, dst_file_name, '-t', '30']
 
-        subprocess.run(command, cwd=os.getcwd(),
+        subprocess.run(command, cwd=dst_dir_name,
                        universal_newlines=True, check=True)
 
         with open(dst_file_name) as dst_file:
@@ -140,8 +251,244 @@ def mcumgr_download(port, src, baud=115200):
 
 
 def mcumgr_upload(port, src, dst, baud=115200):
+    if not os.path.isabs(src):
+        raise ValueError(f'{src} is not an absolute path')
     subprocess.run(['mcumgr', '--conntype', 'serial', '--connstring', f'dev={port},baud={baud}', 'fs', 'upload', src, dst],
-                   cwd=os.getcwd(), universal_newlines=True, check=True)
+                   cwd=os.path.dirname(src), universal_newlines=True, check=True)
+
+
+# FactoryProvisioning.provision_device() writes SenMLCBOR to the current
+# directory, which is shared by all threads
+provision_cwd_lock = threading.Lock()
+
+
+def provision_device_in(fcty, directory):
+    """
+    Runs fcty.provision_device() in DIRECTORY and returns the path of the
+    SenMLCBOR file it has written there. The current directory is changed for
+    the whole process while it runs, so all the other paths used by this
+    script must be absolute; see make_paths_absolute().
+    """
+    with provision_cwd_lock:
+        last_cwd = os.getcwd()
+        os.chdir(directory)
+        try:
+            fcty.provision_device()
+        finally:
+            os.chdir(last_cwd)
+    return os.path.join(directory, 'SenMLCBOR')
+
+
+def make_paths_absolute(args):
+    """
+    Resolves the paths given on the command line against the current
+    directory, before anything changes it.
+    """
+    for name in ['image_dir', 'endpoint_cfg', 'server', 'cert', 'pkey', 'pcert', 'scert',
+                 'batch']:
+        if getattr(args, name):
+            setattr(args, name, os.path.abspath(getattr(args, name)))
+
+    if args.conf_file:
+        args.conf_file = ';'.join(os.path.abspath(path)
+                                  for path in args.conf_file.replace(';', ' ').split())
+
+
+class BoardJob:
+    """
+    Provisioning of a single board in batch mode, with the time spent in each
+    stage and the stage that failed, if any.
+    """
+
+    def __init__(self, serial, endpoint_cfg, vcom):
+        self.serial = serial
+        self.endpoint_cfg = endpoint_cfg
+        self.vcom = vcom
+        self.endpoint_name = None
+        self.fcty = None
+        self.temp_dir = None
+        self.config_file = None
+        self.timings = {}
+        self.attempts = {}
+        self.failed_stage = None
+        self.error = None
+
+
+def load_batch(path, default_vcom):
+    """
+    Reads a JSON list of boards, each an object with the "serial" and
+    "endpoint_cfg" keys, and optionally "vcom". Relative endpoint_cfg paths are
+    resolved against the directory of the batch file.
+    """
+    with open(path) as batch_file:
+        entries = json.load(batch_file)
+
+    batch_dir = os.path.dirname(os.path.abspath(path))
+    jobs = []
+    for entry in entries:
+        jobs.append(BoardJob(str(entry['serial']),
+                             os.path.join(batch_dir, entry['endpoint_cfg']),
+                             entry.get('vcom', default_vcom)))
+
+    serials = [job.serial for job in jobs]
+    if not serials:
+        raise ValueError('No boards in the batch file')
+    if len(set(serials)) != len(serials):
+        raise ValueError('Duplicate serial numbers in the batch file')
+
+    return jobs
+
+
+class BatchProvisioner:
+    """
+    Runs the provisioning stages of many boards concurrently, one worker thread
+    per board, so that e.g. one board is flashed while another is being
+    uploaded to. A failed stage is retried on its own, without repeating the
+    stages that preceded it.
+
+    The device adapter factory and the mcumgr functions can be replaced, e.g.
+    with mocks.
+    """
+
+    STAGES = ['flash_initial', 'read_endpoint', 'generate', 'upload', 'check_result',
+              'register', 'flash_final']
+
+    def __init__(self, args, fp, initial_image, final_image, retries,
+                 adapter_factory=get_device_adapter, upload=mcumgr_upload,
+                 download=mcumgr_download):
+        self.args = args
+        self.fp = fp
+        self.initial_image = initial_image
+        self.final_image = final_image
+        self.retries = retries
+        self.adapter_factory = adapter_factory
+        self.upload = upload
+        self.download = download
+        self.print_lock = threading.Lock()
+
+    def log(self, job, message):
+        with self.print_lock:
+            print(f'[{job.serial}] {message}', flush=True)
+
+    def flash_initial(self, job, adapter):
+        flash_device(adapter, self.initial_image, True, 'Device ready for provisioning.')
+
+    def read_endpoint(self, job, adapter):
+        job.endpoint_name = self.download(adapter.get_port(), '/factory/endpoint.txt',
+                                          self.args.baudrate)
+        self.log(job, f'endpoint name: {job.endpoint_name}')
+
+    def generate(self, job, adapter):
+        args = self.args
+        job.fcty = self.fp.FactoryProvisioning(job.endpoint_cfg, job.endpoint_name, args.server,
+                                               args.token, args.cert)
+        if job.fcty.get_sec_mode() == 'cert':
+            if args.scert is not None:
+                job.fcty.set_server_cert(args.scert)
+
+            if args.cert is not None:
+                job.fcty.generate_self_signed_cert()
+            elif args.pkey is not None and args.pcert is not None:
+                job.fcty.set_endpoint_cert_and_key(args.pcert, args.pkey)
+
+        job.config_file = provision_device_in(job.fcty, job.temp_dir)
+
+    def upload_config(self, job, adapter):
+        self.upload(adapter.get_port(), job.config_file, '/factory/provision.cbor',
+                    self.args.baudrate)
+
+    def check_result(self, job, adapter):
+        if int(self.download(adapter.get_port(), '/factory/result.txt',
+                             self.args.baudrate)) != 0:
+            raise RuntimeError('Bad device provisioning result')
+
+    def register(self, job, adapter):
+        if self.args.server and self.args.token:
+            job.fcty.register()
+
+    def flash_final(self, job, adapter):
+        flash_device(adapter, self.final_image, False, 'persistence: Anjay restored from')
+
+    def run_stage(self, job, stage, function, adapter):
+        for attempt in range(1, self.retries + 2):
+            job.attempts[stage] = attempt
+            start = time.monotonic()
+            try:
+                function(job, adapter)
+            except Exception as e:
+                job.timings[stage] = time.monotonic() - start
+                self.log(job, f'{stage} failed (attempt {attempt}): {e!r}')
+                job.error = e
+                continue
+
+            job.timings[stage] = time.monotonic() - start
+            job.error = None
+            self.log(job, f'{stage} done in {job.timings[stage]:.1f} s')
+            return True
+
+        job.failed_stage = stage
+        return False
+
+    def run_job(self, job):
+        functions = {
+            'flash_initial': self.flash_initial,
+            'read_endpoint': self.read_endpoint,
+            'generate': self.generate,
+            'upload': self.upload_config,
+            'check_result': self.check_result,
+            'register': self.register,
+            'flash_final': self.flash_final,
+        }
+
+        with tempfile.TemporaryDirectory() as temp_dir:
+            job.temp_dir = temp_dir
+            adapter = self.adapter_factory(job.serial, self.args.baudrate, job.vcom)
+            for stage in self.STAGES:
+                if not self.run_stage(job, stage, functions[stage], adapter):
+                    break
+            job.temp_dir = None
+            job.config_file = None
+        return job
+
+    def run(self, jobs, max_workers):
+        with concurrent.futures.ThreadPoolExecutor(max_workers=max_workers) as executor:
+            for future in concurrent.futures.as_completed(
+                    [executor.submit(self.run_job, job) for job in jobs]):
+                job = future.result()
+                self.log(job, 'provisioned' if job.failed_stage is None else
+                         f'FAILED at {job.failed_stage}: {job.error!r}')
+
+    def print_report(self, jobs):
+        columns = ['serial'] + self.STAGES + ['total', 'result']
+        widths = [max(len(columns[0]), max(len(job.serial) for job in jobs))] + \
+            [max(len(column), 8) for column in columns[1:]]
+
+        def row(cells):
+            return '  '.join(str(cell).rjust(width) for cell, width in zip(cells, widths))
+
+        print(row(columns))
+        for job in jobs:
+            cells = [job.serial]
+            for stage in self.STAGES:
+                if stage in job.timings:
+                    retried = job.attempts[stage] - 1
+                    cells.append(f'{job.timings[stage]:.1f}s' + (f'+{retried}' if retried else ''))
+                else:
+                    cells.append('-')
+            cells.append(f'{sum(job.timings.values()):.1f}s')
+            cells.append('ok' if job.failed_stage is None else 'FAILED')
+            print(row(cells))
+
+        print('Stage times over successful attempts (mean / max):')
+        for stage in self.STAGES:
+            times = [job.timings[stage] for job in jobs
+                     if stage in job.timings and job.failed_stage != stage]
+            if times:
+                print(f'  {stage:<14} {sum(times) / len(times):8.1f} s {max(times):8.1f} s')
+
+        failed = [job for job in jobs if job.failed_stage is not None]
+        print(f'{len(jobs) - len(failed)} of {len(jobs)} boards provisioned')
+        return not failed
 
 
 def get_anjay_zephyr_path(manifest_path):
@@ -191,8 +538,8 @@ def main():
 
     # Arguments for flashing
     parser.add_argument('-s', '--serial', type=str,
-                        help='Serial number of the device to be used',
-                        required=True)
+                        help='Serial number of the device to be used, required unless BATCH is set',
+                        required=False)
     parser.add_argument('-B', '--baudrate', type=int,
                         help='Baudrate for the used serial port',
                         required=False, default=115200)
@@ -202,8 +549,8 @@ def main():
 
     # Arguments for factory_provisioning library
     parser.add_argument('-c', '--endpoint_cfg', type=str,
-                        help='Configuration file containing device information to be loaded on the device',
-                        required=True)
+                        help='Configuration file containing device information to be loaded on the device, required unless BATCH is set',
+                        required=False)
     parser.add_argument('-S', '--server', type=str,
                         help='JSON format file containing Coiote server information',
                         required=False)
@@ -223,8 +570,24 @@ def main():
                         help='Server public cert in DER format',
                         required=False)
 
+    # Arguments for batch mode
+    parser.add_argument('-l', '--batch', type=str,
+                        help='JSON file with a list of boards to provision concurrently, each with "serial", "endpoint_cfg" and optionally "vcom" keys; replaces SERIAL and ENDPOINT_CFG',
+                        required=False)
+    parser.add_argument('-j', '--jobs', type=int,
+                        help='Maximum number of boards provisioned at the same time in batch mode, all of them by default',
+                        required=False)
+    parser.add_argument('-R', '--retries', type=int,
+                        help='Number of retries of a failed stage in batch mode',
+                        required=False, default=2)
+
     args = parser.parse_args()
 
+    if not args.batch and not (args.serial and args.endpoint_cfg):
+        parser.error('SERIAL and ENDPOINT_CFG are required unless BATCH is set')
+
+    make_paths_absolute(args)
+
     # This is called also as an early check if the proper west config is set
     manifest_path = get_manifest_path()
 
@@ -243,6 +606,14 @@ def main():
 
     print('Zephyr Images ready!')
 
+    if args.batch:
+        jobs = load_batch(args.batch, args.vcom)
+        provisioner = BatchProvisioner(args, fp, initial_image, final_image, args.retries)
+        provisioner.run(jobs, args.jobs or len(jobs))
+        if not provisioner.print_report(jobs):
+            sys.exit(1)
+        return
+
     adapter = get_device_adapter(args.serial, args.baudrate, args.vcom)
     flash_device(adapter, initial_image, True,
                  'Device ready for provisioning.')
@@ -265,12 +636,8 @@ def main():
             fcty.set_endpoint_cert_and_key(args.pcert, args.pkey)
 
     with tempfile.TemporaryDirectory() as temp_directory:
-        last_cwd = os.getcwd()
-        os.chdir(temp_directory)
-        fcty.provision_device()
-        mcumgr_upload(adapter.get_port(), 'SenMLCBOR',
+        mcumgr_upload(adapter.get_port(), provision_device_in(fcty, temp_directory),
                       '/factory/provision.cbor', args.baudrate)
-        os.chdir(last_cwd)
 
     if int(mcumgr_download(port, '/factory/result.txt', args.baudrate)) != 0:
         raise RuntimeError('Bad device provisioning result')
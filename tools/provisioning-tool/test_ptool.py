@@ -0,0 +1,269 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+# Copyright 2020-2024 AVSystem <avsystem@avsystem.com>
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Tests of the image cache and the batch mode of ptool.py, with west, the
+device adapter, mcumgr and the factory_prov library replaced by mocks. Run
+from this directory with:
+
+    python3 -m unittest test_ptool
+"""
+
+import argparse
+import contextlib
+import io
+import json
+import os
+import sys
+import tempfile
+import threading
+import types
+import unittest
+import unittest.mock
+
+# ptool.py imports these at the top, but the batch mode does not use them
+try:
+    import requests  # noqa: F401
+except ImportError:
+    sys.modules['requests'] = types.SimpleNamespace(HTTPError=Exception)
+try:
+    import west.util  # noqa: F401
+except ImportError:
+    sys.modules['west'] = types.SimpleNamespace(util=types.SimpleNamespace())
+    sys.modules['west.util'] = sys.modules['west'].util
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import ptool  # noqa: E402
+
+
+class MockAdapter:
+    def __init__(self, test, serial):
+        self.test = test
+        self.serial = serial
+
+    def acquire_device(self):
+        pass
+
+    def flash_device(self, image, chiperase):
+        self.test.record(self.serial, 'flash', image)
+        if self.test.take_failure(self.serial, 'flash'):
+            raise RuntimeError('flashing failed')
+
+    def skip_until(self, text):
+        pass
+
+    def skip_until_prompt(self):
+        pass
+
+    def release_device(self, erase):
+        pass
+
+    def get_port(self):
+        return f'/dev/mock{self.serial}'
+
+
+class MockFactoryProvisioning:
+    """
+    Writes the contents of the endpoint configuration file, followed by the
+    endpoint name, to SenMLCBOR in the current directory, like the real one
+    writes the configuration.
+    """
+
+    def __init__(self, endpoint_cfg, endpoint_name, server, token, cert):
+        self.endpoint_cfg = endpoint_cfg
+        self.endpoint_name = endpoint_name
+
+    def get_sec_mode(self):
+        return 'psk'
+
+    def provision_device(self):
+        with open(self.endpoint_cfg) as cfg, open('SenMLCBOR', 'w') as output:
+            output.write(f'{cfg.read()}:{self.endpoint_name}')
+
+    def register(self):
+        pass
+
+
+class BatchProvisionerTest(unittest.TestCase):
+    def setUp(self):
+        self.lock = threading.Lock()
+        self.calls = []
+        self.failures = {}
+        self.results = {}
+        self.uploaded = {}
+
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.addCleanup(self.temp_dir.cleanup)
+        self.fp = types.SimpleNamespace(FactoryProvisioning=MockFactoryProvisioning)
+
+    def record(self, serial, call, argument):
+        with self.lock:
+            self.calls.append((serial, call, argument))
+
+    def take_failure(self, serial, call):
+        with self.lock:
+            left = self.failures.get((serial, call), 0)
+            self.failures[(serial, call)] = max(left - 1, 0)
+            return left > 0
+
+    def upload(self, port, src, dst, baud):
+        self.assertTrue(os.path.isabs(src))
+        serial = port[len('/dev/mock'):]
+        self.record(serial, 'upload', dst)
+        if self.take_failure(serial, 'upload'):
+            raise RuntimeError('upload failed')
+        with open(src) as file:
+            self.uploaded[serial] = file.read()
+
+    def download(self, port, src, baud):
+        serial = port[len('/dev/mock'):]
+        self.record(serial, 'download', src)
+        if src == '/factory/endpoint.txt':
+            return f'ep-{serial}'
+        return self.results.get(serial, '0')
+
+    def make_batch(self, serials):
+        batch_path = os.path.join(self.temp_dir.name, 'batch.json')
+        entries = []
+        for serial in serials:
+            with open(os.path.join(self.temp_dir.name, f'cfg_{serial}'), 'w') as cfg:
+                cfg.write(f'cfg-{serial}')
+            entries.append({'serial': serial, 'endpoint_cfg': f'cfg_{serial}'})
+        with open(batch_path, 'w') as batch_file:
+            json.dump(entries, batch_file)
+        return ptool.load_batch(batch_path, 'VCOM0')
+
+    def provision(self, jobs, retries=2):
+        args = argparse.Namespace(baudrate=115200, server=None, token=None, cert=None,
+                                  pkey=None, pcert=None, scert=None)
+        provisioner = ptool.BatchProvisioner(
+            args, self.fp, '/images/initial.hex', '/images/final.hex', retries,
+            adapter_factory=lambda serial, baudrate, vcom: MockAdapter(self, serial),
+            upload=self.upload, download=self.download)
+        with contextlib.redirect_stdout(io.StringIO()):
+            provisioner.run(jobs, len(jobs))
+            return provisioner.print_report(jobs)
+
+    def count(self, serial, call, argument):
+        return self.calls.count((serial, call, argument))
+
+    def test_boards_provisioned_concurrently(self):
+        cwd = os.getcwd()
+        jobs = self.make_batch(['1', '2', '3', '4'])
+
+        self.assertTrue(self.provision(jobs))
+        self.assertEqual(os.getcwd(), cwd)
+        for job in jobs:
+            self.assertIsNone(job.failed_stage)
+            self.assertEqual(list(job.timings), ptool.BatchProvisioner.STAGES)
+            # each board gets the configuration generated for it
+            self.assertEqual(self.uploaded[job.serial], f'cfg-{job.serial}:ep-{job.serial}')
+            self.assertEqual(self.count(job.serial, 'flash', '/images/initial.hex'), 1)
+            self.assertEqual(self.count(job.serial, 'flash', '/images/final.hex'), 1)
+
+    def test_failed_stage_retried_alone(self):
+        jobs = self.make_batch(['1', '2'])
+        self.failures[('1', 'flash')] = 1
+        self.failures[('2', 'upload')] = 1
+
+        self.assertTrue(self.provision(jobs))
+        self.assertEqual(jobs[0].attempts['flash_initial'], 2)
+        self.assertEqual(self.count('1', 'flash', '/images/initial.hex'), 2)
+        self.assertEqual(jobs[1].attempts['upload'], 2)
+        self.assertEqual(jobs[1].attempts['read_endpoint'], 1)
+        self.assertEqual(self.count('2', 'download', '/factory/endpoint.txt'), 1)
+        self.assertEqual(self.count('2', 'flash', '/images/initial.hex'), 1)
+
+    def test_board_fails_after_retries(self):
+        jobs = self.make_batch(['1', '2'])
+        self.results['2'] = '-1'
+
+        self.assertFalse(self.provision(jobs, retries=2))
+        self.assertIsNone(jobs[0].failed_stage)
+        self.assertEqual(jobs[1].failed_stage, 'check_result')
+        self.assertEqual(jobs[1].attempts['check_result'], 3)
+        self.assertEqual(self.count('2', 'upload', '/factory/provision.cbor'), 1)
+        self.assertEqual(self.count('2', 'flash', '/images/final.hex'), 0)
+
+
+class ZephyrImageBuilderTest(unittest.TestCase):
+    def setUp(self):
+        self.temp_dir = tempfile.TemporaryDirectory()
+        self.addCleanup(self.temp_dir.cleanup)
+        self.commands = []
+
+    def west_build(self, command, check):
+        self.commands.append(command)
+        build_dir = command[command.index('-d') + 1]
+        os.makedirs(os.path.join(build_dir, 'zephyr'), exist_ok=True)
+        with open(os.path.join(build_dir, 'zephyr', 'merged.hex'), 'w') as image:
+            image.write(' '.join(command))
+
+    def builder(self, conf_file):
+        builder = ptool.ZephyrImageBuilder('mock_board', self.temp_dir.name, conf_file)
+        # not hashing the workspace, there is none
+        builder.tree_hash = '0'
+        return builder
+
+    def test_missing_conf_file(self):
+        builder = self.builder(os.path.join(self.temp_dir.name, 'missing.conf'))
+
+        with unittest.mock.patch.object(ptool.subprocess, 'run', self.west_build):
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.assertRaises(FileNotFoundError, builder.build_final_image)
+        self.assertEqual(self.commands, [])
+
+    def test_conf_file_builds_do_not_share_a_directory(self):
+        conf_file = os.path.join(self.temp_dir.name, 'extra.conf')
+        with open(conf_file, 'w') as file:
+            file.write('CONFIG_X=y\n')
+
+        with unittest.mock.patch.object(ptool.subprocess, 'run', self.west_build):
+            with contextlib.redirect_stdout(io.StringIO()):
+                self.builder(conf_file).build_final_image()
+                self.builder(None).build_final_image()
+                # cached
+                self.builder(None).build_final_image()
+
+        self.assertEqual(len(self.commands), 2)
+        with_conf, without_conf = self.commands
+        self.assertIn(f'-DCONF_FILE={conf_file}', with_conf)
+        self.assertFalse(any(arg.startswith('-DCONF_FILE') or not arg for arg in without_conf))
+        self.assertNotEqual(with_conf[with_conf.index('-d') + 1],
+                            without_conf[without_conf.index('-d') + 1])
+
+
+class MakePathsAbsoluteTest(unittest.TestCase):
+    def test_paths_resolved_against_current_directory(self):
+        args = argparse.Namespace(image_dir='images', endpoint_cfg='cfg', server=None,
+                                  cert='../cert.json', pkey=None, pcert=None,
+                                  scert='/certs/server.der', batch='batch.json',
+                                  conf_file='prj.conf;extra.conf')
+        ptool.make_paths_absolute(args)
+
+        cwd = os.getcwd()
+        self.assertEqual(args.image_dir, os.path.join(cwd, 'images'))
+        self.assertEqual(args.endpoint_cfg, os.path.join(cwd, 'cfg'))
+        self.assertIsNone(args.server)
+        self.assertEqual(args.cert, os.path.join(os.path.dirname(cwd), 'cert.json'))
+        self.assertEqual(args.scert, '/certs/server.der')
+        self.assertEqual(args.batch, os.path.join(cwd, 'batch.json'))
+        self.assertEqual(args.conf_file, ';'.join([os.path.join(cwd, 'prj.conf'),
+                                                   os.path.join(cwd, 'extra.conf')]))
+
+
+if __name__ == '__main__':
+    unittest.main()